@@ -0,0 +1,254 @@
+// An h2load-style benchmark: the same handler served over HTTP/1.1, one
+// request per connection, and over HTTP/2 (h2c), with streams requests in
+// flight on each connection. Both runs keep connections * streams requests
+// outstanding.
+// usage: http2.out [seconds] [connections] [streams] [port]
+#include "http/httpserver.h"
+#include "http2/frame.h"
+#include "http2/hpack.h"
+#include "http2/session.h"
+#include "middleware/http2/http2.h"
+#include "socket/socket.h"
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+using Clock = std::chrono::steady_clock;
+
+struct Totals {
+  std::atomic<uint64_t> done{0};
+  std::atomic<uint64_t> errors{0};
+  // summed request latency, in microseconds
+  std::atomic<uint64_t> latency{0};
+};
+
+struct Target {
+  struct sockaddr_storage addr;
+  socklen_t addrlen;
+};
+
+static uint64_t micros(Clock::time_point since) {
+  return (uint64_t)std::chrono::duration_cast<std::chrono::microseconds>(
+             Clock::now() - since)
+      .count();
+}
+
+// one client: a new connection for each request, read until EOF
+static void http1_client(const Target &target, Clock::time_point deadline,
+                         Totals &totals) {
+  static const std::string request = "GET / HTTP/1.1\r\nHost: bench\r\n\r\n";
+  char buf[4096];
+
+  while (Clock::now() < deadline) {
+    Clock::time_point start = Clock::now();
+    auto connect_ret =
+        SocketGenerator::connect(target.addr, target.addrlen, -1);
+    if (connect_ret.is_err()) {
+      ++totals.errors;
+      continue;
+    }
+    SocketClient sc = std::move(connect_ret.unwrap());
+    Writer writer{sc.connfd.unwrap()};
+    Reader reader{sc.connfd.unwrap()};
+    if (writer.write(request).is_err() || writer.flush().is_err()) {
+      ++totals.errors;
+      continue;
+    }
+
+    size_t total = 0;
+    for (;;) {
+      auto read_ret = reader.read(buf, sizeof(buf));
+      if (read_ret.is_err() || read_ret.unwrap() == 0) {
+        break;
+      }
+      total += read_ret.unwrap();
+    }
+    if (total) {
+      ++totals.done;
+      totals.latency += micros(start);
+    } else {
+      ++totals.errors;
+    }
+  }
+}
+
+// one client: a single connection, streams requests kept in flight
+static void http2_client(const Target &target, Clock::time_point deadline,
+                         size_t streams, Totals &totals) {
+  auto connect_ret = SocketGenerator::connect(target.addr, target.addrlen, -1);
+  if (connect_ret.is_err()) {
+    ++totals.errors;
+    return;
+  }
+  SocketClient sc = std::move(connect_ret.unwrap());
+  Writer writer{sc.connfd.unwrap()};
+  Reader reader{sc.connfd.unwrap()};
+
+  // the largest windows, so that flow control never stalls a response
+  char settings[6];
+  write_u16(settings, (uint16_t)H2Setting::initial_window_size);
+  write_u32(settings + 2, (uint32_t)H2_MAX_WINDOW);
+  char increment[4];
+  write_u32(increment, (uint32_t)(H2_MAX_WINDOW - H2_DEFAULT_WINDOW));
+  (void)writer.write(H2_PREFACE, H2_PREFACE_LEN);
+  (void)write_frame(writer, H2Type::settings, 0, 0, settings,
+                    sizeof(settings));
+  (void)write_frame(writer, H2Type::window_update, 0, 0, increment,
+                    sizeof(increment));
+
+  static const HeaderList request = {{":method", "GET"},
+                                     {":scheme", "http"},
+                                     {":path", "/"},
+                                     {":authority", "bench"}};
+  HpackEncoder encoder;
+  uint32_t next_stream = 1;
+  std::unordered_map<uint32_t, Clock::time_point> started;
+  auto open = [&]() {
+    std::string block;
+    encoder.encode(request, block);
+    started[next_stream] = Clock::now();
+    (void)write_frame(writer, H2Type::headers, H2_END_STREAM | H2_END_HEADERS,
+                      next_stream, block.data(), block.size());
+    next_stream += 2;
+  };
+
+  for (size_t i = 0; i < streams; ++i) {
+    open();
+  }
+  if (writer.flush().is_err()) {
+    ++totals.errors;
+    return;
+  }
+
+  // DATA received since the last connection WINDOW_UPDATE
+  uint32_t received = 0;
+  H2Frame frame;
+  while (!started.empty()) {
+    auto read_ret = frame.read(reader, H2_DEFAULT_FRAME_SIZE);
+    if (read_ret.is_err() || !read_ret.unwrap() ||
+        frame.type == H2Type::goaway) {
+      totals.errors += started.size();
+      return;
+    }
+
+    bool ended = false;
+    if (frame.type == H2Type::settings && !(frame.flags & H2_ACK)) {
+      (void)write_frame(writer, H2Type::settings, H2_ACK, 0, nullptr, 0);
+    } else if (frame.type == H2Type::data) {
+      received += frame.length;
+      if (received >= H2_MAX_WINDOW / 2) {
+        write_u32(increment, received);
+        (void)write_frame(writer, H2Type::window_update, 0, 0, increment,
+                          sizeof(increment));
+        received = 0;
+      }
+      ended = frame.flags & H2_END_STREAM;
+    } else if (frame.type == H2Type::headers) {
+      ended = frame.flags & H2_END_STREAM;
+    } else if (frame.type == H2Type::rst_stream) {
+      ++totals.errors;
+      started.erase(frame.stream);
+    }
+
+    if (ended) {
+      auto it = started.find(frame.stream);
+      if (it != started.end()) {
+        ++totals.done;
+        totals.latency += micros(it->second);
+        started.erase(it);
+      }
+    }
+    if (started.size() < streams && Clock::now() < deadline) {
+      open();
+    }
+    if (writer.flush().is_err()) {
+      totals.errors += started.size();
+      return;
+    }
+  }
+}
+
+static void report(const char *name, const Totals &totals, double seconds) {
+  uint64_t done = totals.done;
+  printf("%-9s %10.0f req/s  %8.3f ms mean latency  %llu errors\n", name,
+         (double)done / seconds,
+         done ? (double)totals.latency / (double)done / 1000.0 : 0.0,
+         (unsigned long long)totals.errors.load());
+}
+
+int main(int argc, char **argv) {
+  double seconds = argc > 1 ? atof(argv[1]) : 1.0;
+  size_t connections = argc > 2 ? (size_t)atol(argv[2]) : 4;
+  size_t streams = argc > 3 ? (size_t)atol(argv[3]) : 16;
+  int port = argc > 4 ? atoi(argv[4]) : 18180;
+  if (seconds <= 0 || !connections || !streams ||
+      streams > H2_MAX_CONCURRENT_STREAMS) {
+    fprintf(stderr, "usage: %s [seconds] [connections] [streams] [port]\n",
+            argv[0]);
+    return 1;
+  }
+
+  ServerOptions options;
+  options.reuse_addr = true;
+  HttpServer http{port, options};
+  http.use(Http2()).use([](Context &ctx, const Task &next) {
+    ctx.resp.status = "200";
+    ctx.resp.headers["Content-Type"] = "text/plain";
+    ctx.resp.setContent("ok\n");
+    next.drop();
+  });
+  std::thread server{&HttpServer::run, &http};
+
+  Target target;
+  auto resolve_ret =
+      SocketGenerator::resolve("127.0.0.1", port, target.addr, target.addrlen);
+  if (resolve_ret.is_err()) {
+    fprintf(stderr, "cannot resolve 127.0.0.1\n");
+    http.stop();
+    server.join();
+    return 1;
+  }
+
+  printf("%.1fs, %zu connections x %zu streams\n", seconds, connections,
+         streams);
+  auto duration = std::chrono::duration_cast<Clock::duration>(
+      std::chrono::duration<double>(seconds));
+
+  Totals http1;
+  {
+    Clock::time_point deadline = Clock::now() + duration;
+    std::vector<std::thread> clients;
+    for (size_t i = 0; i < connections * streams; ++i) {
+      clients.emplace_back(http1_client, std::cref(target), deadline,
+                           std::ref(http1));
+    }
+    for (auto &client : clients) {
+      client.join();
+    }
+  }
+  report("HTTP/1.1", http1, seconds);
+
+  Totals http2;
+  {
+    Clock::time_point deadline = Clock::now() + duration;
+    std::vector<std::thread> clients;
+    for (size_t i = 0; i < connections; ++i) {
+      clients.emplace_back(http2_client, std::cref(target), deadline, streams,
+                           std::ref(http2));
+    }
+    for (auto &client : clients) {
+      client.join();
+    }
+  }
+  report("HTTP/2", http2, seconds);
+
+  http.stop();
+  server.join();
+  return http1.errors || http2.errors ? 1 : 0;
+}
@@ -0,0 +1,80 @@
+#pragma once
+
+#include "accesslog/ring.h"
+#include "common.h"
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+struct AccessLogOptions {
+  // file the log is appended to; empty means the standard output
+  std::string path;
+  // entries buffered per thread before the writer catches up
+  size_t ring_size = 256;
+  // when the buffer of a thread is full, wait for room (true) or drop the
+  // entry and count it (false)
+  bool block = false;
+};
+
+/*
+ * The writer of an access log. Each thread that records requests gets a ring
+ * of its own (AccessRing) the first time, so recording never takes a lock
+ * nor contends with the other threads. A background thread drains the rings,
+ * formats the entries in Combined Log Format (without referer and user
+ * agent, with the latency in seconds appended) and writes them in batches.
+ *
+ * The ring of a thread that exits is reused by the next thread once it is
+ * drained, so the rings in memory are bounded by the threads recording at
+ * the same time.
+ */
+class AccessLogger {
+private:
+  AccessLogOptions options;
+  // identifies the logger in the rings attached to a thread
+  uint64_t id;
+  int fd;
+
+  std::mutex mutex;
+  std::condition_variable cv;
+  bool stopping;
+  // every ring ever created, attached to a thread or free
+  std::vector<std::shared_ptr<AccessRing>> rings;
+  std::atomic<uint64_t> drops;
+
+  std::thread thread;
+
+  // "[10/Oct/2000:13:55:36 +0000]" of the last second formatted
+  int64_t stamp_second;
+  std::string stamp;
+
+private:
+  // the ring of the calling thread
+  AccessRing &local();
+  std::shared_ptr<AccessRing> attach();
+
+  void run();
+  void format(const AccessEntry &entry, std::string &out);
+  void flush(std::string &out);
+
+public:
+  // throws std::system_error if the file cannot be opened
+  explicit AccessLogger(const AccessLogOptions &options);
+  // writes what the rings hold, then closes the file
+  ~AccessLogger();
+
+  NOT_COPYABLE(AccessLogger);
+  NOT_MOVEABLE(AccessLogger);
+
+  // a slot of the ring of the calling thread to fill, published by commit();
+  // nullptr if the entry is dropped
+  AccessEntry *reserve();
+  void commit();
+
+  // entries dropped because a ring was full
+  uint64_t dropped() const;
+};
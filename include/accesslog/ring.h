@@ -0,0 +1,74 @@
+#pragma once
+
+#include "common.h"
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+// longest method and request target kept by an entry (longer ones are cut)
+constexpr size_t ACCESS_METHOD_MAX = 15;
+constexpr size_t ACCESS_VERSION_MAX = 8;
+constexpr size_t ACCESS_TARGET_MAX = 190;
+
+// A request as recorded by AccessLog, formatted later by AccessLogger.
+struct AccessEntry {
+  // time the request was received, in microseconds since the epoch
+  int64_t time;
+  // bytes of the response body
+  uint64_t bytes;
+  // time spent in the middleware chain in microseconds
+  uint32_t latency;
+  uint16_t status;
+  // AF_INET or AF_INET6 (addr holds the address), 0 for other clients
+  uint8_t family;
+  unsigned char addr[16];
+  uint8_t method_size;
+  uint8_t version_size;
+  uint8_t target_size;
+  char method[ACCESS_METHOD_MAX];
+  char version[ACCESS_VERSION_MAX];
+  char target[ACCESS_TARGET_MAX];
+};
+
+/*
+ * Bounded single-producer single-consumer queue of AccessEntry. The producer
+ * fills the slot returned by reserve() in place and publishes it with
+ * commit(); the consumer reads front() and frees it with pop(). Each side
+ * keeps its own index on a cache line of its own and only reads the other
+ * one when its cached copy says the ring is full (or empty).
+ */
+class AccessRing {
+private:
+  std::unique_ptr<AccessEntry[]> entries;
+  size_t mask;
+
+  alignas(64) std::atomic<size_t> tail;
+  size_t head_cache;
+
+  alignas(64) std::atomic<size_t> head;
+  size_t tail_cache;
+
+public:
+  // whether a thread currently produces into the ring
+  alignas(64) std::atomic<bool> attached;
+
+public:
+  // capacity is rounded up to a power of 2
+  explicit AccessRing(size_t capacity);
+  ~AccessRing() = default;
+
+  NOT_COPYABLE(AccessRing);
+  NOT_MOVEABLE(AccessRing);
+
+  // producer side; reserve() returns nullptr if the ring is full
+  AccessEntry *reserve();
+  void commit();
+  // called by a new producer before its first reserve()
+  void adopt();
+
+  // consumer side; front() returns nullptr if the ring is empty
+  const AccessEntry *front();
+  void pop();
+  bool empty() const;
+};
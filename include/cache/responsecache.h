@@ -0,0 +1,101 @@
+#pragma once
+
+#include "common.h"
+#include "http/preparedresponse.h"
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+struct CacheStats {
+  // lookups answered from the cache, and lookups that ran the middleware
+  size_t hits;
+  size_t misses;
+  // misses that waited for the same key to be produced by another request
+  size_t coalesced;
+  // responses stored, and stored responses dropped to make room
+  size_t stores;
+  size_t evictions;
+  // responses in the cache and their size in bytes
+  size_t entries;
+  size_t bytes;
+};
+
+/*
+ * Serialized responses (PreparedResponse) by key, each kept until its time
+ * to live runs out. The keys are spread over shards, each an LRU list with
+ * its own lock and byte budget, so lookups of different keys rarely contend.
+ *
+ * Misses are coalesced (single flight): the first request that misses a key
+ * produces the response and passes it to complete(), while the requests that
+ * miss the same key in the meantime wait for it instead of producing it too.
+ */
+class ResponseCache {
+private:
+  struct Entry {
+    std::string key;
+    std::shared_ptr<const PreparedResponse> response;
+    std::chrono::steady_clock::time_point expires;
+  };
+
+  // a response being produced
+  struct Flight {
+    bool done = false;
+    std::shared_ptr<const PreparedResponse> response;
+  };
+
+  struct Shard {
+    std::mutex mutex;
+    std::condition_variable cv;
+    // most recently used at the front
+    std::list<Entry> entries;
+    std::unordered_map<std::string, std::list<Entry>::iterator> index;
+    std::unordered_map<std::string, std::shared_ptr<Flight>> flights;
+    size_t bytes = 0;
+  };
+
+  std::vector<Shard> shards;
+  size_t shard_capacity;
+
+  std::atomic<size_t> hits;
+  std::atomic<size_t> misses;
+  std::atomic<size_t> coalesced;
+  std::atomic<size_t> stores;
+  std::atomic<size_t> evictions;
+
+private:
+  Shard &shard(const std::string &key);
+  static size_t cost(const Entry &entry);
+  void erase(Shard &shard, std::list<Entry>::iterator it);
+
+public:
+  // capacity in bytes, split evenly between the shards
+  ResponseCache(size_t shards, size_t capacity);
+  ~ResponseCache() = default;
+
+  NOT_COPYABLE(ResponseCache);
+  NOT_MOVEABLE(ResponseCache);
+
+  // the cached response of key if there is one. Otherwise leader is set if
+  // the caller has to produce it and then call complete(); if it is not
+  // set, another request was producing it and did not within wait (or its
+  // response cannot be cached): the caller produces its own response and
+  // does not call complete().
+  std::shared_ptr<const PreparedResponse>
+  acquire(const std::string &key, bool &leader,
+          std::chrono::milliseconds wait);
+
+  // hand the response of key (nullptr if it cannot be cached) to the
+  // requests waiting for it, and store it for ttl if ttl is positive
+  void complete(const std::string &key,
+                std::shared_ptr<const PreparedResponse> response,
+                std::chrono::milliseconds ttl);
+
+  CacheStats stats();
+};
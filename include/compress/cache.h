@@ -0,0 +1,52 @@
+#pragma once
+
+#include "common.h"
+#include "http/preparedresponse.h"
+#include <cstddef>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// A compressed variant of a response body.
+struct CompressedBody {
+  // the compressed bytes; empty if compressing did not make the body smaller
+  std::vector<char> data;
+  // for a PreparedResponse: the variant to send (compressed, or a copy with
+  // Vary), and the one it was made from (the key is its address, which may
+  // be reused once it dies)
+  std::shared_ptr<const PreparedResponse> prepared;
+  std::weak_ptr<const PreparedResponse> source;
+};
+
+// Least recently used compressed bodies up to a budget of bytes, shared by
+// the connection threads.
+class CompressCache {
+private:
+  using Entry = std::pair<std::string, std::shared_ptr<const CompressedBody>>;
+
+  size_t capacity;
+  size_t size;
+
+  std::mutex mutex;
+  // most recently used at the front
+  std::list<Entry> entries;
+  std::unordered_map<std::string, std::list<Entry>::iterator> index;
+
+private:
+  static size_t cost(const Entry &entry);
+
+public:
+  // capacity in bytes of compressed data (plus the keys)
+  explicit CompressCache(size_t capacity);
+  ~CompressCache() = default;
+
+  NOT_COPYABLE(CompressCache);
+  NOT_MOVEABLE(CompressCache);
+
+  // nullptr if key is not cached
+  std::shared_ptr<const CompressedBody> get(const std::string &key);
+  void put(const std::string &key, std::shared_ptr<const CompressedBody> body);
+};
@@ -0,0 +1,40 @@
+#pragma once
+
+#include "common.h"
+#include "csr/result.hpp"
+#include "servererrors.h"
+#include <memory>
+#include <variant>
+#include <vector>
+
+// content codings of RFC 9110 8.4.1 produced by Deflater
+enum class Coding { gzip, deflate };
+
+// name of the coding in Content-Encoding
+const char *coding_name(Coding coding);
+
+// Streaming compressor (zlib), compiled in with `make zlib=1` (USE_ZLIB).
+// deflate is the zlib format, as HTTP defines it, not raw deflate.
+class Deflater {
+private:
+  struct z_stream_s *stream;
+
+private:
+  explicit Deflater(struct z_stream_s *stream);
+
+public:
+  ~Deflater();
+
+  NOT_COPYABLE(Deflater);
+  NOT_MOVEABLE(Deflater);
+
+  // level from 1 (fastest) to 9 (smallest); fails with unsupported_option
+  // without USE_ZLIB
+  static csr::Result<std::unique_ptr<Deflater>, server_error_t>
+  create(Coding coding, int level);
+
+  // compress the next size bytes and append the output to out; finish ends
+  // the stream (no more input may follow)
+  csr::Result<std::monostate, server_error_t>
+  feed(const char *data, size_t size, bool finish, std::vector<char> &out);
+};
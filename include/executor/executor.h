@@ -0,0 +1,94 @@
+#pragma once
+
+#include "common.h"
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Order in which queued work is picked up: all the work of a priority, on
+// every worker, goes before any of the next one.
+enum class Priority : uint8_t { high, normal, low };
+
+constexpr size_t PRIORITIES = 3;
+// times an idle worker looks for work again before it sleeps
+constexpr int EXECUTOR_SPINS = 64;
+
+struct ExecutorStats {
+  // work run, and how much of it was taken from another worker's queue
+  size_t executed;
+  size_t stolen;
+  // work waiting for a worker
+  size_t queued;
+};
+
+/*
+ * A fixed set of worker threads (one per core by default) for CPU-heavy
+ * work, so that it runs on as many threads as there are cores instead of on
+ * every connection thread at once.
+ *
+ * Each worker has a queue per priority; a connection thread hands its work
+ * to the same worker every time, and a worker out of work steals the oldest
+ * work of another one, highest priority first. An idle worker spins for a
+ * while before sleeping, so bursts do not pay for a wake-up each.
+ *
+ * run() blocks the connection thread until the work is done: the request
+ * then carries on where it was, on its own thread.
+ */
+class Executor {
+private:
+  struct Job {
+    const std::function<void()> *f;
+    std::mutex mutex;
+    std::condition_variable cv;
+    bool done = false;
+    std::exception_ptr error;
+  };
+
+  struct alignas(64) Worker {
+    std::mutex mutex;
+    // oldest at the front
+    std::deque<Job *> queues[PRIORITIES];
+  };
+
+  std::vector<std::unique_ptr<Worker>> workers;
+  std::vector<std::thread> threads;
+  // spreads the connection threads over the workers
+  std::atomic<size_t> next;
+  std::atomic<size_t> queued;
+  std::atomic<size_t> executed;
+  std::atomic<size_t> stolen;
+
+  std::mutex park_mutex;
+  std::condition_variable park_cv;
+  size_t sleeping;
+  bool stopping;
+
+private:
+  void work(size_t i);
+  // the oldest job of the highest priority, from worker i first
+  Job *take(size_t i);
+  void execute(Job &job);
+
+public:
+  // threads: 0 for one per core
+  explicit Executor(size_t threads = 0);
+  // waits for the queued work to be done
+  ~Executor();
+
+  NOT_COPYABLE(Executor);
+  NOT_MOVEABLE(Executor);
+
+  // run f on a worker and wait for it; an exception thrown by f is thrown
+  // again here. Called from a worker, f runs right away on that worker.
+  void run(Priority priority, const std::function<void()> &f);
+
+  ExecutorStats stats() const;
+};
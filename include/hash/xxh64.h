@@ -0,0 +1,11 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// XXH64 (https://github.com/Cyan4973/xxHash/blob/dev/doc/xxhash_spec.md):
+// a non-cryptographic hash running at memory speed. Its four independent
+// accumulators keep the multipliers of a modern core busy, so large inputs
+// hash at several GB/s without SIMD intrinsics. Not for untrusted keys of
+// hash tables: it is not seeded with a secret.
+uint64_t xxh64(const void *data, size_t size, uint64_t seed = 0);
@@ -0,0 +1,49 @@
+#pragma once
+
+#include "common.h"
+#include "http/headerprefix.h"
+#include "socket/socket.h"
+#include <memory>
+#include <mutex>
+#include <vector>
+
+class HttpClient;
+
+struct PoolStats {
+  // objects waiting for a connection, and objects serving one
+  size_t idle;
+  size_t in_use;
+  // most objects ever in use at once
+  size_t high_water;
+  // objects allocated since the start; acquisitions beyond them were reused
+  size_t created;
+  size_t reused;
+};
+
+// Free list of HttpClient objects (Context, Reader buffer, request and
+// response containers), shared by the connection threads of a server. A
+// released client keeps the capacity of its containers, so once the pool is
+// warm a new connection allocates nothing to be set up.
+class ClientPool {
+private:
+  const HeaderPrefix &prefix;
+  size_t max_idle;
+
+  std::mutex mutex;
+  std::vector<std::unique_ptr<HttpClient>> idle;
+  PoolStats stats;
+
+public:
+  ClientPool(const HeaderPrefix &prefix, size_t max_idle);
+  ~ClientPool();
+
+  NOT_COPYABLE(ClientPool);
+  NOT_MOVEABLE(ClientPool);
+
+  // bufsize: size of the I/O buffers of the connection
+  std::unique_ptr<HttpClient> acquire(SocketClient &&sc, size_t bufsize);
+  // close the connection of client and keep it for the next one
+  void release(std::unique_ptr<HttpClient> &&client);
+
+  PoolStats metrics();
+};
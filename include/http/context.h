@@ -2,12 +2,22 @@
 
 #include "common.h"
 #include "csr/result.hpp"
+#include "http/headerprefix.h"
 #include "servererrors.h"
+#include "socket/io.h"
+#include "socket/socket.h"
 #include "socket/socket_common.h"
+#include <cstdint>
+#include <functional>
 #include <map>
+#include <memory>
 #include <string>
+#include <string_view>
 #include <vector>
 
+// largest body capacity kept by Request::clear and Response::clear
+constexpr size_t KEEP_CAPACITY = 65536;
+
 struct Request {
   std::string method;
   std::string version;
@@ -16,8 +26,14 @@ struct Request {
   std::map<std::string, std::string> headers;
   std::vector<char> content;
 
-  void setContent(const std::string &s);
+  // copy s into content, reusing its memory
+  void setContent(std::string_view s);
+  void setContent(const char *data, size_t size);
+  // take v over, without copying
   void setContent(std::vector<char> &&v);
+  // empty every field, keeping the memory of the containers for the next
+  // request (except for bodies larger than KEEP_CAPACITY)
+  void clear();
 };
 
 struct Response {
@@ -25,13 +41,34 @@ struct Response {
   std::map<std::string, std::string> headers;
   std::vector<char> content;
 
-  void setContent(const std::string &s);
+  // copy s into content, reusing its memory
+  void setContent(std::string_view s);
+  void setContent(const char *data, size_t size);
+  // take v over, without copying
   void setContent(std::vector<char> &&v);
+  void clear();
 };
 
+class PreparedResponse;
+
 class Context {
 private:
   m_sock_t fd;
+  // the connection if it is not a socket, nullptr otherwise
+  Transport *transport;
+  // size of the I/O buffers of the connection
+  size_t bufsize;
+  // address of the client (see SocketClient)
+  struct sockaddr_storage peer;
+  socklen_t peerlen;
+  // id of the trace of the connection, 0 if it is not traced (see Tracer)
+  uint64_t trace;
+  const HeaderPrefix &prefix;
+  std::shared_ptr<const PreparedResponse> prepared;
+
+  // buffered input of the connection, shared by the middleware that parse it
+  Reader reader;
+  std::function<void(SocketClient &&, std::vector<char> &&)> takeover;
 
 public:
   Request req;
@@ -39,15 +76,44 @@ public:
 
   // ? add payload here
 private:
-  Context(m_sock_t fd);
+  Context(m_sock_t fd, const HeaderPrefix &prefix, size_t bufsize = BUFSIZE,
+          Transport *transport = nullptr);
   ~Context() = default;
 
   NOT_COPYABLE(Context);
   NOT_MOVEABLE(Context);
 
+  // forget the request and the response once the connection is done
+  void clear();
+  // serve the next connection, on fd
+  void reset(m_sock_t fd, size_t bufsize);
+  // the status line and the headers of resp, without adding Content-Length
+  csr::Result<size_t, server_error_t> write_head(Writer &writer);
+
 public:
-  void write();
+  // respond with a PreparedResponse instead of resp
+  void send(std::shared_ptr<const PreparedResponse> response);
+  // errors are returned, never thrown: a failed write only means the
+  // connection has to be closed. The body is left out for HEAD.
+  csr::Result<std::monostate, server_error_t> write();
+
+  // after a protocol upgrade: once the middleware chain returns, f receives
+  // the connection and the input read ahead instead of it being closed
+  void take_over(
+      std::function<void(SocketClient &&, std::vector<char> &&)> &&f);
 
   friend class HttpClient;
+  friend class Task;
   friend class HeadParser;
+  friend class Http2;
+  friend class WebSocket;
+  friend class Proxy;
+  friend class Multipart;
+  friend class RateLimit;
+  friend class AccessLog;
+  friend class Compress;
+  friend class Cache;
+  friend class ETag;
+  friend class H2Session;
+  friend class SseHub;
 };
\ No newline at end of file
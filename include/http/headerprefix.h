@@ -0,0 +1,63 @@
+#pragma once
+
+#include "common.h"
+#include "csr/result.hpp"
+#include "servererrors.h"
+#include "socket/io.h"
+#include <atomic>
+#include <ctime>
+#include <map>
+#include <memory>
+#include <string>
+
+// Caches the serialized "Date" header line.
+// The line is refreshed at most once per second and swapped atomically, so
+// readers never format a date themselves.
+class DateCache {
+private:
+  std::atomic<time_t> second;
+  std::shared_ptr<const std::string> line;
+
+private:
+  DateCache();
+  ~DateCache() = default;
+
+  NOT_COPYABLE(DateCache);
+  NOT_MOVEABLE(DateCache);
+
+  static std::shared_ptr<const std::string> format(time_t t);
+
+public:
+  static DateCache &instance();
+
+  // returns "Date:<IMF-fixdate>\r\n"
+  std::shared_ptr<const std::string> get();
+};
+
+// Headers shared by every response (e.g. Server, security headers).
+// They are serialized once when configured and copied by Context::write as a
+// single block. A header set by the response itself takes precedence.
+class HeaderPrefix {
+private:
+  std::map<std::string, std::string> headers;
+  std::string block;
+  bool date;
+
+public:
+  HeaderPrefix();
+  ~HeaderPrefix() = default;
+
+  NOT_COPYABLE(HeaderPrefix);
+  NOT_MOVEABLE(HeaderPrefix);
+
+  void set(const std::string &key, const std::string &value);
+  void set_date(bool enable);
+
+  const std::map<std::string, std::string> &entries() const;
+  bool has_date() const;
+
+  // write the prefix, skipping the headers overridden by resp_headers
+  csr::Result<size_t, server_error_t>
+  write(Writer &writer,
+        const std::map<std::string, std::string> &resp_headers) const;
+};
@@ -0,0 +1,15 @@
+#pragma once
+
+#include <map>
+#include <string>
+
+// case-insensitive comparison of header names and tokens
+bool iequals(const std::string &a, const char *b);
+
+// header names of HTTP/1 requests are kept as sent: look them up ignoring
+// case; returns nullptr if absent
+const std::string *find_header(const std::map<std::string, std::string> &h,
+                               const char *name);
+
+// whether the comma-separated list (e.g. Connection) contains token
+bool has_token(const std::string &list, const char *token);
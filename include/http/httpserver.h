@@ -2,37 +2,134 @@
 
 #include "common.h"
 #include "csr/option.hpp"
+#include "http/clientpool.h"
 #include "http/context.h"
+#include "http/headerprefix.h"
+#include "http/prefork.h"
 #include "http/task.h"
 #include "socket/socket.h"
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <optional>
+#include <set>
+#include <vector>
+
+class HttpClient;
 
 class HttpServer {
 private:
-  Socket s;
+  // the first one is passed on by a handover
+  std::vector<Socket> listeners;
+  ServerOptions options;
   TaskList tasklist;
+  HeaderPrefix prefix;
+  ClientPool pool;
+
+  std::string handover_path;
+  std::chrono::milliseconds drain_timeout;
+  std::atomic<bool> stopping;
+
+  // in-flight connections
+  std::mutex clients_mutex;
+  std::condition_variable clients_cv;
+  std::set<HttpClient *> clients;
+  size_t active;
+  bool forced;
+
+  // in prefork mode only
+  std::unique_ptr<Prefork> prefork;
+  std::function<void(HttpServer &, size_t)> worker_setup;
+
+private:
+  // accept a connection if one arrives within timeout ms and serve it on a
+  // thread of its own
+  void accept(const Socket &listener, int timeout);
+  // trace: see Tracer::sample; accepted: when accept() returned
+  void serve(const Socket &listener, SocketClient &&sc, uint64_t trace,
+             uint64_t accepted);
+  void handover(Socket &&ctl);
+  void drain();
+  // accept connections until stopped
+  void loop();
+  // the life of worker process i in prefork mode
+  void work(size_t i);
 
 public:
-  HttpServer(int port);
+  HttpServer(int port, const ServerOptions &options = ServerOptions());
+  // listen on a Unix socket (see SocketGenerator::listen_unix)
+  HttpServer(const std::string &path,
+             const ServerOptions &options = ServerOptions());
+  // no listening socket: connections are only served by loopback(), and
+  // listen() has to be called before run()
+  explicit HttpServer(const ServerOptions &options);
   ~HttpServer() = default;
 
   NOT_COPYABLE(HttpServer);
   NOT_MOVEABLE(HttpServer);
 
   HttpServer &use(std::function<void(Context &, const Task &)> &&f);
-  void run() const;
+
+  // accept connections on more sockets, served by the same middleware; to be
+  // called before run(). Only the first socket is passed on by a handover.
+  HttpServer &listen(Socket &&s);
+  HttpServer &listen(int port);
+  HttpServer &listen_unix(const std::string &path);
+
+  // add a header to every response
+  HttpServer &header(const std::string &key, const std::string &value);
+  // add a cached Date header to every response
+  HttpServer &date(bool enable = true);
+
+  // serve the connection held by transport in the calling thread, through
+  // the same middleware as the sockets; a connection taken over (see
+  // Context::take_over) ends instead. Can be called concurrently, with or
+  // without run().
+  void loopback(Transport &transport);
+
+  // in prefork mode, called in each worker process once it is forked,
+  // before it accepts connections: the place to add the middleware that run
+  // threads of their own (e.g. AccessLog, Proxy, WebSocket, the Watchdog),
+  // since threads do not survive fork(). They come after the others.
+  HttpServer &on_worker(std::function<void(HttpServer &, size_t)> &&f);
+
+  // usage of the pool of connection objects
+  PoolStats pool_stats();
+  // in prefork mode, the counters of each worker; empty otherwise
+  std::vector<WorkerStats> worker_stats() const;
+
+  // accept connections until stop() is called, then wait for in-flight
+  // requests to finish (see ServerOptions::drain_timeout). In prefork mode,
+  // the workers do it while this process supervises them.
+  void run();
+  // can be called from any thread or from a signal handler
+  void stop();
 };
 
 class HttpClient {
 private:
   Context ctx;
-  SocketClient sc;
+  // empty while the object waits in a ClientPool, or for a Transport
+  std::optional<SocketClient> sc;
 
 public:
-  HttpClient(SocketClient &&sc);
+  HttpClient(SocketClient &&sc, const HeaderPrefix &prefix, size_t bufsize);
+  // a connection that is not a socket
+  HttpClient(Transport &transport, const HeaderPrefix &prefix,
+             size_t bufsize);
   ~HttpClient() = default;
 
   NOT_COPYABLE(HttpClient);
   NOT_MOVEABLE(HttpClient);
 
-  void start(const Task &task);
+  // serve another connection after close()
+  void open(SocketClient &&sc, size_t bufsize);
+  // close the connection and clear the request and the response
+  void close();
+
+  // trace: the id of the trace of the connection, 0 if it is not traced
+  void start(const Task &task, uint64_t trace);
+  // abort the blocking I/O of the connection
+  void shutdown() const;
 };
\ No newline at end of file
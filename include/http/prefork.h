@@ -0,0 +1,112 @@
+#pragma once
+
+#include "common.h"
+#include "csr/result.hpp"
+#include "http/clientpool.h"
+#include "servererrors.h"
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <vector>
+
+// Counters of one worker process, read from shared memory.
+struct WorkerStats {
+  // 0 while the worker is not running (being restarted)
+  int pid;
+  // times the worker was started again after exiting
+  uint64_t restarts;
+  // connections accepted, and being served, by the current process
+  uint64_t accepted;
+  uint64_t active;
+  // ClientPool of the current process, refreshed every 100 ms
+  PoolStats pool;
+};
+
+/*
+ * The worker processes of a server in prefork mode (ServerOptions::workers)
+ * and the memory they share with the master.
+ *
+ * The master binds the listening sockets and forks the workers, which
+ * inherit them and each accept connections with threads of their own: a
+ * worker that crashes only takes its own connections down. The master keeps
+ * the worker count up, restarting a worker that exits (after a second if it
+ * lived less than that), and stops the workers when it is stopped. Workers
+ * stop on their own if the master disappears.
+ *
+ * Not on Windows, where there is no fork().
+ */
+class Prefork {
+private:
+  // one cache line per worker: the master sets pid and restarts and clears
+  // the rest before forking it, the worker writes the rest
+  struct alignas(64) Slot {
+    std::atomic<int> pid;
+    std::atomic<uint64_t> restarts;
+    std::atomic<uint64_t> accepted;
+    std::atomic<uint64_t> active;
+    std::atomic<size_t> idle;
+    std::atomic<size_t> in_use;
+    std::atomic<size_t> high_water;
+    std::atomic<size_t> created;
+    std::atomic<size_t> reused;
+  };
+
+  struct alignas(64) Shared {
+    // set by the master to stop the workers
+    std::atomic<bool> stopping;
+  };
+
+  struct Worker {
+    std::chrono::steady_clock::time_point started;
+    // when to fork it again, after it exited
+    std::chrono::steady_clock::time_point restart_at;
+  };
+
+  // the slots follow it in the same mapping
+  Shared *shared;
+  Slot *slots;
+  size_t mapped;
+  size_t count;
+  bool pin;
+  int master;
+
+  // in a worker, its index; SIZE_MAX in the master
+  size_t index;
+  std::vector<Worker> workers;
+
+private:
+  Prefork(void *memory, size_t mapped, size_t count, bool pin);
+
+  // fork worker i, which runs serve(i) and exits
+  void spawn(size_t i, const std::function<void(size_t)> &serve);
+
+public:
+  ~Prefork();
+
+  NOT_COPYABLE(Prefork);
+  NOT_MOVEABLE(Prefork);
+
+  // map the shared memory of count workers; pin: bind worker i to CPU
+  // i % the number of CPUs (Linux only)
+  static csr::Result<std::unique_ptr<Prefork>, server_error_t>
+  create(size_t count, bool pin);
+
+  // in the master: fork the workers, which run serve(i) then exit, and
+  // restart them until stopping() returns true; then stop them, giving them
+  // up to timeout to drain before killing them
+  void supervise(const std::function<void(size_t)> &serve,
+                 const std::function<bool()> &stopping,
+                 std::chrono::milliseconds timeout);
+
+  // in a worker: true once the master wants it to stop or is gone
+  bool stopping() const;
+  // in a worker: its counters; no-ops in the master
+  void accepted();
+  void finished();
+  void pool(const PoolStats &stats);
+
+  std::vector<WorkerStats> stats() const;
+};
@@ -0,0 +1,42 @@
+#pragma once
+
+#include "common.h"
+#include "http/context.h"
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+// An immutable response serialized once: status line, the response's own
+// headers, Content-Length when the body is not empty, and the body. It can be
+// shared by any number of requests. Over HTTP/1 these bytes are written as
+// they are, without the HeaderPrefix headers or Date. Over HTTP/2 status()
+// and headers() are encoded for each stream, with the HeaderPrefix headers
+// and Date added the same way as for a Response.
+class PreparedResponse {
+private:
+  std::vector<char> bytes;
+  // kept for protocols that do not send the HTTP/1 serialization (HTTP/2)
+  std::string code;
+  std::map<std::string, std::string> fields;
+  size_t head_size;
+
+private:
+  PreparedResponse(std::vector<char> &&bytes, const Response &resp,
+                   size_t head_size);
+
+public:
+  ~PreparedResponse() = default;
+
+  NOT_COPYABLE(PreparedResponse);
+  NOT_MOVEABLE(PreparedResponse);
+
+  static std::shared_ptr<const PreparedResponse> build(const Response &resp);
+
+  const std::vector<char> &data() const;
+
+  const std::string &status() const;
+  const std::map<std::string, std::string> &headers() const;
+  const char *body() const;
+  size_t body_size() const;
+};
@@ -2,6 +2,7 @@
 
 #include "common.h"
 #include "http/context.h"
+#include <cstdint>
 #include <functional>
 #include <memory>
 #include <vector>
@@ -11,6 +12,8 @@ private:
   std::function<void(Context &, const Task &)> f;
 
   std::unique_ptr<Task> next_task;
+  // position in the TaskList, named in traces
+  uint16_t index;
 
 public:
   Task(std::function<void(Context &, const Task &)> &&f);
@@ -33,6 +36,7 @@ class TaskList {
 private:
   std::unique_ptr<Task> header;
   Task *footer;
+  uint16_t count;
 
 public:
   TaskList();
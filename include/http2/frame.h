@@ -0,0 +1,124 @@
+#pragma once
+
+#include "common.h"
+#include "csr/result.hpp"
+#include "servererrors.h"
+#include "socket/io.h"
+#include <cstdint>
+#include <string>
+#include <system_error>
+#include <vector>
+
+// connection preface sent by the client (RFC 7540 3.5)
+constexpr char H2_PREFACE[] = "PRI * HTTP/2.0\r\n\r\nSM\r\n\r\n";
+constexpr size_t H2_PREFACE_LEN = sizeof(H2_PREFACE) - 1;
+
+constexpr size_t H2_FRAME_HEADER_LEN = 9;
+constexpr uint32_t H2_DEFAULT_FRAME_SIZE = 16384;
+constexpr uint32_t H2_MAX_FRAME_SIZE = 16777215;
+constexpr int64_t H2_DEFAULT_WINDOW = 65535;
+constexpr int64_t H2_MAX_WINDOW = 0x7fffffff;
+
+// frame flags
+constexpr uint8_t H2_END_STREAM = 0x1;
+constexpr uint8_t H2_ACK = 0x1;
+constexpr uint8_t H2_END_HEADERS = 0x4;
+constexpr uint8_t H2_PADDED = 0x8;
+constexpr uint8_t H2_PRIORITY = 0x20;
+
+enum class H2Type : uint8_t {
+  data = 0x0,
+  headers = 0x1,
+  priority = 0x2,
+  rst_stream = 0x3,
+  settings = 0x4,
+  push_promise = 0x5,
+  ping = 0x6,
+  goaway = 0x7,
+  window_update = 0x8,
+  continuation = 0x9,
+};
+
+enum class H2Setting : uint16_t {
+  header_table_size = 0x1,
+  enable_push = 0x2,
+  max_concurrent_streams = 0x3,
+  initial_window_size = 0x4,
+  max_frame_size = 0x5,
+  max_header_list_size = 0x6,
+};
+
+// error codes carried by RST_STREAM and GOAWAY (RFC 7540 7)
+enum class H2Err : uint32_t {
+  no_error = 0x0,
+  protocol_error = 0x1,
+  internal_error = 0x2,
+  flow_control_error = 0x3,
+  settings_timeout = 0x4,
+  stream_closed = 0x5,
+  frame_size_error = 0x6,
+  refused_stream = 0x7,
+  cancel = 0x8,
+  compression_error = 0x9,
+  connect_error = 0xa,
+  enhance_your_calm = 0xb,
+  inadequate_security = 0xc,
+  http_1_1_required = 0xd,
+};
+
+class H2Category : public std::error_category {
+public:
+  virtual const char *name() const noexcept override;
+  virtual std::string message(int ev) const override;
+};
+
+const std::error_category &h2_category() noexcept;
+
+std::error_code make_error_code(H2Err err) noexcept;
+
+namespace std {
+template <> struct is_error_code_enum<H2Err> : true_type {};
+} // namespace std
+
+struct H2Frame {
+  uint32_t length;
+  H2Type type;
+  uint8_t flags;
+  uint32_t stream;
+  std::vector<char> payload;
+
+  H2Frame();
+
+  // read the next frame; its payload may be at most max_size bytes
+  // returns false if the connection is closed before a frame starts
+  csr::Result<bool, server_error_t> read(Reader &reader, uint32_t max_size);
+};
+
+csr::Result<size_t, server_error_t> write_frame(Writer &writer, H2Type type,
+                                                uint8_t flags, uint32_t stream,
+                                                const char *payload,
+                                                size_t length);
+
+// big-endian helpers
+inline uint32_t read_u32(const char *p) {
+  const unsigned char *u = (const unsigned char *)p;
+  return (uint32_t)u[0] << 24 | (uint32_t)u[1] << 16 | (uint32_t)u[2] << 8 |
+         (uint32_t)u[3];
+}
+
+inline uint16_t read_u16(const char *p) {
+  const unsigned char *u = (const unsigned char *)p;
+  return (uint16_t)(u[0] << 8 | u[1]);
+}
+
+inline void write_u16(char *p, uint16_t v) {
+  p[0] = (char)(v >> 8);
+  p[1] = (char)v;
+}
+
+inline void write_u32(char *p, uint32_t v) {
+  p[0] = (char)(v >> 24);
+  p[1] = (char)(v >> 16);
+  p[2] = (char)(v >> 8);
+  p[3] = (char)v;
+}
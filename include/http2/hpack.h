@@ -0,0 +1,98 @@
+#pragma once
+
+#include "common.h"
+#include "csr/result.hpp"
+#include "servererrors.h"
+#include <deque>
+#include <string>
+#include <utility>
+#include <vector>
+
+typedef std::pair<std::string, std::string> HeaderField;
+typedef std::vector<HeaderField> HeaderList;
+
+constexpr size_t HPACK_DEFAULT_TABLE_SIZE = 4096;
+// largest header list decoded from one block, counted as in
+// SETTINGS_MAX_HEADER_LIST_SIZE: name, value and 32 bytes per field
+constexpr size_t HPACK_MAX_HEADER_LIST = 65536;
+
+// Static + dynamic table of HPACK (RFC 7541 2.3).
+// Index 1 to 61 are static entries, the following ones are dynamic entries
+// from the newest to the oldest.
+class HpackTable {
+private:
+  std::deque<HeaderField> entries;
+  size_t size;
+  size_t max_size;
+
+  // drop the oldest entries until size <= limit
+  void evict(size_t limit);
+
+public:
+  HpackTable(size_t max_size);
+  ~HpackTable() = default;
+
+  NOT_COPYABLE(HpackTable);
+  NOT_MOVEABLE(HpackTable);
+
+  void resize(size_t max_size);
+  void add(const std::string &name, const std::string &value);
+
+  // nullptr if index is out of range
+  const HeaderField *get(size_t index) const;
+
+  // index of the entry matching name and value (full is set), or of the
+  // first entry matching name, or 0
+  size_t find(const std::string &name, const std::string &value,
+              bool &full) const;
+};
+
+class HpackDecoder {
+private:
+  HpackTable table;
+  // SETTINGS_HEADER_TABLE_SIZE advertised to the peer
+  size_t max_size;
+  // SETTINGS_MAX_HEADER_LIST_SIZE advertised to the peer
+  size_t max_list;
+
+public:
+  HpackDecoder(size_t max_size = HPACK_DEFAULT_TABLE_SIZE,
+               size_t max_list = HPACK_MAX_HEADER_LIST);
+  ~HpackDecoder() = default;
+
+  NOT_COPYABLE(HpackDecoder);
+  NOT_MOVEABLE(HpackDecoder);
+
+  // decode a complete header block and append the fields to headers;
+  // fails with ENHANCE_YOUR_CALM once they add up to more than max_list, as
+  // references to a large table entry may repeat it many times over
+  csr::Result<std::monostate, server_error_t>
+  decode(const char *data, size_t len, HeaderList &headers);
+};
+
+class HpackEncoder {
+private:
+  HpackTable table;
+  size_t max_size;
+  // a table size update has to start the next header block
+  bool size_update;
+
+public:
+  HpackEncoder();
+  ~HpackEncoder() = default;
+
+  NOT_COPYABLE(HpackEncoder);
+  NOT_MOVEABLE(HpackEncoder);
+
+  // SETTINGS_HEADER_TABLE_SIZE received from the peer
+  void set_max_size(size_t size);
+
+  // append the header block of headers (names must be lowercase) to out
+  void encode(const HeaderList &headers, std::string &out);
+};
+
+// Huffman code of HPACK (RFC 7541 5.2, Appendix B)
+csr::Result<std::monostate, server_error_t>
+huffman_decode(const char *data, size_t len, std::string &out);
+size_t huffman_length(const std::string &s);
+void huffman_encode(const std::string &s, std::string &out);
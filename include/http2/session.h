@@ -0,0 +1,120 @@
+#pragma once
+
+#include "common.h"
+#include "csr/result.hpp"
+#include "http/context.h"
+#include "http/task.h"
+#include "http2/frame.h"
+#include "http2/hpack.h"
+#include "servererrors.h"
+#include "socket/io.h"
+#include <condition_variable>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+
+constexpr uint32_t H2_MAX_CONCURRENT_STREAMS = 100;
+// largest header block accepted from the client
+constexpr size_t H2_MAX_HEADER_BLOCK = 65536;
+// largest request body buffered for a stream; larger ones get a 413
+constexpr size_t H2_MAX_BODY = 8 << 20;
+
+// An HTTP/2 connection (RFC 7540) over the socket of a Context.
+// The connection thread reads and dispatches the frames. Each request
+// (stream) is handled by the next middleware with a Context of its own on a
+// thread of its own, so a slow request does not hold up the others.
+class H2Session {
+private:
+  struct Stream {
+    uint32_t id;
+    Context ctx;
+    // the whole request has been received (END_STREAM)
+    bool complete;
+    // only used by the connection thread: DATA the client may still send
+    int64_t recv_window;
+    // guarded by H2Session::mutex
+    int64_t send_window;
+    bool reset;
+
+    // a stream of the connection of conn: its Context reads and writes
+    // through the same socket or transport
+    Stream(uint32_t id, const Context &conn, int64_t window);
+  };
+
+  Context &ctx;
+  const Task &next;
+
+  // guards writer and encoder, so frames are never interleaved
+  std::mutex write_mutex;
+  Writer writer;
+  HpackEncoder encoder;
+
+  // only used by the connection thread
+  HpackDecoder decoder;
+  std::string block;
+  uint32_t block_stream;
+  bool block_end_stream;
+  // GOAWAY received: the open streams are finished, new ones refused
+  bool goaway;
+  // DATA the client may still send on the connection
+  int64_t recv_window;
+
+  // guards the members below
+  std::mutex mutex;
+  std::condition_variable cv;
+  std::map<uint32_t, std::shared_ptr<Stream>> streams;
+  uint32_t last_stream;
+  int64_t send_window;
+  int64_t initial_window;
+  uint32_t max_frame_size;
+  // handlers still running
+  size_t active;
+  bool closed;
+
+private:
+  csr::Result<std::monostate, server_error_t>
+  send_frame(H2Type type, uint8_t flags, uint32_t stream, const char *payload,
+             size_t length);
+  csr::Result<std::monostate, server_error_t> send_reset(uint32_t stream,
+                                                         H2Err err);
+  csr::Result<std::monostate, server_error_t> send_goaway(H2Err err);
+
+  csr::Result<std::monostate, server_error_t>
+  apply_settings(const char *payload, size_t length);
+
+  csr::Result<std::monostate, server_error_t> handle(const H2Frame &frame);
+  csr::Result<std::monostate, server_error_t> on_data(const H2Frame &frame);
+  csr::Result<std::monostate, server_error_t> reject_body(Stream &stream);
+  csr::Result<std::monostate, server_error_t> on_headers(const H2Frame &frame);
+  csr::Result<std::monostate, server_error_t> on_header_block();
+  csr::Result<std::monostate, server_error_t>
+  on_settings(const H2Frame &frame);
+  csr::Result<std::monostate, server_error_t> on_ping(const H2Frame &frame);
+  csr::Result<std::monostate, server_error_t>
+  on_window_update(const H2Frame &frame);
+  csr::Result<std::monostate, server_error_t>
+  on_rst_stream(const H2Frame &frame);
+
+  void dispatch(std::shared_ptr<Stream> stream);
+  void respond(std::shared_ptr<Stream> stream);
+  csr::Result<std::monostate, server_error_t> send_response(Stream &stream);
+  csr::Result<std::monostate, server_error_t>
+  send_data(Stream &stream, const char *data, size_t length);
+
+public:
+  H2Session(Context &ctx, const Task &next);
+  ~H2Session() = default;
+
+  NOT_COPYABLE(H2Session);
+  NOT_MOVEABLE(H2Session);
+
+  // HTTP/1.1 upgrade: the request of ctx becomes stream 1 and settings is
+  // the decoded HTTP2-Settings header of the client
+  csr::Result<std::monostate, server_error_t>
+  upgrade(const std::string &settings);
+
+  // serve the connection until it is closed; preface is the part of the
+  // client connection preface that is still to be read
+  void run(const char *preface);
+};
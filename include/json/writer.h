@@ -0,0 +1,84 @@
+#pragma once
+
+#include "common.h"
+#include "http/context.h"
+#include <charconv>
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+#include <type_traits>
+#include <vector>
+
+// deepest nesting of objects and arrays a JsonWriter accepts
+constexpr size_t JSON_MAX_DEPTH = 64;
+
+/*
+ * Serializes JSON straight into the body of a Response, with no intermediate
+ * string. The body keeps its memory from one request to the next on a
+ * pooled connection (see Request::clear), so once warm a response is built
+ * without allocating.
+ *
+ *   JsonWriter json{ctx.resp};
+ *   json.begin_object().key("id").value(42).key("name").value(name)
+ *       .end_object();
+ *
+ * Commas and colons are placed by the writer; the calls must form a valid
+ * document (every key inside an object followed by a value); nesting deeper
+ * than JSON_MAX_DEPTH, or an end that closes no container or one of the
+ * other kind, throws std::system_error. Strings are
+ * escaped as required by RFC 8259, scanned 16 bytes at a time with SSE2 or
+ * NEON when available; numbers are formatted with std::to_chars (shortest
+ * representation that reads back the same double). NaN and infinities,
+ * which JSON cannot represent, are written as null.
+ */
+class JsonWriter {
+private:
+  std::vector<char> &out;
+  // whether the container at each depth has no element yet, and is an
+  // object rather than an array
+  bool empty[JSON_MAX_DEPTH];
+  bool object[JSON_MAX_DEPTH];
+  size_t depth;
+  bool after_key;
+
+private:
+  // the comma before an element, if needed
+  void separate();
+  void open(char c);
+  void close(char c);
+  void put(const char *data, size_t size);
+  void quoted(std::string_view s);
+
+public:
+  // empties the body of resp and sets its Content-Type
+  explicit JsonWriter(Response &resp);
+  ~JsonWriter() = default;
+
+  NOT_COPYABLE(JsonWriter);
+  NOT_MOVEABLE(JsonWriter);
+
+  JsonWriter &begin_object();
+  JsonWriter &end_object();
+  JsonWriter &begin_array();
+  JsonWriter &end_array();
+  JsonWriter &key(std::string_view name);
+
+  JsonWriter &value(std::string_view s);
+  JsonWriter &value(const char *s);
+  JsonWriter &value(bool b);
+  JsonWriter &value(double d);
+  JsonWriter &null();
+  // an already serialized JSON value, copied as it is
+  JsonWriter &raw(std::string_view json);
+
+  template <typename T>
+  std::enable_if_t<std::is_integral_v<T> && !std::is_same_v<T, bool>,
+                   JsonWriter &>
+  value(T n) {
+    separate();
+    char buf[24];
+    auto result = std::to_chars(buf, buf + sizeof(buf), n);
+    put(buf, (size_t)(result.ptr - buf));
+    return *this;
+  }
+};
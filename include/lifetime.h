@@ -0,0 +1,25 @@
+#pragma once
+
+#include "common.h"
+
+/*
+ * Connection threads are detached: they may still be running while the
+ * process exits and destroys its static objects. So the process-wide objects
+ * they use (BufferPool, Tracer, Watchdog) are allocated by their instance()
+ * and never destroyed.
+ *
+ * Such an object may give each thread that uses it a part of its own (a
+ * ring, a buffer, a slot), so that the thread never waits on the others. The
+ * thread keeps it in a thread_local ThreadSlot, which hands it to release
+ * when the thread exits, for the object to pass it on to the next thread.
+ */
+template <typename T, void (*release)(T &)> class ThreadSlot {
+public:
+  T value;
+
+  ThreadSlot() : value() {}
+  ~ThreadSlot() { release(value); }
+
+  NOT_COPYABLE(ThreadSlot);
+  NOT_MOVEABLE(ThreadSlot);
+};
@@ -0,0 +1,33 @@
+#pragma once
+
+#include "accesslog/logger.h"
+#include "http/context.h"
+#include "http/task.h"
+#include <cstdint>
+#include <memory>
+
+// Records every request that reaches it (client address, request line,
+// status, body size and the time spent in the following middleware) to an
+// access log written by a background thread. Recording copies a fixed-size
+// entry into a buffer of the calling thread; no lock is taken and no I/O is
+// done on the connection threads. Register it right after the parser.
+class AccessLog {
+private:
+  std::shared_ptr<AccessLogger> logger;
+
+public:
+  // throws std::system_error if the log file cannot be opened
+  AccessLog(const AccessLogOptions &options = AccessLogOptions());
+  ~AccessLog() = default;
+  AccessLog(const AccessLog &other) = default;
+  AccessLog(AccessLog &&other) = default;
+
+  AccessLog &operator=(const AccessLog &other) = delete;
+  AccessLog &operator=(AccessLog &&other) = delete;
+
+  void operator()(Context &ctx, const Task &next);
+
+  // entries dropped because the writer fell behind (AccessLogOptions::block
+  // unset)
+  uint64_t dropped() const;
+};
@@ -0,0 +1,62 @@
+#pragma once
+
+#include "cache/responsecache.h"
+#include "http/context.h"
+#include "http/task.h"
+#include <memory>
+#include <string>
+#include <vector>
+
+struct CacheOptions {
+  // time a response is kept when it does not say (Cache-Control max-age or
+  // s-maxage) in ms
+  int ttl = 5000;
+  // request headers that are part of the key besides the method and the
+  // target (e.g. Accept-Encoding); a response that varies on another header
+  // is not cached
+  std::vector<std::string> vary;
+  // bytes of responses kept, and number of shards they are spread over
+  size_t capacity = 64 << 20;
+  size_t shards = 16;
+  // largest response body cached
+  size_t max_body = 1 << 20;
+  // longest time a request waits for the same response to be produced by
+  // another request in ms, before producing it itself
+  int wait = 10000;
+};
+
+// Caches the responses of the following middleware to GET and HEAD requests,
+// serialized once, and answers later requests for the same key from the
+// cache without running them. Requests that miss a key while its response is
+// being produced wait for it instead of running the middleware as well.
+//
+// Only 200, 203, 204, 300, 301, 404 and 410 responses are stored, unless
+// their Cache-Control has no-store, no-cache or private, or they set a
+// cookie. Requests with Cache-Control: no-store bypass the cache, and
+// no-cache ones refresh the cached response. Cached responses are sent as
+// PreparedResponse, without the headers of HttpServer::header.
+class Cache {
+private:
+  CacheOptions options;
+  std::shared_ptr<ResponseCache> cache;
+
+private:
+  std::string key(const Request &req) const;
+  // the response of ctx serialized, and how long to keep it; nullptr if it
+  // cannot be cached
+  std::shared_ptr<const PreparedResponse>
+  store(Context &ctx, std::chrono::milliseconds &ttl) const;
+
+public:
+  Cache(const CacheOptions &options = CacheOptions());
+  ~Cache() = default;
+  Cache(const Cache &other) = default;
+  Cache(Cache &&other) = default;
+
+  Cache &operator=(const Cache &other) = delete;
+  Cache &operator=(Cache &&other) = delete;
+
+  void operator()(Context &ctx, const Task &next);
+
+  CacheStats stats() const;
+};
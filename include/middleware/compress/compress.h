@@ -0,0 +1,75 @@
+#pragma once
+
+#include "compress/cache.h"
+#include "compress/deflate.h"
+#include "http/context.h"
+#include "http/task.h"
+#include <memory>
+#include <string>
+#include <vector>
+
+struct CompressOptions {
+  // zlib level, from 1 (fastest) to 9 (smallest)
+  int level = 6;
+  // bodies smaller than this are sent as they are
+  size_t min_size = 1024;
+  // HTTP/1 bodies at least this large that are not cached are compressed
+  // piece by piece while they are written, instead of into a second buffer
+  // (the body itself is still built whole by the following middleware)
+  size_t stream_size = 1 << 20;
+  // bytes of compressed bodies kept for responses that do not change
+  size_t cache_size = 32 << 20;
+  // media types that are compressed (prefixes of Content-Type, in lower
+  // case); the others are usually compressed already
+  std::vector<std::string> types = {
+      "text/",           "application/json",     "application/javascript",
+      "application/xml", "application/xhtml+xml", "image/svg+xml",
+      "application/wasm"};
+};
+
+// Compresses the responses of the following middleware (gzip or deflate, as
+// negotiated with Accept-Encoding) once they return. Small bodies, other
+// media types, and responses that already have a Content-Encoding are left
+// as they are.
+//
+// Compressed variants of bodies that do not change are cached, so they are
+// compressed once: PreparedResponse objects (whose uncompressed variant is a
+// copy with Vary: Accept-Encoding), and responses with an ETag
+// (keyed on the request target and the ETag) or Cache-Control: immutable
+// (keyed on the target and a hash of the body). Without `make zlib=1`,
+// responses pass through unchanged.
+class Compress {
+private:
+  CompressOptions options;
+  std::shared_ptr<CompressCache> cache;
+  // false without zlib
+  bool enabled;
+
+private:
+  bool compressible(const std::string &status,
+                    const std::map<std::string, std::string> &headers) const;
+  // empty if the response is not cached
+  std::string cache_key(const Request &req, const Response &resp,
+                        Coding coding) const;
+  // compressed data, empty if it is not smaller than size
+  std::vector<char> deflate(const char *data, size_t size,
+                            Coding coding) const;
+
+  // the cached variant of ctx.prepared with Vary, compressed if encode
+  void send_prepared(Context &ctx, bool encode, Coding coding) const;
+  // write the response with resp.content, which the following middleware
+  // built whole, compressed piece by piece: this spares the buffer of the
+  // compressed copy, not the one of the body (the handler is not streamed)
+  void write_pieces(Context &ctx, Coding coding) const;
+
+public:
+  Compress(const CompressOptions &options = CompressOptions());
+  ~Compress() = default;
+  Compress(const Compress &other) = default;
+  Compress(Compress &&other) = default;
+
+  Compress &operator=(const Compress &other) = delete;
+  Compress &operator=(Compress &&other) = delete;
+
+  void operator()(Context &ctx, const Task &next);
+};
@@ -0,0 +1,29 @@
+#pragma once
+
+#include "http/context.h"
+#include "http/task.h"
+
+// Gives the 200 responses of the following middleware to GET and HEAD
+// requests a strong ETag, the XXH64 hash and the length of their body, unless
+// they have one already. When it matches the If-None-Match of the request,
+// the response becomes a 304 without a body. A PreparedResponse is not
+// hashed, but is answered with 304 if it carries a matching ETag.
+//
+// A HEAD response is tagged like the GET one as long as it is built with the
+// same body, which is then not sent (see Context::write). Without a body it
+// gets no ETag, since its tag would not be the one of the representation.
+//
+// Register it after Compress: a 304 is then not compressed in vain, and a
+// compressed body gets a weak ETag derived from the one of the original.
+class ETag {
+public:
+  ETag() = default;
+  ~ETag() = default;
+  ETag(const ETag &other) = default;
+  ETag(ETag &&other) = default;
+
+  ETag &operator=(const ETag &other) = delete;
+  ETag &operator=(ETag &&other) = delete;
+
+  void operator()(Context &ctx, const Task &next);
+};
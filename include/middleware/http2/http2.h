@@ -0,0 +1,25 @@
+#pragma once
+
+#include "http/context.h"
+#include "http/task.h"
+#include <string>
+
+// Serves HTTP/2 over cleartext TCP (h2c) after HeadParser, for clients with
+// prior knowledge ("PRI * HTTP/2.0") and for HTTP/1.1 "Upgrade: h2c"
+// requests. The requests of an HTTP/2 connection go through the next
+// middleware one Context per stream; other requests are passed on as is.
+class Http2 {
+private:
+  static bool upgradable(const Context &ctx, std::string &settings);
+
+public:
+  Http2() = default;
+  ~Http2() = default;
+  Http2(const Http2 &other) = default;
+  Http2(Http2 &&other) = default;
+
+  Http2 &operator=(const Http2 &other) = delete;
+  Http2 &operator=(Http2 &&other) = delete;
+
+  void operator()(Context &ctx, const Task &next);
+};
@@ -0,0 +1,60 @@
+#pragma once
+
+#include "http/context.h"
+#include "http/task.h"
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <string>
+
+struct MultipartOptions {
+  // directory of the temporary files holding the file parts
+  std::string temp_dir = "/tmp";
+  // largest content of a file part, and of a form field (kept in memory)
+  uint64_t max_file_size = (uint64_t)4 << 30;
+  size_t max_field_size = 1 << 20;
+  // largest header block of a part, and most parts in a body
+  size_t max_head = 8192;
+  size_t max_parts = 256;
+};
+
+struct MultipartPart {
+  // parameters of the Content-Disposition; filename is empty for a field
+  std::string name;
+  std::string filename;
+  std::map<std::string, std::string> headers;
+  // the content of a form field
+  std::string value;
+  // the temporary file holding the content of a file part, removed once the
+  // middleware chain returns (rename it to keep it)
+  std::string path;
+  uint64_t size;
+};
+
+// called for each part once its content has been received
+using MultipartHandler =
+    std::function<void(Context &ctx, const MultipartPart &part)>;
+
+// Parses multipart/form-data request bodies as they arrive, with memory
+// bounded by the read buffer whatever the size of the upload: form fields
+// are collected in memory and file parts are written to temporary files.
+// A part over its size limit fails the request with 413 as soon as the
+// limit is crossed. The next middleware runs once the whole body is parsed.
+// Other requests are passed to the next middleware unchanged.
+class Multipart {
+private:
+  MultipartHandler handler;
+  MultipartOptions options;
+
+public:
+  Multipart(MultipartHandler &&handler,
+            const MultipartOptions &options = MultipartOptions());
+  ~Multipart() = default;
+  Multipart(const Multipart &other) = default;
+  Multipart(Multipart &&other) = default;
+
+  Multipart &operator=(const Multipart &other) = delete;
+  Multipart &operator=(Multipart &&other) = delete;
+
+  void operator()(Context &ctx, const Task &next);
+};
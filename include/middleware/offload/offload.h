@@ -0,0 +1,41 @@
+#pragma once
+
+#include "executor/executor.h"
+#include "http/context.h"
+#include "http/task.h"
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+struct OffloadRoute {
+  // requests whose path starts with prefix; the longest one matching wins
+  std::string prefix;
+  Priority priority = Priority::normal;
+  // the CPU-bound work of the route (templating, resizing, crypto); it must
+  // not read or write the connection
+  std::function<void(Context &)> work;
+};
+
+// Runs the work of the route of a request on an Executor, at the priority of
+// the route, and waits for it; the rest of the middleware chain then carries
+// on on the connection thread, so only CPU work is handed to the workers.
+// Requests on no route are passed to the next middleware unchanged.
+class Offload {
+private:
+  std::shared_ptr<Executor> executor;
+  // longest prefix first
+  std::shared_ptr<const std::vector<OffloadRoute>> routes;
+
+public:
+  Offload(std::shared_ptr<Executor> executor,
+          std::vector<OffloadRoute> routes);
+  ~Offload() = default;
+  Offload(const Offload &other) = default;
+  Offload(Offload &&other) = default;
+
+  Offload &operator=(const Offload &other) = delete;
+  Offload &operator=(Offload &&other) = delete;
+
+  void operator()(Context &ctx, const Task &next);
+};
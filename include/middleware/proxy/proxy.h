@@ -0,0 +1,33 @@
+#pragma once
+
+#include "http/context.h"
+#include "http/task.h"
+#include "proxy/upstream.h"
+#include <memory>
+#include <vector>
+
+// Forwards the requests under ProxyOptions::prefix to a group of HTTP/1.1
+// upstreams over pooled keep-alive connections, and streams the bodies
+// through in both directions (HTTP/2 streams, whose body is already read,
+// get the response buffered in ctx.resp). Other requests are passed to the
+// next middleware.
+class Proxy {
+private:
+  std::shared_ptr<UpstreamGroup> group;
+
+private:
+  // false if no connection to upstream could be opened
+  bool forward(Context &ctx, Upstream &upstream) const;
+
+public:
+  Proxy(const std::vector<UpstreamAddress> &upstreams,
+        const ProxyOptions &options = ProxyOptions());
+  ~Proxy() = default;
+  Proxy(const Proxy &other) = default;
+  Proxy(Proxy &&other) = default;
+
+  Proxy &operator=(const Proxy &other) = delete;
+  Proxy &operator=(Proxy &&other) = delete;
+
+  void operator()(Context &ctx, const Task &next);
+};
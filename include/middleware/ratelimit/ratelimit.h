@@ -0,0 +1,45 @@
+#pragma once
+
+#include "http/context.h"
+#include "http/preparedresponse.h"
+#include "http/task.h"
+#include "ratelimit/buckets.h"
+#include <memory>
+#include <string>
+
+struct RateLimitOptions {
+  // requests per second allowed to a client in the long run
+  double rate = 100;
+  // requests a client may send at once after being idle
+  size_t burst = 200;
+  // if set, clients are told apart by this request header (e.g. an API key
+  // or X-Forwarded-For behind a proxy) instead of their address; requests
+  // without it are keyed on their address
+  std::string header;
+  // clients tracked at the same time; beyond that, new clients are let
+  // through until the buckets of idle ones expire
+  size_t capacity = 65536;
+};
+
+// Limits the rate of requests of each client with a token bucket. A client
+// over its limit gets 429 (with Retry-After) from a response serialized
+// once, and the next middleware does not run: register it right after the
+// parser, before the costly middleware. Clients on a Unix domain socket are
+// not limited unless RateLimitOptions::header is set.
+class RateLimit {
+private:
+  std::string header;
+  std::shared_ptr<TokenBuckets> buckets;
+  std::shared_ptr<const PreparedResponse> rejected;
+
+public:
+  RateLimit(const RateLimitOptions &options = RateLimitOptions());
+  ~RateLimit() = default;
+  RateLimit(const RateLimit &other) = default;
+  RateLimit(RateLimit &&other) = default;
+
+  RateLimit &operator=(const RateLimit &other) = delete;
+  RateLimit &operator=(RateLimit &&other) = delete;
+
+  void operator()(Context &ctx, const Task &next);
+};
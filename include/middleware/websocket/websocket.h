@@ -0,0 +1,25 @@
+#pragma once
+
+#include "http/context.h"
+#include "http/task.h"
+#include "websocket/loop.h"
+#include <memory>
+
+// Accepts "Upgrade: websocket" requests (RFC 6455) and hands their
+// connections over to a WsLoop shared by every copy of the middleware.
+// Other requests are passed to the next middleware.
+class WebSocket {
+private:
+  std::shared_ptr<WsLoop> loop;
+
+public:
+  WebSocket(WsHandlers &&handlers, size_t max_message = WS_MAX_MESSAGE);
+  ~WebSocket() = default;
+  WebSocket(const WebSocket &other) = default;
+  WebSocket(WebSocket &&other) = default;
+
+  WebSocket &operator=(const WebSocket &other) = delete;
+  WebSocket &operator=(WebSocket &&other) = delete;
+
+  void operator()(Context &ctx, const Task &next);
+};
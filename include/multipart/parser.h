@@ -0,0 +1,72 @@
+#pragma once
+
+#include "common.h"
+#include "csr/result.hpp"
+#include "servererrors.h"
+#include <cstddef>
+#include <functional>
+#include <map>
+#include <string>
+#include <vector>
+
+// longest boundary allowed by RFC 2046 5.1.1
+constexpr size_t MULTIPART_MAX_BOUNDARY = 70;
+
+// Called by MultipartParser as the parts go by. An error returned by a
+// callback stops the parsing and is returned by feed().
+struct MultipartCallbacks {
+  // the header fields of a part, names as sent
+  std::function<csr::Result<std::monostate, server_error_t>(
+      const std::map<std::string, std::string> &headers)>
+      begin;
+  // the next bytes of the content of the part
+  std::function<csr::Result<std::monostate, server_error_t>(const char *data,
+                                                            size_t size)>
+      data;
+  std::function<csr::Result<std::monostate, server_error_t>()> end;
+};
+
+/*
+ * Streaming parser of multipart bodies (RFC 2046 5.1, RFC 7578). The body is
+ * fed in pieces of any size; the delimiters are found with a
+ * Boyer-Moore-Horspool search, and the content of a part is passed on as
+ * soon as it cannot be the start of a delimiter. Only the bytes that may
+ * belong to a delimiter or to an incomplete part head are kept, so memory
+ * does not grow with the body.
+ */
+class MultipartParser {
+private:
+  enum class State { preamble, delimiter, head, content, epilogue };
+
+  State state;
+  // "\r\n--" boundary
+  std::string delim;
+  // distance to shift the search by, for each last byte of the window
+  size_t skip[256];
+  size_t max_head;
+  MultipartCallbacks callbacks;
+
+  // bytes fed but not parsed yet
+  std::vector<char> window;
+
+private:
+  // offset of the first delimiter in [data, data + size), or size
+  size_t search(const char *data, size_t size) const;
+  csr::Result<std::monostate, server_error_t> parse_head(const char *data,
+                                                         size_t size) const;
+
+public:
+  // boundary: the parameter of the Content-Type; max_head: largest header
+  // block of a part
+  MultipartParser(const std::string &boundary, size_t max_head,
+                  MultipartCallbacks &&callbacks);
+  ~MultipartParser() = default;
+
+  NOT_COPYABLE(MultipartParser);
+  NOT_MOVEABLE(MultipartParser);
+
+  csr::Result<std::monostate, server_error_t> feed(const char *data,
+                                                   size_t size);
+  // whether the close delimiter has been seen
+  bool done() const;
+};
@@ -0,0 +1,113 @@
+#pragma once
+
+#include "common.h"
+#include "csr/result.hpp"
+#include "servererrors.h"
+#include "socket/socket.h"
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+struct UpstreamAddress {
+  std::string host;
+  int port;
+};
+
+struct ProxyOptions {
+  // requests whose path starts with prefix are forwarded
+  std::string prefix = "/";
+  // path requested by the health checks; a 2xx or 3xx status is healthy
+  std::string health_path = "/";
+  // time between two health checks of an upstream in ms
+  int health_interval = 2000;
+  // time allowed to connect to an upstream in ms
+  int connect_timeout = 1000;
+  // time a read or write on an upstream connection may block in ms
+  int timeout = 30000;
+  // idle keep-alive connections kept per upstream
+  size_t max_idle = 32;
+  // idle connections older than this (ms) are closed instead of reused
+  int idle_timeout = 30000;
+};
+
+// An upstream server with its pool of idle keep-alive connections.
+class Upstream {
+private:
+  struct Idle {
+    SocketClient sc;
+    std::chrono::steady_clock::time_point since;
+  };
+
+  // host:port, the Host of requests that have none
+  std::string authority;
+  struct sockaddr_storage addr;
+  socklen_t addrlen;
+
+  std::mutex mutex;
+  // most recently released at the back
+  std::deque<Idle> idle;
+
+public:
+  // requests in flight, for least-outstanding balancing
+  std::atomic<size_t> outstanding;
+  // result of the last health check or connection attempt
+  std::atomic<bool> healthy;
+
+public:
+  Upstream(const UpstreamAddress &address,
+           const struct sockaddr_storage &addr, socklen_t addrlen);
+  ~Upstream() = default;
+
+  NOT_COPYABLE(Upstream);
+  NOT_MOVEABLE(Upstream);
+
+  const std::string &host() const;
+
+  // an idle connection if one is still open (reused is set), a new one
+  // otherwise; the upstream is marked unhealthy if it cannot be connected to
+  csr::Result<SocketClient, server_error_t>
+  acquire(const ProxyOptions &options, bool &reused);
+  // return a connection whose last response was read completely
+  void release(SocketClient &&sc, const ProxyOptions &options);
+
+  // request the health path on a connection of its own
+  bool check(const ProxyOptions &options);
+};
+
+// The upstreams of a Proxy, shared by all its copies. A thread checks their
+// health in the background; requests go to the healthy upstream with the
+// fewest requests in flight.
+class UpstreamGroup {
+private:
+  ProxyOptions options;
+  std::vector<std::unique_ptr<Upstream>> upstreams;
+  // rotates the starting point of pick() to spread ties
+  std::atomic<size_t> next;
+
+  std::mutex mutex;
+  std::condition_variable cv;
+  bool stopping;
+  std::thread thread;
+
+private:
+  void run();
+
+public:
+  // throws std::system_error if an address cannot be resolved
+  UpstreamGroup(const std::vector<UpstreamAddress> &addresses,
+                const ProxyOptions &options);
+  ~UpstreamGroup();
+
+  NOT_COPYABLE(UpstreamGroup);
+  NOT_MOVEABLE(UpstreamGroup);
+
+  const ProxyOptions &config() const;
+  // nullptr if no upstream is healthy
+  Upstream *pick();
+};
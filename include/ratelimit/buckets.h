@@ -0,0 +1,62 @@
+#pragma once
+
+#include "common.h"
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+/*
+ * A fixed-size table of token buckets, one per client key, shared by all
+ * the connection threads without a lock.
+ *
+ * Each bucket is kept as a single timestamp, its theoretical arrival time
+ * (GCRA): a request is allowed if it is no further than burst intervals in
+ * the future, and pushes it one interval ahead. This is the same as a bucket
+ * of burst tokens refilled at rate tokens per second, but a request only
+ * needs a compare-and-swap on one word.
+ *
+ * The slots are grouped by cache line and a key is looked up in the few
+ * slots after its hash, so threads working on different clients rarely
+ * touch the same line. A bucket whose timestamp is in the past is full
+ * again, i.e. indistinguishable from a new one: its slot is reclaimed by the
+ * next client that needs room, so idle entries expire without a sweeper.
+ */
+class TokenBuckets {
+private:
+  struct Slot {
+    // 0 if the slot has never been used
+    std::atomic<uint64_t> key;
+    // theoretical arrival time in ns of steady_clock
+    std::atomic<int64_t> tat;
+  };
+
+  struct alignas(64) Line {
+    Slot slots[64 / sizeof(Slot)];
+  };
+
+  std::unique_ptr<Line[]> lines;
+  size_t mask;
+  // ns between two tokens, and how far ahead tat may go
+  int64_t interval;
+  int64_t tolerance;
+
+public:
+  // rate in requests per second, at most burst of them at once; capacity
+  // is the number of clients tracked at the same time
+  TokenBuckets(double rate, size_t burst, size_t capacity);
+  ~TokenBuckets() = default;
+
+  NOT_COPYABLE(TokenBuckets);
+  NOT_MOVEABLE(TokenBuckets);
+
+  // take a token from the bucket of key; false if it is empty. A key that
+  // finds no free slot is let through.
+  bool take(uint64_t key);
+
+  // seconds until an empty bucket has a token again (at least 1)
+  int64_t retry_after() const;
+};
+
+// FNV-1a of size bytes, never 0
+uint64_t bucket_key(const void *data, size_t size);
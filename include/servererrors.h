@@ -16,6 +16,14 @@ enum ServerErr : int {
 
   // Other
   numeric_limit_reached,
+
+  // New codes go last, so that the values above never change
+  unsupported_option,
+  connection_closed,
+  tls_error,
+  invalid_body,
+  invalid_response,
+  compression_error,
 };
 
 class ServerCategory : public std::error_category {
@@ -24,9 +32,20 @@ public:
   virtual std::string message(int ev) const override;
 };
 
-#define sys_socket_error(str)                                                  \
-  std::system_error(GETSOCKETERRNO(), std::system_category(), str)
-#define server_error(err, str) std::system_error(err, ServerCategory(), str)
+// the single instance of ServerCategory
+const std::error_category &server_category() noexcept;
+
+std::error_code make_error_code(ServerErr err) noexcept;
+
+namespace std {
+template <> struct is_error_code_enum<ServerErr> : true_type {};
+} // namespace std
+
+// Errors are plain std::error_code values: creating and propagating them
+// neither allocates nor throws. The message is only built on demand.
+#define sys_socket_error()                                                     \
+  std::error_code(GETSOCKETERRNO(), std::system_category())
+#define server_error(err) make_error_code(err)
 
-// server_error_t = std::system_error + ServerErr
-typedef std::system_error server_error_t;
\ No newline at end of file
+// server_error_t = std::error_code of system_category or ServerCategory
+typedef std::error_code server_error_t;
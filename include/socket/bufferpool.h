@@ -0,0 +1,47 @@
+#pragma once
+
+#include "common.h"
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+// sizes of the pooled buffers: powers of two from 1 KB to 1 MB
+constexpr size_t BUFFER_MIN = 1024;
+constexpr size_t BUFFER_CLASSES = 11;
+// memory allocated at once for the buffers of a size class
+constexpr size_t SLAB_SIZE = 65536;
+
+// Slab allocator of the I/O buffers of Reader and Writer.
+// Buffers are only held while data is in flight, so an idle connection pins
+// none, and buffers released by one connection are reused by the next
+// instead of going back to malloc. Slabs are never freed: the memory of the
+// pool is the peak of the buffers in use.
+class BufferPool {
+private:
+  struct SizeClass {
+    std::mutex mutex;
+    std::vector<char *> free;
+    std::vector<std::unique_ptr<char[]>> slabs;
+  };
+  SizeClass classes[BUFFER_CLASSES];
+
+private:
+  BufferPool() = default;
+  ~BufferPool() = default;
+
+  NOT_COPYABLE(BufferPool);
+  NOT_MOVEABLE(BufferPool);
+
+public:
+  static BufferPool &instance();
+
+  // size rounded up to the size class that serves it
+  static size_t round(size_t size);
+
+  // a buffer of round(size) bytes; sizes above the largest class are
+  // allocated on their own
+  char *acquire(size_t size);
+  // size must be the one passed to acquire
+  void release(char *buffer, size_t size);
+};
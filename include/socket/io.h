@@ -4,67 +4,100 @@
 #include "csr/result.hpp"
 #include "servererrors.h"
 #include "socket/socket_common.h"
+#include "socket/transport.h"
 #include <vector>
 
 constexpr size_t BUFSIZE = 8192;
 
+// The buffers of Reader and Writer come from the BufferPool and are only held
+// while data is in flight: a connection waiting for input holds none.
+// Given a Transport, they use it instead of the socket connfd.
 class Reader {
 private:
-  char buffer[BUFSIZE];
+  // nullptr while no input is buffered
+  char *buffer;
+  size_t bufsize;
   char *usable_buf;
   m_sock_t fd;
+  // nullptr for a socket
+  Transport *transport;
+
+  // number of bytes that may still be read (if limited)
+  size_t maxlen;
+  bool limited;
 
 protected:
   size_t cnt;
 
+private:
+  csr::Result<size_t, server_error_t> receive(char *usrbuf, size_t n);
+  csr::Result<size_t, server_error_t> fill();
+  void release();
+
 public:
-  Reader(m_sock_t connfd);
-  virtual ~Reader() = default;
+  Reader(m_sock_t connfd, size_t bufsize = BUFSIZE,
+         Transport *transport = nullptr);
+  virtual ~Reader();
 
   NOT_COPYABLE(Reader);
   NOT_MOVEABLE(Reader);
 
-  virtual csr::Result<size_t, std::system_error> read(char *usrbuf, size_t n);
-  csr::Result<size_t, std::system_error> readn(char *usrbuf, size_t n);
-  csr::Result<size_t, std::system_error> read_char(char *c);
-  csr::Result<size_t, std::system_error> readline(std::vector<char> &usrbuf);
-  csr::Result<size_t, std::system_error> readline(std::string &usrbuf);
+  // fail with max_len_reached once maxlen more bytes have been read
+  void limit(size_t maxlen);
+  void unlimit();
+  // start over on another connection, dropping the buffered input
+  void reset(m_sock_t connfd, size_t bufsize = BUFSIZE,
+             Transport *transport = nullptr);
+
+  virtual csr::Result<size_t, server_error_t> read(char *usrbuf, size_t n);
+  csr::Result<size_t, server_error_t> readn(char *usrbuf, size_t n);
+  // read exactly n bytes unless EOF is reached first
+  csr::Result<size_t, server_error_t> read_exact(char *usrbuf, size_t n);
+  csr::Result<size_t, server_error_t> read_char(char *c);
+  csr::Result<size_t, server_error_t> readline(std::vector<char> &usrbuf);
+  csr::Result<size_t, server_error_t> readline(std::string &usrbuf);
+
+  // move the bytes read from the socket but not consumed yet to usrbuf
+  void take(std::vector<char> &usrbuf);
 };
 
 class LimitSizeReader : public Reader {
-private:
-  size_t maxlen;
-
 public:
   LimitSizeReader(m_sock_t connfd, size_t maxlen);
   virtual ~LimitSizeReader() = default;
 
   NOT_COPYABLE(LimitSizeReader);
   NOT_MOVEABLE(LimitSizeReader);
-
-  virtual csr::Result<size_t, server_error_t> read(char *usrbuf,
-                                                   size_t n) override;
 };
 
 class Writer {
 private:
-  char buffer[BUFSIZE];
+  // nullptr while nothing is buffered
+  char *buffer;
+  size_t bufsize;
   size_t cnt;
   m_sock_t fd;
+  // nullptr for a socket
+  Transport *transport;
 
-  csr::Result<size_t, std::system_error> write_ub(const char *usrbuf,
-                                                  size_t size) const;
+  csr::Result<size_t, server_error_t> write_ub(const char *usrbuf,
+                                               size_t size) const;
 
 public:
-  Writer(m_sock_t connfd);
-  ~Writer() = default;
+  Writer(m_sock_t connfd, size_t bufsize = BUFSIZE,
+         Transport *transport = nullptr);
+  ~Writer();
 
   NOT_COPYABLE(Writer);
   NOT_MOVEABLE(Writer);
 
-  csr::Result<size_t, std::system_error> write(const char *usrbuf, size_t size);
-  csr::Result<size_t, std::system_error> write(const std::vector<char> &usrbuf);
-  csr::Result<size_t, std::system_error> write(const std::string &usrbuf);
+  csr::Result<size_t, server_error_t> write(const char *usrbuf, size_t size);
+  csr::Result<size_t, server_error_t> write(const std::vector<char> &usrbuf);
+  csr::Result<size_t, server_error_t> write(const std::string &usrbuf);
+
+  // flush the buffer and write usrbuf to the socket without copying it
+  csr::Result<size_t, server_error_t> write_through(const char *usrbuf,
+                                                    size_t size);
 
-  csr::Result<size_t, std::system_error> flush();
+  csr::Result<size_t, server_error_t> flush();
 };
\ No newline at end of file
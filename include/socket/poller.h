@@ -0,0 +1,62 @@
+#pragma once
+
+#include "common.h"
+#include "csr/result.hpp"
+#include "servererrors.h"
+#include "socket/socket_common.h"
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+// struct pollfd (winsock2.h on Windows)
+#if defined(__APPLE__)
+#include <poll.h>
+#endif
+
+struct PollEvent {
+  m_sock_t fd;
+  bool readable;
+  bool writable;
+  // error or hang up
+  bool closed;
+};
+
+// Readiness notification for many sockets: epoll on Linux, poll elsewhere.
+// Only the thread calling wait() may add, modify or remove sockets; wake()
+// can be called from any thread.
+class Poller {
+private:
+#if defined(__linux__)
+  int epfd;
+#else
+  std::vector<struct pollfd> fds;
+  // index of each socket in fds
+  std::unordered_map<m_sock_t, size_t> index;
+#endif
+
+#if defined(__APPLE__) || defined(__linux__)
+  // self-pipe interrupting wait()
+  int wake_pipe[2];
+#endif
+
+private:
+  Poller();
+
+public:
+  ~Poller();
+
+  NOT_COPYABLE(Poller);
+  NOT_MOVEABLE(Poller);
+
+  static csr::Result<std::unique_ptr<Poller>, server_error_t> create();
+
+  // readability is always watched, writability only if write is set
+  csr::Result<std::monostate, server_error_t> add(m_sock_t fd, bool write);
+  csr::Result<std::monostate, server_error_t> modify(m_sock_t fd, bool write);
+  csr::Result<std::monostate, server_error_t> remove(m_sock_t fd);
+
+  // wait at most timeout ms (-1 for no limit) for events or wake()
+  csr::Result<std::monostate, server_error_t>
+  wait(int timeout, std::vector<PollEvent> &events);
+  void wake();
+};
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+
+// Tunables applied to the listening socket and to every accepted connection.
+// Options that are not available on the current platform make
+// SocketGenerator::listen fail with ServerErr::unsupported_option when they
+// are enabled.
+struct ServerOptions {
+  // length of the pending connection queue passed to listen()
+  int backlog = 1024;
+  // address to bind to; empty means all local addresses
+  std::string address;
+
+  // SO_REUSEADDR / SO_REUSEPORT on the listening socket
+  bool reuse_addr = false;
+  bool reuse_port = false;
+
+  // SO_SNDBUF / SO_RCVBUF in bytes; 0 keeps the system default
+  int send_buffer = 0;
+  int recv_buffer = 0;
+
+  // TCP_DEFER_ACCEPT timeout in seconds; 0 disables it (Linux only)
+  int defer_accept = 0;
+  // TCP_FASTOPEN queue length; 0 disables it
+  int fastopen = 0;
+
+  // disable Nagle's algorithm on accepted connections
+  bool tcp_nodelay = true;
+  // close accepted connections on exec (SOCK_CLOEXEC with accept4 on
+  // Linux); they are always blocking, as Reader and Writer expect
+  bool accept_cloexec = true;
+  // size of the read and write buffers of a connection (8 KB); they are
+  // taken from a shared pool only while data is in flight
+  size_t buffer_size = 8192;
+
+  // PEM files of the certificate chain and of its private key; setting
+  // them serves TLS on every connection (requires a build with tls=1)
+  std::string tls_cert;
+  std::string tls_key;
+
+  // Unix socket path used for zero-downtime restarts (not on Windows).
+  // On startup, the listening socket is taken over from the server
+  // listening on this path, if any. The server then listens on the path
+  // itself and hands its listening socket to the next process that connects.
+  std::string handover_path;
+  // time given to in-flight requests after stop() in milliseconds
+  int drain_timeout = 30000;
+
+  // connection objects (Context and its buffers) kept for reuse once their
+  // connection is closed
+  size_t client_pool = 256;
+
+  // worker processes accepting on the listening sockets (see Prefork); 0
+  // serves every connection from the process calling run() (not on Windows)
+  size_t workers = 0;
+  // bind worker i to CPU i (Linux only)
+  bool pin_workers = false;
+};
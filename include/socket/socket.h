@@ -4,7 +4,11 @@
 #include "csr/result.hpp"
 #include "servererrors.h"
 #include "socket/io.h"
+#include "socket/serveroptions.h"
 #include "socket/socket_common.h"
+#include "socket/tls.h"
+#include <memory>
+#include <string>
 #include <variant>
 
 class SocketClient {
@@ -24,18 +28,45 @@ public:
   SocketClient &operator=(SocketClient &&other) = delete;
   NOT_COPYABLE(SocketClient);
 
+  // shut down both directions, failing any blocking read or write
+  csr::Result<std::monostate, server_error_t> shutdown() const;
+
+  csr::Result<std::monostate, server_error_t>
+  set_nonblock(bool nonblock) const;
+  // close the connection before the destructor does
+  csr::Result<std::monostate, server_error_t> close();
+
+  // fail blocking reads and writes that wait longer than timeout ms;
+  // 0 for no limit
+  csr::Result<std::monostate, server_error_t> set_timeout(int timeout) const;
+
   friend class Socket;
+  friend class SocketGenerator;
 };
 
 class Socket {
 private:
   csr::Option<m_sock_t> sockfd;
+  // whether this object owns a WSAStartup reference (Windows)
+  bool owner;
+  // filesystem path bound by a Unix listening socket, and the identity
+  // (st_dev, st_ino) of the file created by bind()
+  std::string path;
+  uint64_t path_dev;
+  uint64_t path_ino;
+  bool nodelay;
+  bool cloexec;
+  // size of the I/O buffers of the connections
+  size_t bufsize;
+  // set when the connections are TLS
+  std::shared_ptr<TlsContext> tls;
 
 private:
-  Socket(m_sock_t sockfd);
+  Socket(m_sock_t sockfd, const ServerOptions &options);
 
-  static csr::Result<m_sock_t, std::system_error>
-  _Accept(m_sock_t listenfd, struct sockaddr *addr, socklen_t *addrlen);
+  // returns None if no connection is pending
+  csr::Result<csr::Option<m_sock_t>, server_error_t>
+  _Accept(m_sock_t listenfd, struct sockaddr *addr, socklen_t *addrlen) const;
 
 public:
   Socket(Socket &&other);
@@ -44,24 +75,73 @@ public:
   Socket &operator=(Socket &&other) = delete;
   NOT_COPYABLE(Socket);
 
-  csr::Result<SocketClient, std::system_error> accept() const;
+  csr::Result<SocketClient, server_error_t> accept() const;
+  // wait at most timeout ms (-1 for no limit) for a connection
+  csr::Result<csr::Option<SocketClient>, server_error_t>
+  accept_for(int timeout) const;
+
+  // run the TLS handshake of an accepted connection, if the socket serves
+  // TLS; blocks, so it belongs to the thread of the connection
+  csr::Result<std::monostate, server_error_t> secure(SocketClient &sc) const;
+
+  // stop listening; the destructor does the rest of the cleanup
+  csr::Result<std::monostate, server_error_t> close();
+
+  m_sock_t fd() const;
+  size_t buffer_size() const;
+
+  // pass the listening descriptor to the process connected to peer
+  // via SCM_RIGHTS (not on Windows); the path of a Unix socket then
+  // belongs to that process and is no longer removed by close()
+  csr::Result<std::monostate, server_error_t>
+  send_to(const SocketClient &peer);
 
   friend class SocketGenerator;
 };
 
 class SocketGenerator {
 private:
-  static csr::Result<std::monostate, std::system_error>
+  static csr::Result<std::monostate, server_error_t>
   _Getaddrinfo(const char *node, const char *service,
                const struct addrinfo *hints, struct addrinfo **res);
 
-  static csr::Result<m_sock_t, std::system_error> _Socket(int domain, int type,
-                                                          int protocol);
-  static csr::Result<std::monostate, std::system_error>
+  static csr::Result<m_sock_t, server_error_t> _Socket(int domain, int type,
+                                                       int protocol);
+  static csr::Result<std::monostate, server_error_t>
   _Bind(m_sock_t sockfd, const struct sockaddr *addr, socklen_t addrlen);
-  static csr::Result<std::monostate, std::system_error> _Listen(m_sock_t sockfd,
-                                                                int backlog);
+  static csr::Result<std::monostate, server_error_t> _Listen(m_sock_t sockfd,
+                                                             int backlog);
+
+  static csr::Result<std::monostate, server_error_t>
+  _Setsockopts(m_sock_t sockfd, const ServerOptions &options);
+  static csr::Result<std::monostate, server_error_t>
+  _Secure(Socket &s, const ServerOptions &options);
 
 public:
-  static csr::Result<Socket, server_error_t> listen(int port);
+  static csr::Result<Socket, server_error_t>
+  listen(int port, const ServerOptions &options = ServerOptions());
+
+  // listen on a Unix stream socket bound to path (not on Windows); a path
+  // starting with '@' names a socket in the abstract namespace (Linux only).
+  // The TCP options are ignored.
+  static csr::Result<Socket, server_error_t>
+  listen_unix(const std::string &path,
+              const ServerOptions &options = ServerOptions());
+
+  // receive a listening socket from the process listening on path
+  // (see Socket::send_to)
+  static csr::Result<Socket, server_error_t>
+  inherit(const std::string &path,
+          const ServerOptions &options = ServerOptions());
+
+  // resolve host and port to the first address usable by connect
+  static csr::Result<std::monostate, server_error_t>
+  resolve(const std::string &host, int port, struct sockaddr_storage &addr,
+          socklen_t &addrlen);
+
+  // open a TCP connection to addr, waiting at most timeout ms (-1 for no
+  // limit); the connection is blocking and has TCP_NODELAY set
+  static csr::Result<SocketClient, server_error_t>
+  connect(const struct sockaddr_storage &addr, socklen_t addrlen,
+          int timeout);
 };
\ No newline at end of file
@@ -15,6 +15,7 @@
 // helpers
 #if defined(__APPLE__) || defined(__linux__)
 typedef int m_sock_t;
+#define INVALID_SOCKET (-1)
 #define ISINVALIDSOCKET(socket) ((socket) == -1)
 #define ISSOCKETERROR(socket) ((socket) == -1)
 #elif defined(_WIN32)
@@ -28,6 +29,15 @@ typedef SOCKET m_sock_t;
 // errno
 #if defined(__APPLE__) || defined(__linux__)
 #define GETSOCKETERRNO() (errno)
+#define ISWOULDBLOCK(err) ((err) == EAGAIN || (err) == EWOULDBLOCK)
 #elif defined(_WIN32)
 #define GETSOCKETERRNO() (WSAGetLastError())
+#define ISWOULDBLOCK(err) ((err) == WSAEWOULDBLOCK)
+#endif
+// a peer that resets the connection makes send fail with EPIPE instead of
+// raising SIGPIPE (Apple sockets use SO_NOSIGPIPE instead, see Socket)
+#if defined(__linux__)
+#define SEND_FLAGS MSG_NOSIGNAL
+#else
+#define SEND_FLAGS 0
 #endif
\ No newline at end of file
@@ -0,0 +1,43 @@
+#pragma once
+
+#include "common.h"
+#include "csr/result.hpp"
+#include "servererrors.h"
+#include "socket/socket_common.h"
+#include <memory>
+#include <string>
+#include <variant>
+
+class SocketClient;
+
+// longest time a client may take to complete the TLS handshake
+constexpr int TLS_HANDSHAKE_TIMEOUT = 10;
+
+// TLS termination with OpenSSL, compiled in with `make tls=1` (USE_TLS).
+// After the handshake, the record layer is offloaded to the kernel (kTLS)
+// when both the kernel and OpenSSL support it for the negotiated cipher: the
+// connection then reads and writes plaintext on its descriptor, so Reader,
+// Writer, sendfile and the Poller work on it unchanged. Otherwise the
+// connection is relayed through a socket pair by a thread of its own.
+class TlsContext {
+private:
+  struct ssl_ctx_st *ctx;
+
+private:
+  explicit TlsContext(struct ssl_ctx_st *ctx);
+
+public:
+  ~TlsContext();
+
+  NOT_COPYABLE(TlsContext);
+  NOT_MOVEABLE(TlsContext);
+
+  // load the certificate chain and the private key (PEM files); fails with
+  // unsupported_option without USE_TLS or on Windows
+  static csr::Result<std::shared_ptr<TlsContext>, server_error_t>
+  create(const std::string &cert, const std::string &key);
+
+  // run the server side of the handshake on sc; on success, sc carries the
+  // plaintext of the connection
+  csr::Result<std::monostate, server_error_t> accept(SocketClient &sc) const;
+};
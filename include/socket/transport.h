@@ -0,0 +1,54 @@
+#pragma once
+
+#include "common.h"
+#include "csr/result.hpp"
+#include "servererrors.h"
+#include <string_view>
+#include <vector>
+
+// Where Reader and Writer move their bytes when they are not bound to a
+// socket. A connection is either a descriptor or a Transport: the socket
+// calls are skipped entirely for the latter.
+class Transport {
+public:
+  Transport() = default;
+  virtual ~Transport() = default;
+
+  NOT_COPYABLE(Transport);
+  NOT_MOVEABLE(Transport);
+
+  // at most n bytes, 0 at the end of the input
+  virtual csr::Result<size_t, server_error_t> recv(char *usrbuf,
+                                                   size_t n) = 0;
+  // all the n bytes, or an error
+  virtual csr::Result<size_t, server_error_t> send(const char *usrbuf,
+                                                   size_t n) = 0;
+};
+
+// A connection held in memory: the client sends the bytes of input at once
+// and closes its side; whatever the server sends is appended to output.
+// Used by HttpServer::loopback to run requests through the middleware
+// without the network stack.
+class MemoryTransport : public Transport {
+private:
+  std::vector<char> input;
+  size_t consumed;
+  std::vector<char> output;
+
+public:
+  MemoryTransport();
+  explicit MemoryTransport(std::string_view input);
+  virtual ~MemoryTransport() = default;
+
+  NOT_COPYABLE(MemoryTransport);
+  NOT_MOVEABLE(MemoryTransport);
+
+  // start over with another input, keeping the memory of both buffers
+  void reset(std::string_view input);
+  const std::vector<char> &sent() const;
+
+  virtual csr::Result<size_t, server_error_t> recv(char *usrbuf,
+                                                   size_t n) override;
+  virtual csr::Result<size_t, server_error_t> send(const char *usrbuf,
+                                                   size_t n) override;
+};
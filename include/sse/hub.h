@@ -0,0 +1,150 @@
+#pragma once
+
+#include "common.h"
+#include "csr/result.hpp"
+#include "http/context.h"
+#include "servererrors.h"
+#include "socket/poller.h"
+#include "socket/socket.h"
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+// buffers written by a single sendmsg() to a subscriber
+constexpr size_t SSE_IOV = 64;
+
+struct SseOptions {
+  // bytes of events queued for a subscriber; a subscriber that falls
+  // further behind is disconnected
+  size_t max_queue = 1 << 20;
+  // a comment is sent to a subscriber nothing was written to for that many
+  // ms, so that proxies keep the connection open and dead clients are found
+  // out; 0 disables it
+  int heartbeat = 15000;
+};
+
+struct SseStats {
+  // connections subscribed to a channel
+  size_t subscribers;
+  // events published, and the subscribers they were queued to
+  size_t published;
+  size_t delivered;
+  // subscribers disconnected for being too slow
+  size_t dropped;
+};
+
+/*
+ * Server-Sent Events: connections subscribed to named channels, kept open
+ * and written to from a single thread waiting on a Poller (like WsLoop), so
+ * an idle subscriber costs its socket and its queue instead of a thread.
+ *
+ * publish() serializes an event once into a refcounted buffer and queues a
+ * reference to it to every subscriber of the channel, without copying it;
+ * the loop thread then writes each queue with a single sendmsg(). A
+ * subscriber whose queue grows past SseOptions::max_queue is dropped, so a
+ * slow reader never holds more than that.
+ *
+ * Create it with std::make_shared: connections being handed over to it keep
+ * it alive.
+ */
+class SseHub : public std::enable_shared_from_this<SseHub> {
+private:
+  struct Subscriber {
+    SocketClient sc;
+    std::string channel;
+
+    // guards the members below
+    std::mutex mutex;
+    // events not completely written yet, oldest first
+    std::deque<std::shared_ptr<const std::string>> queue;
+    // bytes of the first event already written
+    size_t offset = 0;
+    // bytes left to write
+    size_t queued = 0;
+    // too slow or gone: to be closed by the loop
+    bool dropped = false;
+    // when output was last written to it (or it was registered)
+    std::chrono::steady_clock::time_point last_write;
+
+    // only used by the loop thread
+    bool watching = false;
+    bool closed = false;
+
+    Subscriber(SocketClient &&sc, const std::string &channel);
+  };
+
+  SseOptions options;
+  std::unique_ptr<Poller> poller;
+  std::atomic<bool> stopping;
+  std::shared_ptr<const std::string> heartbeat;
+  // only used by the loop thread: when a subscriber may be due a heartbeat
+  std::chrono::steady_clock::time_point next_heartbeat;
+
+  // guards channels
+  std::mutex mutex;
+  std::unordered_map<std::string, std::vector<std::shared_ptr<Subscriber>>>
+      channels;
+
+  // guards the queues below
+  std::mutex pending_mutex;
+  std::vector<std::shared_ptr<Subscriber>> added;
+  // subscribers with events to write
+  std::vector<std::shared_ptr<Subscriber>> pending;
+
+  // only used by the loop thread
+  std::unordered_map<m_sock_t, std::shared_ptr<Subscriber>> subscribers;
+
+  std::atomic<size_t> count;
+  std::atomic<size_t> published;
+  std::atomic<size_t> delivered;
+  std::atomic<size_t> dropped;
+
+  std::thread thread;
+
+private:
+  void run();
+  // queue event to the subscribers and append those to write to ready;
+  // returns how many it was queued to
+  size_t queue(const std::vector<std::shared_ptr<Subscriber>> &to,
+               const std::shared_ptr<const std::string> &event,
+               std::vector<std::shared_ptr<Subscriber>> &ready);
+  // queue a heartbeat to the idle subscribers with nothing queued, append
+  // them to ready and set next_heartbeat
+  void beat(std::chrono::steady_clock::time_point now,
+            std::vector<std::shared_ptr<Subscriber>> &ready);
+  void flush(const std::shared_ptr<Subscriber> &subscriber);
+  void on_readable(const std::shared_ptr<Subscriber> &subscriber);
+  void finish(const std::shared_ptr<Subscriber> &subscriber);
+
+public:
+  // throws std::system_error if no Poller can be created
+  SseHub(const SseOptions &options = SseOptions());
+  ~SseHub();
+
+  NOT_COPYABLE(SseHub);
+  NOT_MOVEABLE(SseHub);
+
+  // answer the request with an event stream and subscribe its connection
+  // to channel once the middleware chain returns; fails with
+  // unsupported_option on HTTP/2 streams and on connections that are not
+  // sockets, or with the error of writing the response head
+  csr::Result<std::monostate, server_error_t>
+  subscribe(Context &ctx, const std::string &channel);
+
+  // send an event to every subscriber of channel; data may span several
+  // lines, event and id are left out if empty. Returns the number of
+  // subscribers it was queued to.
+  size_t publish(const std::string &channel, std::string_view data,
+                 std::string_view event = std::string_view(),
+                 std::string_view id = std::string_view());
+
+  SseStats stats() const;
+};
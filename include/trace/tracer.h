@@ -0,0 +1,123 @@
+#pragma once
+
+#include "common.h"
+#include "lifetime.h"
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// spans kept per thread; older ones are overwritten
+constexpr size_t TRACE_SPANS = 4096;
+
+enum class SpanKind : uint8_t {
+  // from accept() returning to the connection thread running
+  accept,
+  // TLS handshake
+  handshake,
+  // request line and headers (HeadParser)
+  parse,
+  // a middleware, including the ones it passes the request to; the
+  // argument is its position in the chain
+  task,
+  // Context::write
+  write,
+};
+
+/*
+ * Records timed spans of sampled connections and dumps them as Chrome Trace
+ * Event JSON (chrome://tracing, https://ui.perfetto.dev).
+ *
+ * Tracing is off until enable(). A connection is sampled once, when it is
+ * accepted; every span of an unsampled connection (and all of them while
+ * tracing is off) costs a test of its trace id. Spans are kept in a buffer
+ * of the thread that records them, which takes no lock other threads wait
+ * on outside of dump(). The buffer of a thread that exits is passed on to
+ * the next thread that records, with its spans, so memory is bounded by the
+ * threads recording at the same time.
+ */
+class Tracer {
+private:
+  struct Span {
+    uint64_t start;
+    uint64_t end;
+    uint64_t trace;
+    uint32_t tid;
+    uint16_t arg;
+    SpanKind kind;
+  };
+
+  // the spans of a thread, as a ring
+  struct Buffer {
+    std::mutex mutex;
+    std::vector<Span> spans;
+    size_t next = 0;
+    std::atomic<bool> attached{false};
+  };
+
+  // trace one connection every that many; 0 when off
+  std::atomic<size_t> every;
+  std::atomic<uint64_t> next_trace;
+
+  std::mutex mutex;
+  std::vector<std::shared_ptr<Buffer>> buffers;
+
+private:
+  Tracer();
+  ~Tracer() = default;
+
+  NOT_COPYABLE(Tracer);
+  NOT_MOVEABLE(Tracer);
+
+  // gives the buffer of an exiting thread to the next one
+  static void detach(std::shared_ptr<Buffer> &buffer);
+  // the buffer the current thread records into
+  static thread_local ThreadSlot<std::shared_ptr<Buffer>, detach> local_buffer;
+
+  Buffer &local();
+
+public:
+  static Tracer &instance();
+
+  // trace one connection in every (1 traces all of them)
+  void enable(size_t every = 1);
+  void disable();
+
+  // a trace id if the connection now accepted is sampled, 0 otherwise
+  uint64_t sample();
+
+  // monotonic time in ns
+  static uint64_t now();
+
+  void record(uint64_t trace, SpanKind kind, uint16_t arg, uint64_t start,
+              uint64_t end);
+
+  // the spans recorded so far as Chrome Trace Event JSON
+  std::string dump();
+  void clear();
+};
+
+// Records a span from its construction to its destruction if trace is not 0.
+// Defined here so that an untraced scope compiles down to a test.
+class TraceScope {
+private:
+  uint64_t trace;
+  SpanKind kind;
+  uint16_t arg;
+  uint64_t start;
+
+public:
+  TraceScope(uint64_t trace, SpanKind kind, uint16_t arg = 0)
+      : trace(trace), kind(kind), arg(arg), start(trace ? Tracer::now() : 0) {}
+  ~TraceScope() {
+    if (trace) {
+      Tracer::instance().record(trace, kind, arg, start, Tracer::now());
+    }
+  }
+
+  NOT_COPYABLE(TraceScope);
+  NOT_MOVEABLE(TraceScope);
+};
@@ -0,0 +1,184 @@
+#pragma once
+
+#include "common.h"
+#include "lifetime.h"
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#if defined(__APPLE__) || defined(__linux__)
+#include <pthread.h>
+#include <signal.h>
+#endif
+
+// threads watched at the same time; others run unwatched
+constexpr size_t WATCH_SLOTS = 1024;
+// frames of a captured stack
+constexpr size_t WATCH_FRAMES = 48;
+// longest route kept, longer ones are truncated
+constexpr size_t WATCH_ROUTE = 120;
+
+// A middleware that has been running for longer than the threshold.
+struct Stall {
+  // request path, empty if the request line was not parsed yet
+  std::string route;
+  // position of the middleware in the chain (0 is HeadParser)
+  uint16_t stage;
+  // time spent in the middleware so far, in ms
+  uint64_t elapsed;
+  // stack of the thread when it was found, innermost frame first; empty
+  // where stacks cannot be captured (Windows)
+  std::vector<std::string> stack;
+};
+
+struct WatchdogOptions {
+  // a middleware running for that long (ms) is reported, once
+  uint64_t threshold = 5000;
+  // time between two scans in ms, also the precision of the timings
+  uint64_t interval = 100;
+#if defined(__APPLE__) || defined(__linux__)
+  // sent to a stalled thread to capture its stack; its handler is replaced
+  int signal = SIGUSR2;
+#endif
+  // called on the watchdog thread; the default prints to stderr
+  std::function<void(const Stall &)> report;
+};
+
+/*
+ * Reports the middleware that run for too long (a lock never released, a
+ * slow disk) while the server keeps running.
+ *
+ * Every thread running the middleware chain gets a slot of its own, where
+ * Task::next stores the middleware it enters and when (see WatchScope). The
+ * clock is a tick the watchdog thread advances every interval, so this is a
+ * few stores to a cache line no other thread writes, with no lock and no
+ * system call. The watchdog thread scans the slots; when it finds a stall, it
+ * signals the thread, whose handler copies its stack and route into the slot.
+ */
+class Watchdog {
+private:
+  enum SlotState : uint8_t { slot_free, slot_busy, slot_signaled };
+
+  struct alignas(64) Slot {
+    std::atomic<uint8_t> state{slot_free};
+    // tick when the current middleware was entered, 0 outside the chain
+    std::atomic<uint64_t> since{0};
+    std::atomic<uint16_t> stage{0};
+    // written by the owner thread only
+    char route[WATCH_ROUTE];
+    size_t route_len = 0;
+    bool routed = false;
+#if defined(__APPLE__) || defined(__linux__)
+    pthread_t thread;
+#endif
+
+    // written by the signal handler, read once captured is set
+    std::atomic<bool> captured{false};
+    void *frames[WATCH_FRAMES];
+    int depth = 0;
+    char stall_route[WATCH_ROUTE];
+    size_t stall_route_len = 0;
+
+    // the since already reported (watchdog thread only)
+    uint64_t reported = 0;
+  };
+
+  std::unique_ptr<Slot[]> slots;
+  // rotates the starting point of local()
+  std::atomic<size_t> next_slot;
+  // steady clock in ms, minus one so that tick is never 0
+  uint64_t epoch;
+  // ms since epoch, advanced by the watchdog thread
+  std::atomic<uint64_t> tick;
+  std::atomic<bool> running;
+
+  WatchdogOptions options;
+  std::mutex mutex;
+  std::condition_variable cv;
+  bool stopping;
+  std::thread thread;
+
+  friend class WatchScope;
+  friend class WatchPause;
+
+private:
+  Watchdog();
+  ~Watchdog() = default;
+
+  NOT_COPYABLE(Watchdog);
+  NOT_MOVEABLE(Watchdog);
+
+  // frees the slot of an exiting thread for the next one
+  static void detach(Slot *&slot);
+  // the slot of the current thread
+  static thread_local ThreadSlot<Slot *, detach> local_slot;
+
+  // the slot of the current thread, nullptr if not running or if every
+  // slot is taken
+  Slot *local();
+  void run();
+  void check(Slot &slot, uint64_t now);
+  static void capture(int sig);
+
+public:
+  static Watchdog &instance();
+
+  // start the watchdog thread; throws std::system_error if the signal
+  // handler cannot be installed. Restarts it with options if running.
+  void start(const WatchdogOptions &options = WatchdogOptions());
+  void stop();
+};
+
+// Marks the current thread as running the middleware stage of a request
+// until destruction. Nested scopes restore the enclosing stage, with its
+// start time. Defined here so that it compiles down to a test while the
+// watchdog is stopped.
+class WatchScope {
+private:
+  Watchdog::Slot *slot;
+  uint64_t since;
+  uint16_t stage;
+
+public:
+  WatchScope(const std::string &route, uint16_t stage)
+      : slot(nullptr), since(0), stage(0) {
+    Watchdog &watchdog = Watchdog::instance();
+    if (watchdog.running.load(std::memory_order_relaxed)) {
+      enter(watchdog, route, stage);
+    }
+  }
+  ~WatchScope() {
+    if (slot) {
+      slot->stage.store(stage, std::memory_order_relaxed);
+      slot->since.store(since, std::memory_order_release);
+    }
+  }
+
+  NOT_COPYABLE(WatchScope);
+  NOT_MOVEABLE(WatchScope);
+
+private:
+  void enter(Watchdog &watchdog, const std::string &route, uint16_t stage);
+};
+
+// Stops watching the current thread until destruction, around a middleware
+// that runs for the whole connection by design (e.g. an HTTP/2 session).
+class WatchPause {
+private:
+  Watchdog::Slot *slot;
+  uint64_t since;
+
+public:
+  WatchPause();
+  ~WatchPause();
+
+  NOT_COPYABLE(WatchPause);
+  NOT_MOVEABLE(WatchPause);
+};
@@ -0,0 +1,67 @@
+#pragma once
+
+#include "common.h"
+#include "csr/result.hpp"
+#include "http/context.h"
+#include "servererrors.h"
+#include "socket/socket.h"
+#include "websocket/frame.h"
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+class WsLoop;
+
+// A WebSocket connection multiplexed on a WsLoop.
+// Messages can be sent from any thread; the output that the socket does not
+// take at once is buffered and written by the loop.
+class WsConnection : public std::enable_shared_from_this<WsConnection> {
+private:
+  SocketClient sc;
+  WsLoop *loop;
+  // the upgrade request
+  Request req;
+
+  // only used by the loop thread
+  std::vector<char> in;
+  std::string message;
+  // opcode of the fragmented message being received, or continuation
+  WsOpcode message_opcode;
+  // close once the output is flushed
+  bool done;
+  WsClose done_code;
+
+  // guards the members below
+  std::mutex mutex;
+  std::string out;
+  bool close_sent;
+  bool closed;
+
+private:
+  csr::Result<std::monostate, server_error_t>
+  send_frame(WsOpcode opcode, const char *payload, size_t len);
+  // write as much of out as the socket takes; mutex must be held
+  csr::Result<std::monostate, server_error_t> flush();
+
+public:
+  WsConnection(SocketClient &&sc, Request &&req, WsLoop *loop);
+  ~WsConnection() = default;
+
+  NOT_COPYABLE(WsConnection);
+  NOT_MOVEABLE(WsConnection);
+
+  const Request &request() const;
+
+  csr::Result<std::monostate, server_error_t> send(const std::string &text);
+  csr::Result<std::monostate, server_error_t> send_binary(const char *data,
+                                                          size_t len);
+  csr::Result<std::monostate, server_error_t>
+  ping(const std::string &payload = "");
+  // start the closing handshake; the connection is closed once the client
+  // answers
+  csr::Result<std::monostate, server_error_t>
+  close(WsClose code = WsClose::normal, const std::string &reason = "");
+
+  friend class WsLoop;
+};
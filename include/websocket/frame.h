@@ -0,0 +1,51 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// largest message accepted from a client by default
+constexpr size_t WS_MAX_MESSAGE = 16 * 1024 * 1024;
+// largest payload of a control frame (RFC 6455 5.5)
+constexpr size_t WS_MAX_CONTROL = 125;
+
+constexpr uint8_t WS_FIN = 0x80;
+constexpr uint8_t WS_RSV = 0x70;
+constexpr uint8_t WS_MASKED = 0x80;
+
+enum class WsOpcode : uint8_t {
+  continuation = 0x0,
+  text = 0x1,
+  binary = 0x2,
+  close = 0x8,
+  ping = 0x9,
+  pong = 0xa,
+};
+
+// status codes of close frames (RFC 6455 7.4.1)
+enum class WsClose : uint16_t {
+  normal = 1000,
+  going_away = 1001,
+  protocol_error = 1002,
+  unsupported_data = 1003,
+  no_status = 1005,
+  abnormal = 1006,
+  invalid_data = 1007,
+  policy_violation = 1008,
+  too_big = 1009,
+  internal_error = 1011,
+};
+
+// XOR data with the 4-byte masking key, 16 or 32 bytes at a time where
+// SIMD is available (masking and unmasking are the same operation)
+void ws_mask(char *data, size_t len, const char key[4]);
+
+// whether data is well-formed UTF-8 (text messages, close reasons)
+bool ws_valid_utf8(const char *data, size_t len);
+
+// append the header of an unmasked frame (server to client) to out
+void ws_frame_header(std::string &out, WsOpcode opcode, size_t len,
+                     bool fin = true);
+
+// Sec-WebSocket-Accept for the Sec-WebSocket-Key of a client
+std::string ws_accept_key(const std::string &key);
@@ -0,0 +1,78 @@
+#pragma once
+
+#include "common.h"
+#include "http/context.h"
+#include "socket/poller.h"
+#include "socket/socket.h"
+#include "websocket/connection.h"
+#include "websocket/frame.h"
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+// Callbacks of the WebSocket connections, run by the loop thread.
+// They must not block: every connection of the loop waits for them.
+struct WsHandlers {
+  std::function<void(const std::shared_ptr<WsConnection> &)> open;
+  std::function<void(const std::shared_ptr<WsConnection> &,
+                     const std::string &message, bool binary)>
+      message;
+  std::function<void(const std::shared_ptr<WsConnection> &, WsClose code)>
+      close;
+};
+
+// Serves WebSocket connections from a single thread waiting on a Poller, so
+// an idle connection costs its buffers instead of a thread.
+class WsLoop {
+private:
+  std::unique_ptr<Poller> poller;
+  WsHandlers handlers;
+  size_t max_message;
+  std::atomic<bool> stopping;
+
+  // only used by the loop thread
+  std::unordered_map<m_sock_t, std::shared_ptr<WsConnection>> connections;
+  // read buffer shared by every connection
+  std::vector<char> buffer;
+
+  // guards the queues below
+  std::mutex mutex;
+  std::vector<std::shared_ptr<WsConnection>> added;
+  // connections with output left to write
+  std::vector<std::shared_ptr<WsConnection>> pending;
+
+  std::thread thread;
+
+private:
+  static void close_connection(WsConnection &conn);
+
+  void run();
+  void want_write(std::shared_ptr<WsConnection> conn);
+
+  void on_readable(const std::shared_ptr<WsConnection> &conn);
+  void on_writable(const std::shared_ptr<WsConnection> &conn);
+  // handle the complete frames of data, returns the bytes consumed
+  size_t process(const std::shared_ptr<WsConnection> &conn, char *data,
+                 size_t len);
+  void fail(const std::shared_ptr<WsConnection> &conn, WsClose code);
+  // finish the connection once it is done and its output is written
+  void settle(const std::shared_ptr<WsConnection> &conn);
+  void finish(const std::shared_ptr<WsConnection> &conn, WsClose code);
+
+public:
+  // throws std::system_error if no Poller can be created
+  WsLoop(WsHandlers &&handlers, size_t max_message = WS_MAX_MESSAGE);
+  ~WsLoop();
+
+  NOT_COPYABLE(WsLoop);
+  NOT_MOVEABLE(WsLoop);
+
+  // take over an upgraded connection and the input read ahead
+  void add(SocketClient &&sc, Request &&req, std::vector<char> &&input);
+
+  friend class WsConnection;
+};
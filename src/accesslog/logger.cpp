@@ -0,0 +1,251 @@
+#include "accesslog/logger.h"
+#include "lifetime.h"
+#include "socket/socket_common.h"
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <ctime>
+#include <system_error>
+#include <utility>
+
+#if defined(__APPLE__) || defined(__linux__)
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <unistd.h>
+#elif defined(_WIN32)
+#include <fcntl.h>
+#include <io.h>
+#include <share.h>
+#include <sys/stat.h>
+#endif
+
+// formatted bytes written at once
+constexpr size_t ACCESS_LOG_BATCH = 65536;
+// how long the writer sleeps when every ring is empty
+constexpr std::chrono::milliseconds ACCESS_LOG_IDLE{10};
+// descriptor of the standard output
+constexpr int ACCESS_LOG_STDOUT = 1;
+
+static const char *const months[] = {"Jan", "Feb", "Mar", "Apr",
+                                     "May", "Jun", "Jul", "Aug",
+                                     "Sep", "Oct", "Nov", "Dec"};
+
+static std::atomic<uint64_t> next_id{1};
+
+// the rings the current thread produces into, one per logger id
+typedef std::vector<std::pair<uint64_t, std::shared_ptr<AccessRing>>>
+    LocalRings;
+
+static void detach(LocalRings &rings) {
+  for (auto &entry : rings) {
+    entry.second->attached.store(false, std::memory_order_release);
+  }
+}
+
+static thread_local ThreadSlot<LocalRings, detach> local_rings;
+
+static int open_log(const std::string &path) {
+  if (path.empty()) {
+    return ACCESS_LOG_STDOUT;
+  }
+#if defined(__APPLE__) || defined(__linux__)
+  int fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC,
+                  0644);
+#elif defined(_WIN32)
+  int fd = -1;
+  (void)_sopen_s(&fd, path.c_str(),
+                 _O_WRONLY | _O_CREAT | _O_APPEND | _O_BINARY | _O_NOINHERIT,
+                 _SH_DENYNO, _S_IREAD | _S_IWRITE);
+#endif
+  if (fd == -1) {
+    throw std::system_error(errno, std::system_category(),
+                            "access log " + path);
+  }
+  return fd;
+}
+
+AccessLogger::AccessLogger(const AccessLogOptions &options)
+    : options(options), id(next_id.fetch_add(1)), fd(open_log(options.path)),
+      mutex(), cv(), stopping(false), rings(), drops(0), thread(),
+      stamp_second(-1), stamp() {
+  thread = std::thread{&AccessLogger::run, this};
+}
+
+AccessLogger::~AccessLogger() {
+  {
+    std::lock_guard<std::mutex> lock{mutex};
+    stopping = true;
+  }
+  cv.notify_all();
+  thread.join();
+
+  if (fd != ACCESS_LOG_STDOUT) {
+#if defined(__APPLE__) || defined(__linux__)
+    (void)::close(fd);
+#elif defined(_WIN32)
+    (void)_close(fd);
+#endif
+  }
+}
+
+std::shared_ptr<AccessRing> AccessLogger::attach() {
+  std::lock_guard<std::mutex> lock{mutex};
+  // a ring left by a thread that exited, once the writer has emptied it
+  for (auto &ring : rings) {
+    if (!ring->attached.load(std::memory_order_acquire) && ring->empty()) {
+      ring->attached.store(true, std::memory_order_relaxed);
+      ring->adopt();
+      return ring;
+    }
+  }
+  auto ring = std::make_shared<AccessRing>(options.ring_size);
+  ring->attached.store(true, std::memory_order_relaxed);
+  rings.push_back(ring);
+  return ring;
+}
+
+AccessRing &AccessLogger::local() {
+  for (auto &entry : local_rings.value) {
+    if (entry.first == id) {
+      return *entry.second;
+    }
+  }
+  local_rings.value.emplace_back(id, attach());
+  return *local_rings.value.back().second;
+}
+
+AccessEntry *AccessLogger::reserve() {
+  AccessRing &ring = local();
+  AccessEntry *entry = ring.reserve();
+  while (!entry && options.block) {
+    cv.notify_one();
+    std::this_thread::yield();
+    entry = ring.reserve();
+  }
+  if (!entry) {
+    drops.fetch_add(1, std::memory_order_relaxed);
+  }
+  return entry;
+}
+
+void AccessLogger::commit() { local().commit(); }
+
+uint64_t AccessLogger::dropped() const {
+  return drops.load(std::memory_order_relaxed);
+}
+
+void AccessLogger::run() {
+  std::string out;
+  out.reserve(ACCESS_LOG_BATCH + 1024);
+  std::vector<std::shared_ptr<AccessRing>> snapshot;
+
+  for (;;) {
+    bool stop;
+    {
+      std::lock_guard<std::mutex> lock{mutex};
+      stop = stopping;
+      // rings are only ever added
+      if (snapshot.size() != rings.size()) {
+        snapshot = rings;
+      }
+    }
+
+    size_t count = 0;
+    for (auto &ring : snapshot) {
+      while (const AccessEntry *entry = ring->front()) {
+        format(*entry, out);
+        ring->pop();
+        ++count;
+        if (out.size() >= ACCESS_LOG_BATCH) {
+          flush(out);
+        }
+      }
+    }
+    flush(out);
+
+    // keep going while there is work: the rings may have refilled
+    if (count) {
+      continue;
+    }
+    if (stop) {
+      break;
+    }
+    std::unique_lock<std::mutex> lock{mutex};
+    cv.wait_for(lock, ACCESS_LOG_IDLE, [this] { return stopping; });
+  }
+}
+
+void AccessLogger::format(const AccessEntry &entry, std::string &out) {
+  char buf[INET6_ADDRSTRLEN + 64];
+
+  if (entry.family == AF_INET || entry.family == AF_INET6) {
+    if (inet_ntop(entry.family, entry.addr, buf, sizeof(buf))) {
+      out += buf;
+    } else {
+      out += '-';
+    }
+  } else {
+    out += '-';
+  }
+
+  int64_t second = entry.time / 1000000;
+  if (second != stamp_second) {
+    time_t t = (time_t)second;
+    struct tm tm;
+#if defined(__APPLE__) || defined(__linux__)
+    gmtime_r(&t, &tm);
+#elif defined(_WIN32)
+    gmtime_s(&tm, &t);
+#endif
+    int n = snprintf(buf, sizeof(buf), "[%02d/%s/%04d:%02d:%02d:%02d +0000]",
+                     tm.tm_mday, months[tm.tm_mon], tm.tm_year + 1900,
+                     tm.tm_hour, tm.tm_min, tm.tm_sec);
+    stamp.assign(buf, (size_t)n);
+    stamp_second = second;
+  }
+  out += " - - ";
+  out += stamp;
+
+  out += " \"";
+  out.append(entry.method, entry.method_size);
+  out += ' ';
+  // the target is as sent by the client: keep the line parseable
+  for (size_t i = 0; i < entry.target_size; ++i) {
+    unsigned char c = (unsigned char)entry.target[i];
+    if (c < 0x20 || c == 0x7f || c == '"' || c == '\\') {
+      int n = snprintf(buf, sizeof(buf), "\\x%02x", c);
+      out.append(buf, (size_t)n);
+    } else {
+      out += (char)c;
+    }
+  }
+  out += ' ';
+  out.append(entry.version, entry.version_size);
+
+  int n = snprintf(buf, sizeof(buf), "\" %u %llu %u.%06u\n",
+                   (unsigned)entry.status, (unsigned long long)entry.bytes,
+                   entry.latency / 1000000, entry.latency % 1000000);
+  out.append(buf, (size_t)n);
+}
+
+void AccessLogger::flush(std::string &out) {
+  const char *data = out.data();
+  size_t size = out.size();
+  while (size) {
+#if defined(__APPLE__) || defined(__linux__)
+    ssize_t rc = ::write(fd, data, size);
+    if (rc == -1 && errno == EINTR) {
+      continue;
+    }
+#elif defined(_WIN32)
+    int rc = _write(fd, data, (unsigned)size);
+#endif
+    // nothing else can be done with a log that cannot be written
+    if (rc <= 0) {
+      break;
+    }
+    data += rc;
+    size -= (size_t)rc;
+  }
+  out.clear();
+}
@@ -0,0 +1,51 @@
+#include "accesslog/ring.h"
+
+AccessRing::AccessRing(size_t capacity)
+    : entries(), mask(0), tail(0), head_cache(0), head(0), tail_cache(0),
+      attached(false) {
+  size_t size = 1;
+  while (size < capacity) {
+    size <<= 1;
+  }
+  entries.reset(new AccessEntry[size]);
+  mask = size - 1;
+}
+
+AccessEntry *AccessRing::reserve() {
+  size_t t = tail.load(std::memory_order_relaxed);
+  if (t - head_cache > mask) {
+    head_cache = head.load(std::memory_order_acquire);
+    if (t - head_cache > mask) {
+      return nullptr;
+    }
+  }
+  return &entries[t & mask];
+}
+
+void AccessRing::commit() {
+  tail.store(tail.load(std::memory_order_relaxed) + 1,
+             std::memory_order_release);
+}
+
+void AccessRing::adopt() { head_cache = head.load(std::memory_order_acquire); }
+
+const AccessEntry *AccessRing::front() {
+  size_t h = head.load(std::memory_order_relaxed);
+  if (h == tail_cache) {
+    tail_cache = tail.load(std::memory_order_acquire);
+    if (h == tail_cache) {
+      return nullptr;
+    }
+  }
+  return &entries[h & mask];
+}
+
+void AccessRing::pop() {
+  head.store(head.load(std::memory_order_relaxed) + 1,
+             std::memory_order_release);
+}
+
+bool AccessRing::empty() const {
+  return head.load(std::memory_order_acquire) ==
+         tail.load(std::memory_order_acquire);
+}
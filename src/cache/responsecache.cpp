@@ -0,0 +1,102 @@
+#include "cache/responsecache.h"
+#include <functional>
+#include <iterator>
+
+ResponseCache::ResponseCache(size_t shards, size_t capacity)
+    : shards(shards ? shards : 1),
+      shard_capacity(capacity / (shards ? shards : 1)), hits(0), misses(0),
+      coalesced(0), stores(0), evictions(0) {}
+
+ResponseCache::Shard &ResponseCache::shard(const std::string &key) {
+  return shards[std::hash<std::string>{}(key) % shards.size()];
+}
+
+size_t ResponseCache::cost(const Entry &entry) {
+  return entry.key.size() + entry.response->data().size();
+}
+
+void ResponseCache::erase(Shard &shard, std::list<Entry>::iterator it) {
+  shard.bytes -= cost(*it);
+  shard.index.erase(it->key);
+  shard.entries.erase(it);
+}
+
+std::shared_ptr<const PreparedResponse>
+ResponseCache::acquire(const std::string &key, bool &leader,
+                       std::chrono::milliseconds wait) {
+  Shard &s = shard(key);
+  auto now = std::chrono::steady_clock::now();
+  leader = false;
+
+  std::unique_lock<std::mutex> lock{s.mutex};
+  auto it = s.index.find(key);
+  if (it != s.index.end()) {
+    if (it->second->expires > now) {
+      s.entries.splice(s.entries.begin(), s.entries, it->second);
+      hits.fetch_add(1, std::memory_order_relaxed);
+      return it->second->response;
+    }
+    erase(s, it->second);
+  }
+  misses.fetch_add(1, std::memory_order_relaxed);
+
+  auto flight_it = s.flights.find(key);
+  if (flight_it == s.flights.end()) {
+    s.flights.emplace(key, std::make_shared<Flight>());
+    leader = true;
+    return nullptr;
+  }
+
+  coalesced.fetch_add(1, std::memory_order_relaxed);
+  std::shared_ptr<Flight> flight = flight_it->second;
+  s.cv.wait_for(lock, wait, [&flight] { return flight->done; });
+  return flight->response;
+}
+
+void ResponseCache::complete(const std::string &key,
+                             std::shared_ptr<const PreparedResponse> response,
+                             std::chrono::milliseconds ttl) {
+  Shard &s = shard(key);
+
+  std::lock_guard<std::mutex> lock{s.mutex};
+  auto flight_it = s.flights.find(key);
+  if (flight_it != s.flights.end()) {
+    flight_it->second->done = true;
+    flight_it->second->response = response;
+    s.flights.erase(flight_it);
+    s.cv.notify_all();
+  }
+
+  if (!response || ttl.count() <= 0) {
+    return;
+  }
+
+  auto it = s.index.find(key);
+  if (it != s.index.end()) {
+    erase(s, it->second);
+  }
+  Entry entry{key, std::move(response), std::chrono::steady_clock::now() + ttl};
+  size_t bytes = cost(entry);
+  if (bytes > shard_capacity) {
+    return;
+  }
+  while (s.bytes + bytes > shard_capacity) {
+    erase(s, std::prev(s.entries.end()));
+    evictions.fetch_add(1, std::memory_order_relaxed);
+  }
+  s.entries.push_front(std::move(entry));
+  s.index.emplace(key, s.entries.begin());
+  s.bytes += bytes;
+  stores.fetch_add(1, std::memory_order_relaxed);
+}
+
+CacheStats ResponseCache::stats() {
+  CacheStats stats{hits.load(),   misses.load(), coalesced.load(),
+                   stores.load(), evictions.load(), 0, 0};
+  for (auto &s : shards) {
+    std::lock_guard<std::mutex> lock{s.mutex};
+    stats.entries += s.entries.size();
+    stats.bytes += s.bytes;
+  }
+  return stats;
+}
@@ -0,0 +1,48 @@
+#include "compress/cache.h"
+
+CompressCache::CompressCache(size_t capacity)
+    : capacity(capacity), size(0), mutex(), entries(), index() {}
+
+size_t CompressCache::cost(const Entry &entry) {
+  size_t bytes = entry.first.size() + entry.second->data.size();
+  if (entry.second->prepared) {
+    bytes += entry.second->prepared->data().size();
+  }
+  return bytes;
+}
+
+std::shared_ptr<const CompressedBody>
+CompressCache::get(const std::string &key) {
+  std::lock_guard<std::mutex> lock{mutex};
+  auto it = index.find(key);
+  if (it == index.end()) {
+    return nullptr;
+  }
+  entries.splice(entries.begin(), entries, it->second);
+  return it->second->second;
+}
+
+void CompressCache::put(const std::string &key,
+                        std::shared_ptr<const CompressedBody> body) {
+  std::lock_guard<std::mutex> lock{mutex};
+  auto it = index.find(key);
+  if (it != index.end()) {
+    size -= cost(*it->second);
+    entries.erase(it->second);
+    index.erase(it);
+  }
+
+  Entry entry{key, std::move(body)};
+  size_t bytes = cost(entry);
+  if (bytes > capacity) {
+    return;
+  }
+  while (size + bytes > capacity) {
+    size -= cost(entries.back());
+    index.erase(entries.back().first);
+    entries.pop_back();
+  }
+  entries.push_front(std::move(entry));
+  index.emplace(key, entries.begin());
+  size += bytes;
+}
@@ -0,0 +1,94 @@
+#include "compress/deflate.h"
+
+const char *coding_name(Coding coding) {
+  return coding == Coding::gzip ? "gzip" : "deflate";
+}
+
+#if defined(USE_ZLIB)
+#include <climits>
+#include <zlib.h>
+
+// output produced per call of deflate()
+constexpr size_t DEFLATE_CHUNK = 16384;
+
+Deflater::Deflater(struct z_stream_s *stream) : stream(stream) {}
+
+Deflater::~Deflater() {
+  deflateEnd(stream);
+  delete stream;
+}
+
+csr::Result<std::unique_ptr<Deflater>, server_error_t>
+Deflater::create(Coding coding, int level) {
+  auto stream = std::make_unique<z_stream>();
+  // 16 asks zlib for a gzip header and trailer instead of the zlib ones
+  int bits = coding == Coding::gzip ? MAX_WBITS + 16 : MAX_WBITS;
+  if (deflateInit2(stream.get(), level, Z_DEFLATED, bits, 8,
+                   Z_DEFAULT_STRATEGY) != Z_OK) {
+    return csr::Result<std::unique_ptr<Deflater>, server_error_t>::Err(
+        server_error(ServerErr::compression_error));
+  }
+  return csr::Result<std::unique_ptr<Deflater>, server_error_t>::Ok(
+      std::unique_ptr<Deflater>(new Deflater(stream.release())));
+}
+
+csr::Result<std::monostate, server_error_t>
+Deflater::feed(const char *data, size_t size, bool finish,
+               std::vector<char> &out) {
+  while (true) {
+    // avail_in is 32 bits wide
+    uInt step = size > UINT_MAX ? UINT_MAX : (uInt)size;
+    stream->next_in = (Bytef *)data;
+    stream->avail_in = step;
+    bool last = step == size;
+    int flush = finish && last ? Z_FINISH : Z_NO_FLUSH;
+
+    int rc;
+    do {
+      size_t used = out.size();
+      out.resize(used + DEFLATE_CHUNK);
+      stream->next_out = (Bytef *)(out.data() + used);
+      stream->avail_out = (uInt)DEFLATE_CHUNK;
+      rc = deflate(stream, flush);
+      out.resize(used + DEFLATE_CHUNK - stream->avail_out);
+      if (rc == Z_STREAM_ERROR) {
+        return csr::Result<std::monostate, server_error_t>::Err(
+            server_error(ServerErr::compression_error));
+      }
+    } while (stream->avail_out == 0);
+
+    data += step;
+    size -= step;
+    if (last) {
+      break;
+    }
+  }
+  return csr::Result<std::monostate, server_error_t>();
+}
+
+#else
+
+Deflater::Deflater(struct z_stream_s *stream) : stream(stream) {}
+
+Deflater::~Deflater() {}
+
+csr::Result<std::unique_ptr<Deflater>, server_error_t>
+Deflater::create(Coding coding, int level) {
+  (void)coding;
+  (void)level;
+  return csr::Result<std::unique_ptr<Deflater>, server_error_t>::Err(
+      server_error(ServerErr::unsupported_option));
+}
+
+csr::Result<std::monostate, server_error_t>
+Deflater::feed(const char *data, size_t size, bool finish,
+               std::vector<char> &out) {
+  (void)data;
+  (void)size;
+  (void)finish;
+  (void)out;
+  return csr::Result<std::monostate, server_error_t>::Err(
+      server_error(ServerErr::unsupported_option));
+}
+
+#endif
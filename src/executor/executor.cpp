@@ -0,0 +1,150 @@
+#include "executor/executor.h"
+
+// the executor whose worker the current thread is, if it is one
+struct LocalWorker {
+  const Executor *owner = nullptr;
+};
+
+static thread_local LocalWorker local_worker;
+// the worker the current thread hands its work to
+static thread_local size_t home = SIZE_MAX;
+
+Executor::Executor(size_t threads)
+    : workers(), threads(), next(0), queued(0), executed(0), stolen(0),
+      park_mutex(), park_cv(), sleeping(0), stopping(false) {
+  if (!threads) {
+    threads = std::thread::hardware_concurrency();
+  }
+  if (!threads) {
+    threads = 1;
+  }
+
+  for (size_t i = 0; i < threads; ++i) {
+    workers.push_back(std::make_unique<Worker>());
+  }
+  for (size_t i = 0; i < threads; ++i) {
+    this->threads.emplace_back(&Executor::work, this, i);
+  }
+}
+
+Executor::~Executor() {
+  {
+    std::lock_guard<std::mutex> lock{park_mutex};
+    stopping = true;
+  }
+  park_cv.notify_all();
+  for (auto &thread : threads) {
+    thread.join();
+  }
+}
+
+void Executor::run(Priority priority, const std::function<void()> &f) {
+  if (local_worker.owner == this) {
+    // waiting for another worker from here could take every worker
+    f();
+    return;
+  }
+
+  Job job;
+  job.f = &f;
+
+  if (home == SIZE_MAX) {
+    home = next.fetch_add(1, std::memory_order_relaxed);
+  }
+  Worker &worker = *workers[home % workers.size()];
+  // counted first, so that a worker taking it never makes it go below 0
+  queued.fetch_add(1);
+  {
+    std::lock_guard<std::mutex> lock{worker.mutex};
+    worker.queues[(size_t)priority].push_back(&job);
+  }
+
+  {
+    // sleeping is checked under the lock the workers sleep with, so a
+    // worker about to sleep sees the job
+    std::lock_guard<std::mutex> lock{park_mutex};
+    if (sleeping) {
+      park_cv.notify_one();
+    }
+  }
+
+  std::unique_lock<std::mutex> lock{job.mutex};
+  job.cv.wait(lock, [&job] { return job.done; });
+  if (job.error) {
+    std::rethrow_exception(job.error);
+  }
+}
+
+Executor::Job *Executor::take(size_t i) {
+  size_t n = workers.size();
+  for (size_t p = 0; p < PRIORITIES; ++p) {
+    for (size_t k = 0; k < n; ++k) {
+      Worker &worker = *workers[(i + k) % n];
+      std::lock_guard<std::mutex> lock{worker.mutex};
+      auto &queue = worker.queues[p];
+      if (!queue.empty()) {
+        Job *job = queue.front();
+        queue.pop_front();
+        if (k) {
+          stolen.fetch_add(1, std::memory_order_relaxed);
+        }
+        return job;
+      }
+    }
+  }
+  return nullptr;
+}
+
+void Executor::execute(Job &job) {
+  std::exception_ptr error;
+  try {
+    (*job.f)();
+  } catch (...) {
+    error = std::current_exception();
+  }
+  executed.fetch_add(1, std::memory_order_relaxed);
+
+  std::lock_guard<std::mutex> lock{job.mutex};
+  job.error = error;
+  job.done = true;
+  // still under the lock: job is on the stack of run(), which may return as
+  // soon as it is released
+  job.cv.notify_one();
+}
+
+void Executor::work(size_t i) {
+  local_worker.owner = this;
+
+  int spins = 0;
+  while (true) {
+    if (queued.load() > 0) {
+      Job *job = take(i);
+      if (job) {
+        queued.fetch_sub(1);
+        execute(*job);
+        spins = 0;
+        continue;
+      }
+    }
+
+    if (++spins < EXECUTOR_SPINS) {
+      std::this_thread::yield();
+      continue;
+    }
+    spins = 0;
+
+    std::unique_lock<std::mutex> lock{park_mutex};
+    if (stopping && !queued.load()) {
+      return;
+    }
+    ++sleeping;
+    park_cv.wait(lock, [this] { return stopping || queued.load() > 0; });
+    --sleeping;
+  }
+}
+
+ExecutorStats Executor::stats() const {
+  return ExecutorStats{executed.load(std::memory_order_relaxed),
+                       stolen.load(std::memory_order_relaxed),
+                       queued.load(std::memory_order_relaxed)};
+}
@@ -0,0 +1,51 @@
+#include "http/clientpool.h"
+#include "http/httpserver.h"
+
+ClientPool::ClientPool(const HeaderPrefix &prefix, size_t max_idle)
+    : prefix(prefix), max_idle(max_idle), stats() {
+  idle.reserve(max_idle);
+}
+
+ClientPool::~ClientPool() = default;
+
+std::unique_ptr<HttpClient> ClientPool::acquire(SocketClient &&sc,
+                                                size_t bufsize) {
+  std::unique_ptr<HttpClient> client;
+  {
+    std::lock_guard<std::mutex> lock{mutex};
+    if (++stats.in_use > stats.high_water) {
+      stats.high_water = stats.in_use;
+    }
+    if (!idle.empty()) {
+      client = std::move(idle.back());
+      idle.pop_back();
+      --stats.idle;
+      ++stats.reused;
+    } else {
+      ++stats.created;
+    }
+  }
+
+  if (!client) {
+    // allocate outside of the lock
+    return std::make_unique<HttpClient>(std::move(sc), prefix, bufsize);
+  }
+  client->open(std::move(sc), bufsize);
+  return client;
+}
+
+void ClientPool::release(std::unique_ptr<HttpClient> &&client) {
+  client->close();
+
+  std::lock_guard<std::mutex> lock{mutex};
+  --stats.in_use;
+  if (idle.size() < max_idle) {
+    idle.push_back(std::move(client));
+    ++stats.idle;
+  }
+}
+
+PoolStats ClientPool::metrics() {
+  std::lock_guard<std::mutex> lock{mutex};
+  return stats;
+}
@@ -1,44 +1,158 @@
 #include "http/context.h"
 #include "csr/result.hpp"
+#include "http/preparedresponse.h"
 #include "servererrors.h"
 #include "socket/io.h"
+#include "trace/tracer.h"
 
-void Request::setContent(const std::string &s) {
-  content = {s.begin(), s.end()};
+// empty c, and free its memory only if it grew past KEEP_CAPACITY
+template <typename T> static void recycle(T &c) {
+  if (c.capacity() > KEEP_CAPACITY) {
+    T().swap(c);
+  } else {
+    c.clear();
+  }
+}
+
+void Request::setContent(std::string_view s) {
+  content.assign(s.begin(), s.end());
+}
+
+void Request::setContent(const char *data, size_t size) {
+  content.assign(data, data + size);
 }
 
 void Request::setContent(std::vector<char> &&v) { content = std::move(v); }
 
-void Response::setContent(const std::string &s) {
-  content = {s.begin(), s.end()};
+void Request::clear() {
+  method.clear();
+  version.clear();
+  recycle(path);
+  recycle(fullpath);
+  params.clear();
+  headers.clear();
+  recycle(content);
+}
+
+void Response::setContent(std::string_view s) {
+  content.assign(s.begin(), s.end());
+}
+
+void Response::setContent(const char *data, size_t size) {
+  content.assign(data, data + size);
 }
 
 void Response::setContent(std::vector<char> &&v) { content = std::move(v); }
 
-Context::Context(m_sock_t fd) : fd(fd) {}
+void Response::clear() {
+  status.clear();
+  headers.clear();
+  recycle(content);
+}
 
-void Context::write() {
-  if (resp.headers.empty()) {
-    return;
+Context::Context(m_sock_t fd, const HeaderPrefix &prefix, size_t bufsize,
+                 Transport *transport)
+    : fd(fd), transport(transport), bufsize(bufsize), peer(), peerlen(0),
+      trace(0), prefix(prefix), prepared(nullptr),
+      reader(fd, bufsize, transport), takeover() {}
+
+void Context::clear() {
+  trace = 0;
+  prepared.reset();
+  takeover = nullptr;
+  reader.reset(fd, bufsize, transport);
+  req.clear();
+  resp.clear();
+}
+
+void Context::reset(m_sock_t fd, size_t bufsize) {
+  this->fd = fd;
+  transport = nullptr;
+  this->bufsize = bufsize;
+  reader.reset(fd, bufsize);
+}
+
+void Context::send(std::shared_ptr<const PreparedResponse> response) {
+  prepared = std::move(response);
+}
+
+void Context::take_over(
+    std::function<void(SocketClient &&, std::vector<char> &&)> &&f) {
+  takeover = std::move(f);
+}
+
+csr::Result<std::monostate, server_error_t> Context::write() {
+  TraceScope scope(trace, SpanKind::write);
+  // the response to HEAD is the one to GET without its body
+  bool head = req.method == "HEAD";
+  if (prepared) {
+    size_t size = prepared->data().size();
+    if (head) {
+      size -= prepared->body_size();
+    }
+    Writer writer{fd, bufsize, transport};
+    auto write_result = writer.write_through(prepared->data().data(), size);
+    if (write_result.is_err()) {
+      return csr::Result<std::monostate, server_error_t>::Err(
+          std::move(write_result.unwrap_err()));
+    }
+    return csr::Result<std::monostate, server_error_t>();
   }
 
-  Writer writer{fd};
+  if (resp.headers.empty()) {
+    return csr::Result<std::monostate, server_error_t>();
+  }
 
-  // omit reason phrase here
-  writer.write("HTTP/1.0 " + resp.status + " \r\n").unwrap();
+  Writer writer{fd, bufsize, transport};
 
   if (!resp.content.empty()) {
     resp.headers["Content-Length"] = std::to_string(resp.content.size());
   }
-  for (const auto &[key, value] : resp.headers) {
-    writer.write(key + ":" + value + "\r\n").unwrap();
+
+  auto write_result = write_head(writer);
+  if (write_result.is_ok() && !head && !resp.content.empty()) {
+    write_result = writer.write(resp.content);
+  }
+  if (write_result.is_ok()) {
+    write_result = writer.flush();
   }
 
-  writer.write("\r\n", 2).unwrap();
+  if (write_result.is_err()) {
+    return csr::Result<std::monostate, server_error_t>::Err(
+        std::move(write_result.unwrap_err()));
+  }
+  return csr::Result<std::monostate, server_error_t>();
+}
 
-  if (!resp.content.empty()) {
-    writer.write(resp.content).unwrap();
+csr::Result<size_t, server_error_t> Context::write_head(Writer &writer) {
+  // omit reason phrase here
+  auto write_result = writer.write("HTTP/1.0 ", 9);
+  if (write_result.is_ok()) {
+    write_result = writer.write(resp.status);
+  }
+  if (write_result.is_ok()) {
+    write_result = writer.write(" \r\n", 3);
+  }
+  if (write_result.is_ok()) {
+    write_result = prefix.write(writer, resp.headers);
   }
 
-  writer.flush().unwrap();
-}
+  for (auto it = resp.headers.begin();
+       write_result.is_ok() && it != resp.headers.end(); ++it) {
+    write_result = writer.write(it->first);
+    if (write_result.is_ok()) {
+      write_result = writer.write(":", 1);
+    }
+    if (write_result.is_ok()) {
+      write_result = writer.write(it->second);
+    }
+    if (write_result.is_ok()) {
+      write_result = writer.write("\r\n", 2);
+    }
+  }
+
+  if (write_result.is_ok()) {
+    write_result = writer.write("\r\n", 2);
+  }
+  return write_result;
+}
\ No newline at end of file
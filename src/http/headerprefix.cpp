@@ -0,0 +1,111 @@
+#include "http/headerprefix.h"
+#include <cstdio>
+
+static const char *const days[] = {"Sun", "Mon", "Tue", "Wed",
+                                   "Thu", "Fri", "Sat"};
+static const char *const months[] = {"Jan", "Feb", "Mar", "Apr",
+                                     "May", "Jun", "Jul", "Aug",
+                                     "Sep", "Oct", "Nov", "Dec"};
+
+DateCache::DateCache() : second(time(nullptr)), line(format(second.load())) {}
+
+DateCache &DateCache::instance() {
+  static DateCache cache;
+  return cache;
+}
+
+/*
+ * Format t as IMF-fixdate (RFC 7231 7.1.1.1) without relying on the
+ * current locale.
+ */
+std::shared_ptr<const std::string> DateCache::format(time_t t) {
+  struct tm tm;
+#if defined(__APPLE__) || defined(__linux__)
+  gmtime_r(&t, &tm);
+#elif defined(_WIN32)
+  gmtime_s(&tm, &t);
+#endif
+
+  char buf[64];
+  int n = snprintf(buf, sizeof(buf),
+                   "Date:%s, %02d %s %04d %02d:%02d:%02d GMT\r\n",
+                   days[tm.tm_wday], tm.tm_mday, months[tm.tm_mon],
+                   tm.tm_year + 1900, tm.tm_hour, tm.tm_min, tm.tm_sec);
+  return std::make_shared<const std::string>(buf, (size_t)n);
+}
+
+std::shared_ptr<const std::string> DateCache::get() {
+  time_t now = time(nullptr);
+  time_t last = second.load(std::memory_order_relaxed);
+
+  // only the thread that wins the exchange formats the new line
+  if (now != last && second.compare_exchange_strong(last, now)) {
+    std::atomic_store(&line, format(now));
+  }
+  return std::atomic_load(&line);
+}
+
+HeaderPrefix::HeaderPrefix() : headers(), block(), date(false) {}
+
+void HeaderPrefix::set(const std::string &key, const std::string &value) {
+  headers[key] = value;
+
+  block.clear();
+  for (const auto &[k, v] : headers) {
+    block += k + ":" + v + "\r\n";
+  }
+}
+
+void HeaderPrefix::set_date(bool enable) { date = enable; }
+
+const std::map<std::string, std::string> &HeaderPrefix::entries() const {
+  return headers;
+}
+
+bool HeaderPrefix::has_date() const { return date; }
+
+csr::Result<size_t, server_error_t> HeaderPrefix::write(
+    Writer &writer,
+    const std::map<std::string, std::string> &resp_headers) const {
+  size_t size = 0;
+
+  bool overridden = false;
+  for (const auto &[key, _] : headers) {
+    if (resp_headers.count(key)) {
+      overridden = true;
+      break;
+    }
+  }
+
+  if (!overridden) {
+    auto write_result = writer.write(block);
+    if (write_result.is_err()) {
+      return write_result;
+    }
+    size += block.size();
+  } else {
+    // slow path: serialize the headers that are not overridden one by one
+    for (const auto &[key, value] : headers) {
+      if (resp_headers.count(key)) {
+        continue;
+      }
+      std::string line = key + ":" + value + "\r\n";
+      auto write_result = writer.write(line);
+      if (write_result.is_err()) {
+        return write_result;
+      }
+      size += line.size();
+    }
+  }
+
+  if (date && !resp_headers.count("Date")) {
+    auto line = DateCache::instance().get();
+    auto write_result = writer.write(*line);
+    if (write_result.is_err()) {
+      return write_result;
+    }
+    size += line->size();
+  }
+
+  return csr::Result<size_t, server_error_t>::Ok(std::move(size));
+}
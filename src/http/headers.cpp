@@ -0,0 +1,46 @@
+#include "http/headers.h"
+#include <cctype>
+#include <cstring>
+
+bool iequals(const std::string &a, const char *b) {
+  size_t len = strlen(b);
+  if (a.size() != len) {
+    return false;
+  }
+  for (size_t i = 0; i < len; ++i) {
+    if (std::tolower((unsigned char)a[i]) !=
+        std::tolower((unsigned char)b[i])) {
+      return false;
+    }
+  }
+  return true;
+}
+
+const std::string *find_header(const std::map<std::string, std::string> &h,
+                               const char *name) {
+  for (const auto &[key, value] : h) {
+    if (iequals(key, name)) {
+      return &value;
+    }
+  }
+  return nullptr;
+}
+
+bool has_token(const std::string &list, const char *token) {
+  size_t start = 0;
+  while (start <= list.size()) {
+    size_t end = list.find(',', start);
+    if (end == std::string::npos) {
+      end = list.size();
+    }
+
+    size_t first = list.find_first_not_of(" \t", start);
+    size_t last = list.find_last_not_of(" \t", end - 1);
+    if (first < end && last != std::string::npos && last >= first &&
+        iequals(list.substr(first, last - first + 1), token)) {
+      return true;
+    }
+    start = end + 1;
+  }
+  return false;
+}
@@ -1,35 +1,376 @@
 #include "http/httpserver.h"
 #include "middleware/headparser/headparser.h"
 #include "socket/io.h"
+#include "socket/poller.h"
+#include "trace/tracer.h"
 #include <thread>
 #include <vector>
 
-HttpServer::HttpServer(int port)
-    : s(std::move(SocketGenerator::listen(port).unwrap())) {
+// the time it takes run() to notice stop()
+constexpr int ACCEPT_TIMEOUT = 100;
+
+static Socket
+open_socket(const std::function<csr::Result<Socket, server_error_t>()> &open,
+            const ServerOptions &options) {
+  if (!options.handover_path.empty()) {
+    // take over the listening socket of the running server, if any
+    auto inherit_ret =
+        SocketGenerator::inherit(options.handover_path, options);
+    if (inherit_ret.is_ok()) {
+      return std::move(inherit_ret.unwrap());
+    }
+  }
+
+  auto listen_ret = open();
+  if (listen_ret.is_err()) {
+    throw std::system_error(listen_ret.unwrap_err(), "listen error");
+  }
+  return std::move(listen_ret.unwrap());
+}
+
+static std::unique_ptr<Prefork> open_prefork(const ServerOptions &options) {
+  if (!options.workers) {
+    return nullptr;
+  }
+  auto prefork_ret = Prefork::create(options.workers, options.pin_workers);
+  if (prefork_ret.is_err()) {
+    throw std::system_error(prefork_ret.unwrap_err(), "prefork error");
+  }
+  return std::move(prefork_ret.unwrap());
+}
+
+HttpServer::HttpServer(int port, const ServerOptions &options)
+    : options(options), pool(prefix, options.client_pool),
+      handover_path(options.handover_path),
+      drain_timeout(options.drain_timeout), stopping(false), active(0),
+      forced(false), prefork(open_prefork(options)) {
+  listen(open_socket(
+      [&] { return SocketGenerator::listen(port, options); }, options));
+  use(HeadParser());
+}
+
+HttpServer::HttpServer(const std::string &path, const ServerOptions &options)
+    : options(options), pool(prefix, options.client_pool),
+      handover_path(options.handover_path),
+      drain_timeout(options.drain_timeout), stopping(false), active(0),
+      forced(false), prefork(open_prefork(options)) {
+  listen(open_socket(
+      [&] { return SocketGenerator::listen_unix(path, options); }, options));
+  use(HeadParser());
+}
+
+HttpServer::HttpServer(const ServerOptions &options)
+    : options(options), pool(prefix, options.client_pool),
+      handover_path(options.handover_path),
+      drain_timeout(options.drain_timeout), stopping(false), active(0),
+      forced(false), prefork(open_prefork(options)) {
   use(HeadParser());
 }
 
-static void process_req(SocketClient &&sc, Task *task) {
-  HttpClient client{std::move(sc)};
-  client.start(*task);
+void HttpServer::serve(const Socket &listener, SocketClient &&sc,
+                       uint64_t trace, uint64_t accepted) {
+  if (trace) {
+    Tracer::instance().record(trace, SpanKind::accept, 0, accepted,
+                              Tracer::now());
+  }
+
+  bool secured;
+  {
+    TraceScope scope(trace, SpanKind::handshake);
+    secured = listener.secure(sc).is_ok();
+  }
+  // a failed TLS handshake drops the connection
+  if (secured) {
+    auto client = pool.acquire(std::move(sc), listener.buffer_size());
+    {
+      std::lock_guard<std::mutex> lock{clients_mutex};
+      if (forced) {
+        client->shutdown();
+      }
+      clients.insert(client.get());
+    }
+
+    client->start(*tasklist.head(), trace);
+
+    {
+      std::lock_guard<std::mutex> lock{clients_mutex};
+      clients.erase(client.get());
+    }
+    pool.release(std::move(client));
+  }
+
+  if (prefork) {
+    prefork->finished();
+  }
+  // nothing in this object may be touched once active reaches 0
+  std::lock_guard<std::mutex> lock{clients_mutex};
+  --active;
+  clients_cv.notify_all();
+}
+
+/*
+ * Wait for the next process to connect to the handover socket and pass it
+ * the listening socket. The connection queue is shared by both processes,
+ * so no connection is refused during the restart.
+ */
+void HttpServer::handover(Socket &&ctl) {
+  while (!stopping.load()) {
+    auto accept_ret = ctl.accept_for(ACCEPT_TIMEOUT);
+    if (accept_ret.is_err()) {
+      return;
+    }
+    if (accept_ret.unwrap().is_none()) {
+      continue;
+    }
+
+    // remove the path before sending the socket, so it does not race with
+    // the next process listening on the same path
+    (void)ctl.close();
+
+    if (listeners[0].send_to(accept_ret.unwrap().unwrap()).is_ok()) {
+      stop();
+    }
+    return;
+  }
+}
+
+void HttpServer::drain() {
+  std::unique_lock<std::mutex> lock{clients_mutex};
+  if (clients_cv.wait_for(lock, drain_timeout, [this] { return !active; })) {
+    return;
+  }
+
+  // deadline reached: fail the remaining connections
+  forced = true;
+  for (auto client : clients) {
+    client->shutdown();
+  }
+  clients_cv.wait(lock, [this] { return !active; });
+}
+
+void HttpServer::run() {
+  if (listeners.empty()) {
+    throw std::system_error(std::make_error_code(std::errc::invalid_argument),
+                            "no listening socket");
+  }
+
+  std::thread handover_thread;
+  if (!handover_path.empty()) {
+    auto listen_ret = SocketGenerator::listen_unix(handover_path);
+    if (listen_ret.is_err()) {
+      throw std::system_error(listen_ret.unwrap_err(), "listen_unix error");
+    }
+    handover_thread = std::thread{&HttpServer::handover, this,
+                                  std::move(listen_ret.unwrap())};
+  }
+
+  if (prefork) {
+    prefork->supervise([this](size_t i) { work(i); },
+                       [this] { return stopping.load(); }, drain_timeout);
+  } else {
+    loop();
+  }
+
+  if (handover_thread.joinable()) {
+    handover_thread.join();
+  }
+
+  // stop accepting before draining
+  for (auto &listener : listeners) {
+    (void)listener.close();
+  }
+  drain();
+}
+
+void HttpServer::work(size_t i) {
+  if (worker_setup) {
+    worker_setup(*this, i);
+  }
+  loop();
+  // the listening sockets stay open: they are the master's
+  drain();
+}
+
+void HttpServer::loop() {
+  // a single listener is waited on by accept_for() itself
+  std::unique_ptr<Poller> poller;
+  if (listeners.size() > 1) {
+    auto poller_ret = Poller::create();
+    if (poller_ret.is_err()) {
+      throw std::system_error(poller_ret.unwrap_err(), "poller error");
+    }
+    poller = std::move(poller_ret.unwrap());
+    for (const auto &listener : listeners) {
+      auto add_ret = poller->add(listener.fd(), false);
+      if (add_ret.is_err()) {
+        throw std::system_error(add_ret.unwrap_err(), "poller error");
+      }
+    }
+  }
+
+  auto published = std::chrono::steady_clock::now();
+  std::vector<PollEvent> events;
+  while (!stopping.load() && !(prefork && prefork->stopping())) {
+    if (poller) {
+      if (poller->wait(ACCEPT_TIMEOUT, events).is_err()) {
+        continue;
+      }
+      for (const auto &event : events) {
+        for (const auto &listener : listeners) {
+          if (listener.fd() == event.fd) {
+            accept(listener, 0);
+          }
+        }
+      }
+    } else {
+      accept(listeners[0], ACCEPT_TIMEOUT);
+    }
+
+    if (prefork) {
+      auto now = std::chrono::steady_clock::now();
+      if (now - published >= std::chrono::milliseconds(ACCEPT_TIMEOUT)) {
+        prefork->pool(pool.metrics());
+        published = now;
+      }
+    }
+  }
 }
 
-void HttpServer::run() const {
-  while (true) {
-    std::thread t{process_req, std::move(s.accept().unwrap()), tasklist.head()};
+void HttpServer::accept(const Socket &listener, int timeout) {
+  auto accept_ret = listener.accept_for(timeout);
+  if (accept_ret.is_err()) {
+    // e.g. out of descriptors: back off instead of spinning on poll
+    std::this_thread::sleep_for(std::chrono::milliseconds(ACCEPT_TIMEOUT));
+    return;
+  }
+  if (accept_ret.unwrap().is_none()) {
+    return;
+  }
+
+  uint64_t trace = Tracer::instance().sample();
+  uint64_t accepted = trace ? Tracer::now() : 0;
+
+  {
+    std::lock_guard<std::mutex> lock{clients_mutex};
+    ++active;
+  }
+  if (prefork) {
+    prefork->accepted();
+  }
+  try {
+    std::thread t{&HttpServer::serve, this, std::cref(listener),
+                  std::move(accept_ret.unwrap().unwrap()), trace, accepted};
     t.detach();
+  } catch (const std::system_error &) {
+    // out of threads: the connection has already been closed
+    if (prefork) {
+      prefork->finished();
+    }
+    std::lock_guard<std::mutex> lock{clients_mutex};
+    --active;
   }
 }
 
+void HttpServer::stop() { stopping.store(true); }
+
 HttpServer &HttpServer::use(std::function<void(Context &, const Task &)> &&f) {
   tasklist.use(std::move(f));
   return *this;
 }
 
-HttpClient::HttpClient(SocketClient &&sc)
-    : ctx(sc.connfd.unwrap()), sc(std::move(sc)) {}
+HttpServer &HttpServer::listen(Socket &&s) {
+  listeners.push_back(std::move(s));
+  return *this;
+}
+
+HttpServer &HttpServer::listen(int port) {
+  auto listen_ret = SocketGenerator::listen(port, options);
+  if (listen_ret.is_err()) {
+    throw std::system_error(listen_ret.unwrap_err(), "listen error");
+  }
+  return listen(std::move(listen_ret.unwrap()));
+}
+
+HttpServer &HttpServer::listen_unix(const std::string &path) {
+  auto listen_ret = SocketGenerator::listen_unix(path, options);
+  if (listen_ret.is_err()) {
+    throw std::system_error(listen_ret.unwrap_err(), "listen_unix error");
+  }
+  return listen(std::move(listen_ret.unwrap()));
+}
+
+HttpServer &HttpServer::header(const std::string &key,
+                               const std::string &value) {
+  prefix.set(key, value);
+  return *this;
+}
+
+HttpServer &HttpServer::date(bool enable) {
+  prefix.set_date(enable);
+  return *this;
+}
+
+void HttpServer::loopback(Transport &transport) {
+  HttpClient client{transport, prefix, options.buffer_size};
+  client.start(*tasklist.head(), Tracer::instance().sample());
+}
+
+HttpServer &
+HttpServer::on_worker(std::function<void(HttpServer &, size_t)> &&f) {
+  worker_setup = std::move(f);
+  return *this;
+}
+
+PoolStats HttpServer::pool_stats() { return pool.metrics(); }
+
+std::vector<WorkerStats> HttpServer::worker_stats() const {
+  return prefork ? prefork->stats() : std::vector<WorkerStats>();
+}
+
+HttpClient::HttpClient(SocketClient &&sc, const HeaderPrefix &prefix,
+                       size_t bufsize)
+    : ctx(sc.connfd.unwrap(), prefix, bufsize), sc(std::move(sc)) {
+  ctx.peer = this->sc->clientaddr;
+  ctx.peerlen = this->sc->clientlen;
+}
+
+HttpClient::HttpClient(Transport &transport, const HeaderPrefix &prefix,
+                       size_t bufsize)
+    : ctx(INVALID_SOCKET, prefix, bufsize, &transport), sc() {}
+
+void HttpClient::open(SocketClient &&sc, size_t bufsize) {
+  ctx.reset(sc.connfd.unwrap(), bufsize);
+  ctx.peer = sc.clientaddr;
+  ctx.peerlen = sc.clientlen;
+  this->sc.emplace(std::move(sc));
+}
+
+void HttpClient::close() {
+  sc.reset();
+  ctx.clear();
+}
 
-void HttpClient::start(const Task &task) {
+void HttpClient::start(const Task &task, uint64_t trace) {
+  ctx.trace = trace;
   task.next(ctx);
-  ctx.write();
+
+  if (ctx.takeover) {
+    // nothing to hand over without a socket: the connection ends here
+    if (!sc) {
+      return;
+    }
+    std::vector<char> input;
+    ctx.reader.take(input);
+    ctx.takeover(std::move(*sc), std::move(input));
+    return;
+  }
+
+  // on error, the connection is torn down by close() all the same
+  (void)ctx.write();
+}
+
+void HttpClient::shutdown() const {
+  if (sc) {
+    (void)sc->shutdown();
+  }
 }
\ No newline at end of file
@@ -0,0 +1,234 @@
+#include "http/prefork.h"
+#include <cerrno>
+#include <cstdio>
+#include <new>
+#include <thread>
+
+#if defined(__APPLE__) || defined(__linux__)
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+#if defined(__linux__)
+#include <sched.h>
+#endif
+
+// time between two checks of the workers by the master
+constexpr int SUPERVISE_INTERVAL = 100;
+// a worker that exits sooner than this after starting is restarted after
+// as long, so a worker crashing on startup does not make the master spin
+constexpr int RESTART_DELAY = 1000;
+// time given to the workers after the drain timeout before they are killed
+constexpr int KILL_GRACE = 1000;
+
+static_assert(std::atomic<uint64_t>::is_always_lock_free &&
+                  std::atomic<size_t>::is_always_lock_free &&
+                  std::atomic<int>::is_always_lock_free,
+              "counters shared between processes must be lock free");
+
+Prefork::Prefork(void *memory, size_t mapped, size_t count, bool pin)
+    : shared(new (memory) Shared()), slots(nullptr), mapped(mapped),
+      count(count), pin(pin), master(0), index(SIZE_MAX),
+      workers(count) {
+  char *first = (char *)memory + sizeof(Shared);
+  slots = (Slot *)first;
+  for (size_t i = 0; i < count; ++i) {
+    new (&slots[i]) Slot();
+  }
+#if defined(__APPLE__) || defined(__linux__)
+  master = getpid();
+#endif
+}
+
+Prefork::~Prefork() {
+#if defined(__APPLE__) || defined(__linux__)
+  (void)munmap(shared, mapped);
+#endif
+}
+
+csr::Result<std::unique_ptr<Prefork>, server_error_t>
+Prefork::create(size_t count, bool pin) {
+#if defined(__APPLE__) || defined(__linux__)
+  size_t mapped = sizeof(Shared) + count * sizeof(Slot);
+  // shared by the processes forked afterwards
+  void *memory = mmap(nullptr, mapped, PROT_READ | PROT_WRITE,
+                      MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+  if (memory == MAP_FAILED) {
+    return csr::Result<std::unique_ptr<Prefork>, server_error_t>::Err(
+        std::error_code(errno, std::system_category()));
+  }
+  return csr::Result<std::unique_ptr<Prefork>, server_error_t>::Ok(
+      std::unique_ptr<Prefork>(new Prefork(memory, mapped, count, pin)));
+#elif defined(_WIN32)
+  (void)count;
+  (void)pin;
+  return csr::Result<std::unique_ptr<Prefork>, server_error_t>::Err(
+      server_error(ServerErr::unsupported_option));
+#endif
+}
+
+void Prefork::spawn(size_t i, const std::function<void(size_t)> &serve) {
+#if defined(__APPLE__) || defined(__linux__)
+  Slot &slot = slots[i];
+  slot.accepted.store(0);
+  slot.active.store(0);
+  slot.idle.store(0);
+  slot.in_use.store(0);
+  slot.high_water.store(0);
+  slot.created.store(0);
+  slot.reused.store(0);
+
+  auto now = std::chrono::steady_clock::now();
+  // the output buffered so far would be written by both processes
+  fflush(nullptr);
+  pid_t pid = fork();
+  if (pid == -1) {
+    workers[i].restart_at = now + std::chrono::milliseconds(RESTART_DELAY);
+    return;
+  }
+
+  if (pid == 0) {
+    index = i;
+#if defined(__linux__)
+    if (pin) {
+      unsigned cpus = std::thread::hardware_concurrency();
+      cpu_set_t set;
+      CPU_ZERO(&set);
+      CPU_SET(i % (cpus ? cpus : 1), &set);
+      (void)sched_setaffinity(0, sizeof(set), &set);
+    }
+#endif
+    serve(i);
+    // the destructors of the master's objects must not run here, and the
+    // connection threads may still be detached
+    fflush(nullptr);
+    _exit(0);
+  }
+
+  slot.pid.store(pid);
+  workers[i].started = now;
+#else
+  (void)i;
+  (void)serve;
+#endif
+}
+
+void Prefork::supervise(const std::function<void(size_t)> &serve,
+                        const std::function<bool()> &stopping,
+                        std::chrono::milliseconds timeout) {
+#if defined(__APPLE__) || defined(__linux__)
+  for (size_t i = 0; i < count; ++i) {
+    spawn(i, serve);
+  }
+
+  while (!stopping()) {
+    std::this_thread::sleep_for(
+        std::chrono::milliseconds(SUPERVISE_INTERVAL));
+    auto now = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < count; ++i) {
+      Slot &slot = slots[i];
+      int pid = slot.pid.load();
+      // other children of the process are not reaped here
+      if (pid && waitpid(pid, nullptr, WNOHANG) == pid) {
+        slot.pid.store(0);
+        workers[i].restart_at =
+            now - workers[i].started <
+                    std::chrono::milliseconds(RESTART_DELAY)
+                ? now + std::chrono::milliseconds(RESTART_DELAY)
+                : now;
+      }
+      if (!slot.pid.load() && now >= workers[i].restart_at &&
+          !stopping()) {
+        slot.restarts.fetch_add(1);
+        spawn(i, serve);
+      }
+    }
+  }
+
+  shared->stopping.store(true);
+  auto deadline = std::chrono::steady_clock::now() + timeout +
+                  std::chrono::milliseconds(KILL_GRACE);
+  bool killed = false;
+  while (true) {
+    bool alive = false;
+    for (size_t i = 0; i < count; ++i) {
+      int pid = slots[i].pid.load();
+      if (!pid) {
+        continue;
+      }
+      if (waitpid(pid, nullptr, WNOHANG) == pid) {
+        slots[i].pid.store(0);
+      } else {
+        alive = true;
+        if (killed) {
+          (void)kill(pid, SIGKILL);
+        }
+      }
+    }
+    if (!alive) {
+      break;
+    }
+    killed = std::chrono::steady_clock::now() >= deadline;
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  }
+  shared->stopping.store(false);
+#else
+  (void)serve;
+  (void)stopping;
+  (void)timeout;
+#endif
+}
+
+bool Prefork::stopping() const {
+#if defined(__APPLE__) || defined(__linux__)
+  return shared->stopping.load(std::memory_order_relaxed) ||
+         getppid() != master;
+#else
+  return false;
+#endif
+}
+
+// no-ops in the master, which has no slot (index is SIZE_MAX)
+void Prefork::accepted() {
+  if (index >= count) {
+    return;
+  }
+  slots[index].accepted.fetch_add(1, std::memory_order_relaxed);
+  slots[index].active.fetch_add(1, std::memory_order_relaxed);
+}
+
+void Prefork::finished() {
+  if (index >= count) {
+    return;
+  }
+  slots[index].active.fetch_sub(1, std::memory_order_relaxed);
+}
+
+void Prefork::pool(const PoolStats &stats) {
+  if (index >= count) {
+    return;
+  }
+  Slot &slot = slots[index];
+  slot.idle.store(stats.idle, std::memory_order_relaxed);
+  slot.in_use.store(stats.in_use, std::memory_order_relaxed);
+  slot.high_water.store(stats.high_water, std::memory_order_relaxed);
+  slot.created.store(stats.created, std::memory_order_relaxed);
+  slot.reused.store(stats.reused, std::memory_order_relaxed);
+}
+
+std::vector<WorkerStats> Prefork::stats() const {
+  std::vector<WorkerStats> stats;
+  for (size_t i = 0; i < count; ++i) {
+    const Slot &slot = slots[i];
+    stats.push_back(WorkerStats{
+        slot.pid.load(),
+        slot.restarts.load(),
+        slot.accepted.load(),
+        slot.active.load(),
+        PoolStats{slot.idle.load(), slot.in_use.load(),
+                  slot.high_water.load(), slot.created.load(),
+                  slot.reused.load()}});
+  }
+  return stats;
+}
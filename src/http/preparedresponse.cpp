@@ -0,0 +1,45 @@
+#include "http/preparedresponse.h"
+#include <string>
+
+PreparedResponse::PreparedResponse(std::vector<char> &&bytes,
+                                   const Response &resp, size_t head_size)
+    : bytes(std::move(bytes)), code(resp.status), fields(resp.headers),
+      head_size(head_size) {}
+
+std::shared_ptr<const PreparedResponse>
+PreparedResponse::build(const Response &resp) {
+  std::string head = "HTTP/1.0 " + resp.status + " \r\n";
+
+  bool has_length = false;
+  for (const auto &[key, value] : resp.headers) {
+    has_length = has_length || key == "Content-Length";
+    head += key + ":" + value + "\r\n";
+  }
+  if (!has_length && !resp.content.empty()) {
+    head += "Content-Length:" + std::to_string(resp.content.size()) + "\r\n";
+  }
+  head += "\r\n";
+
+  std::vector<char> bytes;
+  bytes.reserve(head.size() + resp.content.size());
+  bytes.insert(bytes.end(), head.begin(), head.end());
+  bytes.insert(bytes.end(), resp.content.begin(), resp.content.end());
+
+  // constructor is private, so std::make_shared cannot be used
+  return std::shared_ptr<const PreparedResponse>(
+      new PreparedResponse(std::move(bytes), resp, head.size()));
+}
+
+const std::vector<char> &PreparedResponse::data() const { return bytes; }
+
+const std::string &PreparedResponse::status() const { return code; }
+
+const std::map<std::string, std::string> &PreparedResponse::headers() const {
+  return fields;
+}
+
+const char *PreparedResponse::body() const {
+  return bytes.data() + head_size;
+}
+
+size_t PreparedResponse::body_size() const { return bytes.size() - head_size; }
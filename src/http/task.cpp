@@ -1,23 +1,27 @@
 #include "http/task.h"
+#include "trace/tracer.h"
+#include "watchdog/watchdog.h"
 
 Task::Task(std::function<void(Context &, const Task &)> &&f)
     : Task(std::move(f), nullptr) {}
 
 Task::Task(std::function<void(Context &, const Task &)> &&f,
            std::unique_ptr<Task> &&next_task)
-    : f(std::move(f)), next_task(std::move(next_task)) {}
+    : f(std::move(f)), next_task(std::move(next_task)), index(0) {}
 
 void Task::next(Context &ctx) const {
   if (!next_task) {
     return;
   }
+  TraceScope scope(ctx.trace, SpanKind::task, index);
+  WatchScope watch(ctx.req.fullpath, index);
   f(ctx, *next_task.get());
 }
 
 void Task::drop() const {}
 
 TaskList::TaskList()
-    : header(std::make_unique<Task>(nullptr)), footer(nullptr) {}
+    : header(std::make_unique<Task>(nullptr)), footer(nullptr), count(0) {}
 
 TaskList::~TaskList() {
   while (header) {
@@ -35,6 +39,7 @@ void TaskList::use(std::function<void(Context &, const Task &)> &&f) {
         std::make_unique<Task>(std::move(f), std::move(footer->next_task));
     footer = footer->next_task.get();
   }
+  footer->index = count++;
 }
 
 Task *TaskList::head() const { return header.get(); }
\ No newline at end of file
@@ -0,0 +1,108 @@
+#include "http2/frame.h"
+
+const char *H2Category::name() const noexcept { return "http2"; }
+
+std::string H2Category::message(int ev) const {
+  switch ((H2Err)ev) {
+  case H2Err::no_error:
+    return "no error";
+  case H2Err::protocol_error:
+    return "protocol error";
+  case H2Err::internal_error:
+    return "internal error";
+  case H2Err::flow_control_error:
+    return "flow control error";
+  case H2Err::settings_timeout:
+    return "settings timeout";
+  case H2Err::stream_closed:
+    return "stream closed";
+  case H2Err::frame_size_error:
+    return "frame size error";
+  case H2Err::refused_stream:
+    return "stream refused";
+  case H2Err::cancel:
+    return "stream cancelled";
+  case H2Err::compression_error:
+    return "compression error";
+  case H2Err::connect_error:
+    return "connect error";
+  case H2Err::enhance_your_calm:
+    return "enhance your calm";
+  case H2Err::inadequate_security:
+    return "inadequate security";
+  case H2Err::http_1_1_required:
+    return "HTTP/1.1 required";
+  }
+  return "unknown error";
+}
+
+const std::error_category &h2_category() noexcept {
+  static H2Category category;
+  return category;
+}
+
+std::error_code make_error_code(H2Err err) noexcept {
+  return std::error_code((int)err, h2_category());
+}
+
+H2Frame::H2Frame()
+    : length(0), type(H2Type::data), flags(0), stream(0), payload() {}
+
+csr::Result<bool, server_error_t> H2Frame::read(Reader &reader,
+                                                uint32_t max_size) {
+  char header[H2_FRAME_HEADER_LEN];
+
+  auto read_result = reader.read_exact(header, sizeof(header));
+  if (read_result.is_err()) {
+    return csr::Result<bool, server_error_t>::Err(
+        std::move(read_result.unwrap_err()));
+  }
+  if (read_result.unwrap() == 0) {
+    return csr::Result<bool, server_error_t>::Ok(false);
+  }
+  if (read_result.unwrap() != sizeof(header)) {
+    return csr::Result<bool, server_error_t>::Err(
+        server_error(ServerErr::connection_close_by_client));
+  }
+
+  length = read_u32(header) >> 8;
+  type = (H2Type)header[3];
+  flags = (uint8_t)header[4];
+  stream = read_u32(header + 5) & 0x7fffffff;
+
+  if (length > max_size) {
+    return csr::Result<bool, server_error_t>::Err(
+        make_error_code(H2Err::frame_size_error));
+  }
+
+  // keep the capacity of the previous payload
+  payload.resize(length);
+  read_result = reader.read_exact(payload.data(), length);
+  if (read_result.is_err()) {
+    return csr::Result<bool, server_error_t>::Err(
+        std::move(read_result.unwrap_err()));
+  }
+  if (read_result.unwrap() != length) {
+    return csr::Result<bool, server_error_t>::Err(
+        server_error(ServerErr::connection_close_by_client));
+  }
+
+  return csr::Result<bool, server_error_t>::Ok(true);
+}
+
+csr::Result<size_t, server_error_t> write_frame(Writer &writer, H2Type type,
+                                                uint8_t flags, uint32_t stream,
+                                                const char *payload,
+                                                size_t length) {
+  char header[H2_FRAME_HEADER_LEN];
+  write_u32(header, (uint32_t)length << 8);
+  header[3] = (char)type;
+  header[4] = (char)flags;
+  write_u32(header + 5, stream);
+
+  auto write_result = writer.write(header, sizeof(header));
+  if (write_result.is_ok() && length) {
+    write_result = writer.write(payload, length);
+  }
+  return write_result;
+}
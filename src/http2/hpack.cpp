@@ -0,0 +1,347 @@
+#include "http2/hpack.h"
+#include "http2/frame.h"
+
+// size of an entry is the length of its name and value plus 32
+// (RFC 7541 4.1)
+constexpr size_t HPACK_ENTRY_OVERHEAD = 32;
+
+// RFC 7541 Appendix A
+static const HeaderField static_table[] = {
+    {":authority", ""},
+    {":method", "GET"},
+    {":method", "POST"},
+    {":path", "/"},
+    {":path", "/index.html"},
+    {":scheme", "http"},
+    {":scheme", "https"},
+    {":status", "200"},
+    {":status", "204"},
+    {":status", "206"},
+    {":status", "304"},
+    {":status", "400"},
+    {":status", "404"},
+    {":status", "500"},
+    {"accept-charset", ""},
+    {"accept-encoding", "gzip, deflate"},
+    {"accept-language", ""},
+    {"accept-ranges", ""},
+    {"accept", ""},
+    {"access-control-allow-origin", ""},
+    {"age", ""},
+    {"allow", ""},
+    {"authorization", ""},
+    {"cache-control", ""},
+    {"content-disposition", ""},
+    {"content-encoding", ""},
+    {"content-language", ""},
+    {"content-length", ""},
+    {"content-location", ""},
+    {"content-range", ""},
+    {"content-type", ""},
+    {"cookie", ""},
+    {"date", ""},
+    {"etag", ""},
+    {"expect", ""},
+    {"expires", ""},
+    {"from", ""},
+    {"host", ""},
+    {"if-match", ""},
+    {"if-modified-since", ""},
+    {"if-none-match", ""},
+    {"if-range", ""},
+    {"if-unmodified-since", ""},
+    {"last-modified", ""},
+    {"link", ""},
+    {"location", ""},
+    {"max-forwards", ""},
+    {"proxy-authenticate", ""},
+    {"proxy-authorization", ""},
+    {"range", ""},
+    {"referer", ""},
+    {"refresh", ""},
+    {"retry-after", ""},
+    {"server", ""},
+    {"set-cookie", ""},
+    {"strict-transport-security", ""},
+    {"transfer-encoding", ""},
+    {"user-agent", ""},
+    {"vary", ""},
+    {"via", ""},
+    {"www-authenticate", ""},
+};
+
+constexpr size_t STATIC_TABLE_LEN =
+    sizeof(static_table) / sizeof(static_table[0]);
+
+HpackTable::HpackTable(size_t max_size) : size(0), max_size(max_size) {}
+
+void HpackTable::evict(size_t limit) {
+  while (size > limit) {
+    size -= entries.back().first.size() + entries.back().second.size() +
+            HPACK_ENTRY_OVERHEAD;
+    entries.pop_back();
+  }
+}
+
+void HpackTable::resize(size_t max_size) {
+  this->max_size = max_size;
+  evict(max_size);
+}
+
+void HpackTable::add(const std::string &name, const std::string &value) {
+  size_t entry_size = name.size() + value.size() + HPACK_ENTRY_OVERHEAD;
+
+  // an entry larger than the table empties it (RFC 7541 4.4)
+  if (entry_size > max_size) {
+    evict(0);
+    return;
+  }
+
+  evict(max_size - entry_size);
+  entries.emplace_front(name, value);
+  size += entry_size;
+}
+
+const HeaderField *HpackTable::get(size_t index) const {
+  if (index == 0) {
+    return nullptr;
+  }
+  if (index <= STATIC_TABLE_LEN) {
+    return &static_table[index - 1];
+  }
+  index -= STATIC_TABLE_LEN + 1;
+  return index < entries.size() ? &entries[index] : nullptr;
+}
+
+size_t HpackTable::find(const std::string &name, const std::string &value,
+                        bool &full) const {
+  size_t name_index = 0;
+  full = false;
+
+  for (size_t i = 0; i < STATIC_TABLE_LEN; ++i) {
+    if (static_table[i].first == name) {
+      if (static_table[i].second == value) {
+        full = true;
+        return i + 1;
+      }
+      if (!name_index) {
+        name_index = i + 1;
+      }
+    }
+  }
+
+  for (size_t i = 0; i < entries.size(); ++i) {
+    if (entries[i].first == name) {
+      if (entries[i].second == value) {
+        full = true;
+        return i + STATIC_TABLE_LEN + 1;
+      }
+      if (!name_index) {
+        name_index = i + STATIC_TABLE_LEN + 1;
+      }
+    }
+  }
+
+  return name_index;
+}
+
+/*
+ * Decode an integer with an N-bit prefix (RFC 7541 5.1).
+ * Values that do not fit in 32 bits are rejected.
+ */
+static bool decode_int(const unsigned char *&p, const unsigned char *end,
+                       int prefix, size_t &value) {
+  size_t max = ((size_t)1 << prefix) - 1;
+
+  value = *p++ & max;
+  if (value < max) {
+    return true;
+  }
+
+  for (int shift = 0; p < end && shift <= 28; shift += 7) {
+    unsigned char b = *p++;
+    value += (size_t)(b & 0x7f) << shift;
+    if (!(b & 0x80)) {
+      return value <= 0xffffffff;
+    }
+  }
+  return false;
+}
+
+static bool decode_string(const unsigned char *&p, const unsigned char *end,
+                          std::string &s) {
+  if (p == end) {
+    return false;
+  }
+
+  bool huffman = *p & 0x80;
+  size_t len;
+  if (!decode_int(p, end, 7, len) || len > (size_t)(end - p)) {
+    return false;
+  }
+
+  if (huffman) {
+    if (huffman_decode((const char *)p, len, s).is_err()) {
+      return false;
+    }
+  } else {
+    s.assign((const char *)p, len);
+  }
+  p += len;
+  return true;
+}
+
+HpackDecoder::HpackDecoder(size_t max_size, size_t max_list)
+    : table(max_size), max_size(max_size), max_list(max_list) {}
+
+csr::Result<std::monostate, server_error_t>
+HpackDecoder::decode(const char *data, size_t len, HeaderList &headers) {
+  const unsigned char *p = (const unsigned char *)data, *end = p + len;
+  // size updates are only allowed at the beginning of a block
+  bool started = false;
+  size_t list_size = 0;
+
+  while (p < end) {
+    unsigned char b = *p;
+    size_t index;
+
+    if (b & 0x80) {
+      // indexed header field
+      if (!decode_int(p, end, 7, index)) {
+        break;
+      }
+      const HeaderField *field = table.get(index);
+      if (!field) {
+        break;
+      }
+      list_size += field->first.size() + field->second.size() + 32;
+      if (list_size > max_list) {
+        return csr::Result<std::monostate, server_error_t>::Err(
+            make_error_code(H2Err::enhance_your_calm));
+      }
+      headers.push_back(*field);
+    } else if ((b & 0xe0) == 0x20) {
+      // dynamic table size update
+      if (started || !decode_int(p, end, 5, index) || index > max_size) {
+        break;
+      }
+      table.resize(index);
+      continue;
+    } else {
+      // literal header field, with incremental indexing (01), without
+      // indexing (0000) or never indexed (0001)
+      bool indexing = b & 0x40;
+      if (!decode_int(p, end, indexing ? 6 : 4, index)) {
+        break;
+      }
+
+      HeaderField field;
+      if (index) {
+        const HeaderField *name = table.get(index);
+        if (!name) {
+          break;
+        }
+        field.first = name->first;
+      } else if (!decode_string(p, end, field.first)) {
+        break;
+      }
+      if (!decode_string(p, end, field.second)) {
+        break;
+      }
+
+      list_size += field.first.size() + field.second.size() + 32;
+      if (list_size > max_list) {
+        return csr::Result<std::monostate, server_error_t>::Err(
+            make_error_code(H2Err::enhance_your_calm));
+      }
+      if (indexing) {
+        table.add(field.first, field.second);
+      }
+      headers.push_back(std::move(field));
+    }
+
+    started = true;
+  }
+
+  if (p != end) {
+    return csr::Result<std::monostate, server_error_t>::Err(
+        make_error_code(H2Err::compression_error));
+  }
+  return csr::Result<std::monostate, server_error_t>();
+}
+
+static void encode_int(std::string &out, unsigned char flags, int prefix,
+                       size_t value) {
+  size_t max = ((size_t)1 << prefix) - 1;
+
+  if (value < max) {
+    out.push_back((char)(flags | value));
+    return;
+  }
+
+  out.push_back((char)(flags | max));
+  value -= max;
+  while (value >= 0x80) {
+    out.push_back((char)(value | 0x80));
+    value >>= 7;
+  }
+  out.push_back((char)value);
+}
+
+static void encode_string(std::string &out, const std::string &s) {
+  size_t len = huffman_length(s);
+  if (len < s.size()) {
+    encode_int(out, 0x80, 7, len);
+    huffman_encode(s, out);
+  } else {
+    encode_int(out, 0, 7, s.size());
+    out += s;
+  }
+}
+
+HpackEncoder::HpackEncoder()
+    : table(HPACK_DEFAULT_TABLE_SIZE), max_size(HPACK_DEFAULT_TABLE_SIZE),
+      size_update(false) {}
+
+void HpackEncoder::set_max_size(size_t size) {
+  // never use more than the default, whatever the peer allows
+  size = size < HPACK_DEFAULT_TABLE_SIZE ? size : HPACK_DEFAULT_TABLE_SIZE;
+  if (size != max_size) {
+    max_size = size;
+    table.resize(size);
+    size_update = true;
+  }
+}
+
+void HpackEncoder::encode(const HeaderList &headers, std::string &out) {
+  if (size_update) {
+    encode_int(out, 0x20, 5, max_size);
+    size_update = false;
+  }
+
+  for (auto &field : headers) {
+    bool full;
+    size_t index = table.find(field.first, field.second, full);
+
+    if (full) {
+      encode_int(out, 0x80, 7, index);
+      continue;
+    }
+
+    if (field.first == "authorization" || field.first == "set-cookie") {
+      // sensitive: never indexed, by any intermediary either
+      encode_int(out, 0x10, 4, index);
+    } else if (field.first == "content-length" || field.first == "date") {
+      // changes with (almost) every response: not worth a table entry
+      encode_int(out, 0x00, 4, index);
+    } else {
+      encode_int(out, 0x40, 6, index);
+      table.add(field.first, field.second);
+    }
+
+    if (!index) {
+      encode_string(out, field.first);
+    }
+    encode_string(out, field.second);
+  }
+}
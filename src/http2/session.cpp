@@ -0,0 +1,753 @@
+#include "http2/session.h"
+#include "http/preparedresponse.h"
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+#include <thread>
+
+typedef csr::Result<std::monostate, server_error_t> H2Result;
+
+static H2Result h2_error(H2Err err) {
+  return H2Result::Err(make_error_code(err));
+}
+
+static std::string lowercase(const std::string &s) {
+  std::string ret = s;
+  for (auto &c : ret) {
+    c = (char)std::tolower((unsigned char)c);
+  }
+  return ret;
+}
+
+// headers that only make sense for a single HTTP/1 connection (RFC 7540
+// 8.1.2.2)
+static bool connection_specific(const std::string &name) {
+  return name == "connection" || name == "keep-alive" ||
+         name == "proxy-connection" || name == "transfer-encoding" ||
+         name == "upgrade";
+}
+
+/*
+ * Fill req from a decoded request header block.
+ * Returns false if the block is malformed (RFC 7540 8.1.2).
+ */
+static bool build_request(HeaderList &fields, Request &req) {
+  bool regular = false;
+
+  for (auto &[name, value] : fields) {
+    if (name.empty()) {
+      return false;
+    }
+
+    if (name[0] == ':') {
+      // pseudo-headers come first
+      if (regular) {
+        return false;
+      }
+      if (name == ":method") {
+        req.method = std::move(value);
+      } else if (name == ":path") {
+        req.fullpath = std::move(value);
+      } else if (name == ":authority") {
+        req.headers.emplace("host", std::move(value));
+      } else if (name != ":scheme") {
+        return false;
+      }
+      continue;
+    }
+
+    regular = true;
+    if (connection_specific(name) || lowercase(name) != name) {
+      return false;
+    }
+
+    auto it = req.headers.find(name);
+    if (it == req.headers.end()) {
+      req.headers.emplace(std::move(name), std::move(value));
+    } else if (name == "host") {
+      // :authority takes precedence
+    } else {
+      it->second += name == "cookie" ? "; " : ", ";
+      it->second += value;
+    }
+  }
+
+  req.version = "HTTP/2.0";
+  return !req.method.empty() &&
+         (!req.fullpath.empty() || req.method == "CONNECT");
+}
+
+H2Session::Stream::Stream(uint32_t id, const Context &conn, int64_t window)
+    : id(id), ctx(conn.fd, conn.prefix, conn.bufsize, conn.transport),
+      complete(false), recv_window(H2_DEFAULT_WINDOW), send_window(window),
+      reset(false) {
+  ctx.peer = conn.peer;
+  ctx.peerlen = conn.peerlen;
+  ctx.trace = conn.trace;
+}
+
+H2Session::H2Session(Context &ctx, const Task &next)
+    : ctx(ctx), next(next), writer(ctx.fd, ctx.bufsize, ctx.transport),
+      block_stream(0), block_end_stream(false), goaway(false),
+      recv_window(H2_DEFAULT_WINDOW), last_stream(0),
+      send_window(H2_DEFAULT_WINDOW), initial_window(H2_DEFAULT_WINDOW),
+      max_frame_size(H2_DEFAULT_FRAME_SIZE), active(0), closed(false) {}
+
+H2Result H2Session::send_frame(H2Type type, uint8_t flags, uint32_t stream,
+                               const char *payload, size_t length) {
+  std::lock_guard<std::mutex> lock{write_mutex};
+
+  auto write_result = write_frame(writer, type, flags, stream, payload, length);
+  if (write_result.is_ok()) {
+    write_result = writer.flush();
+  }
+
+  if (write_result.is_err()) {
+    return H2Result::Err(std::move(write_result.unwrap_err()));
+  }
+  return H2Result();
+}
+
+H2Result H2Session::send_reset(uint32_t stream, H2Err err) {
+  char payload[4];
+  write_u32(payload, (uint32_t)err);
+  return send_frame(H2Type::rst_stream, 0, stream, payload, sizeof(payload));
+}
+
+H2Result H2Session::send_goaway(H2Err err) {
+  char payload[8];
+  {
+    std::lock_guard<std::mutex> lock{mutex};
+    write_u32(payload, last_stream);
+  }
+  write_u32(payload + 4, (uint32_t)err);
+  return send_frame(H2Type::goaway, 0, 0, payload, sizeof(payload));
+}
+
+H2Result H2Session::apply_settings(const char *payload, size_t length) {
+  if (length % 6) {
+    return h2_error(H2Err::frame_size_error);
+  }
+
+  for (const char *p = payload; p < payload + length; p += 6) {
+    uint32_t value = read_u32(p + 2);
+
+    switch ((H2Setting)read_u16(p)) {
+    case H2Setting::header_table_size: {
+      std::lock_guard<std::mutex> lock{write_mutex};
+      encoder.set_max_size(value);
+      break;
+    }
+    case H2Setting::enable_push:
+      if (value > 1) {
+        return h2_error(H2Err::protocol_error);
+      }
+      break;
+    case H2Setting::initial_window_size: {
+      if (value > H2_MAX_WINDOW) {
+        return h2_error(H2Err::flow_control_error);
+      }
+      // the change applies to the windows of the open streams too
+      std::lock_guard<std::mutex> lock{mutex};
+      int64_t delta = (int64_t)value - initial_window;
+      for (auto &[_, stream] : streams) {
+        stream->send_window += delta;
+      }
+      initial_window = value;
+      cv.notify_all();
+      break;
+    }
+    case H2Setting::max_frame_size: {
+      if (value < H2_DEFAULT_FRAME_SIZE || value > H2_MAX_FRAME_SIZE) {
+        return h2_error(H2Err::protocol_error);
+      }
+      std::lock_guard<std::mutex> lock{mutex};
+      max_frame_size = value;
+      break;
+    }
+    default:
+      // unknown settings are ignored
+      break;
+    }
+  }
+
+  return H2Result();
+}
+
+H2Result H2Session::upgrade(const std::string &settings) {
+  auto err = apply_settings(settings.data(), settings.size());
+  if (err.is_err()) {
+    return err;
+  }
+
+  auto stream = std::make_shared<Stream>(1, ctx, initial_window);
+  stream->ctx.req = ctx.req;
+  stream->ctx.req.version = "HTTP/2.0";
+  stream->complete = true;
+
+  std::lock_guard<std::mutex> lock{mutex};
+  streams.emplace(1, std::move(stream));
+  last_stream = 1;
+  return H2Result();
+}
+
+H2Result H2Session::handle(const H2Frame &frame) {
+  // nothing may come between the frames of a header block
+  if (block_stream && (frame.type != H2Type::continuation ||
+                       frame.stream != block_stream)) {
+    return h2_error(H2Err::protocol_error);
+  }
+
+  switch (frame.type) {
+  case H2Type::data:
+    return on_data(frame);
+  case H2Type::headers:
+    return on_headers(frame);
+  case H2Type::continuation:
+    if (!block_stream) {
+      return h2_error(H2Err::protocol_error);
+    }
+    if (block.size() + frame.length > H2_MAX_HEADER_BLOCK) {
+      return h2_error(H2Err::enhance_your_calm);
+    }
+    block.append(frame.payload.data(), frame.length);
+    if (frame.flags & H2_END_HEADERS) {
+      return on_header_block();
+    }
+    return H2Result();
+  case H2Type::settings:
+    return on_settings(frame);
+  case H2Type::ping:
+    return on_ping(frame);
+  case H2Type::window_update:
+    return on_window_update(frame);
+  case H2Type::rst_stream:
+    return on_rst_stream(frame);
+  case H2Type::goaway:
+    goaway = true;
+    return H2Result();
+  case H2Type::push_promise:
+    // only servers push
+    return h2_error(H2Err::protocol_error);
+  default:
+    // PRIORITY is advisory and unknown frames are ignored
+    return H2Result();
+  }
+}
+
+/*
+ * Strip the padding of DATA and HEADERS frames.
+ * Returns false if the padding is longer than the payload.
+ */
+static bool unpad(const H2Frame &frame, const char *&data, size_t &length) {
+  data = frame.payload.data();
+  length = frame.length;
+
+  if (frame.flags & H2_PADDED) {
+    if (length < 1 || (uint8_t)data[0] >= length) {
+      return false;
+    }
+    length -= 1 + (uint8_t)data[0];
+    ++data;
+  }
+  return true;
+}
+
+H2Result H2Session::on_data(const H2Frame &frame) {
+  const char *data;
+  size_t length;
+  if (!frame.stream || !unpad(frame, data, length)) {
+    return h2_error(H2Err::protocol_error);
+  }
+
+  std::shared_ptr<Stream> stream;
+  {
+    std::lock_guard<std::mutex> lock{mutex};
+    if (frame.stream > last_stream) {
+      return h2_error(H2Err::protocol_error);
+    }
+    auto it = streams.find(frame.stream);
+    if (it != streams.end() && !it->second->complete) {
+      stream = it->second;
+    }
+  }
+
+  // the windows count the padding too
+  if (frame.length > recv_window) {
+    return h2_error(H2Err::flow_control_error);
+  }
+  recv_window -= frame.length;
+
+  // the connection window is given back as the frame is consumed: buffered
+  // into its stream, or dropped
+  if (frame.length) {
+    char increment[4];
+    write_u32(increment, frame.length);
+    auto err = send_frame(H2Type::window_update, 0, 0, increment, 4);
+    if (err.is_err()) {
+      return err;
+    }
+    recv_window += frame.length;
+  }
+
+  if (!stream) {
+    return send_reset(frame.stream, H2Err::stream_closed);
+  }
+
+  std::vector<char> &content = stream->ctx.req.content;
+  if (frame.length > stream->recv_window) {
+    std::lock_guard<std::mutex> lock{mutex};
+    streams.erase(frame.stream);
+    return send_reset(frame.stream, H2Err::flow_control_error);
+  }
+  stream->recv_window -= frame.length;
+  if (content.size() + length > H2_MAX_BODY) {
+    return reject_body(*stream);
+  }
+  content.insert(content.end(), data, data + length);
+
+  if (frame.flags & H2_END_STREAM) {
+    stream->complete = true;
+    dispatch(std::move(stream));
+    return H2Result();
+  }
+
+  // the stream window is given back as the body is buffered: a body over
+  // H2_MAX_BODY gets its 413 rather than a window that never reopens
+  if (!frame.length) {
+    return H2Result();
+  }
+  char increment[4];
+  write_u32(increment, frame.length);
+  stream->recv_window += frame.length;
+  return send_frame(H2Type::window_update, 0, frame.stream, increment, 4);
+}
+
+// a body over H2_MAX_BODY: answered with 413 before the rest of it arrives,
+// which the client is told not to send
+H2Result H2Session::reject_body(Stream &stream) {
+  {
+    std::lock_guard<std::mutex> lock{mutex};
+    streams.erase(stream.id);
+  }
+  stream.ctx.req.content.clear();
+  stream.ctx.resp.status = "413";
+  stream.ctx.resp.headers["Content-Length"] = "0";
+  // on error, the connection is gone or about to be
+  (void)send_response(stream);
+  return send_reset(stream.id, H2Err::no_error);
+}
+
+H2Result H2Session::on_headers(const H2Frame &frame) {
+  const char *data;
+  size_t length;
+  if (!frame.stream || !(frame.stream & 1) || !unpad(frame, data, length)) {
+    return h2_error(H2Err::protocol_error);
+  }
+
+  if (frame.flags & H2_PRIORITY) {
+    if (length < 5) {
+      return h2_error(H2Err::protocol_error);
+    }
+    data += 5;
+    length -= 5;
+  }
+
+  {
+    std::lock_guard<std::mutex> lock{mutex};
+    if (frame.stream <= last_stream) {
+      // trailers are only valid on a stream still sending its request
+      auto it = streams.find(frame.stream);
+      if (it == streams.end() || it->second->complete) {
+        return h2_error(H2Err::stream_closed);
+      }
+    }
+  }
+
+  block.assign(data, length);
+  block_stream = frame.stream;
+  block_end_stream = frame.flags & H2_END_STREAM;
+
+  if (frame.flags & H2_END_HEADERS) {
+    return on_header_block();
+  }
+  return H2Result();
+}
+
+H2Result H2Session::on_header_block() {
+  uint32_t id = block_stream;
+  bool end_stream = block_end_stream;
+  block_stream = 0;
+
+  // the block has to be decoded even if the stream is refused, to keep the
+  // table of the decoder in sync
+  HeaderList fields;
+  auto err = decoder.decode(block.data(), block.size(), fields);
+  block.clear();
+  if (err.is_err()) {
+    return err;
+  }
+
+  std::shared_ptr<Stream> stream;
+  {
+    std::lock_guard<std::mutex> lock{mutex};
+    if (id <= last_stream) {
+      // trailers: the fields are dropped
+      if (!end_stream) {
+        return h2_error(H2Err::protocol_error);
+      }
+      stream = streams[id];
+    } else {
+      last_stream = id;
+      // no new streams once the client has sent GOAWAY
+      if (goaway || streams.size() >= H2_MAX_CONCURRENT_STREAMS) {
+        stream = nullptr;
+      } else {
+        stream = std::make_shared<Stream>(id, ctx, initial_window);
+      }
+    }
+  }
+
+  if (!stream) {
+    return send_reset(id, H2Err::refused_stream);
+  }
+
+  if (!stream->complete && stream->ctx.req.method.empty()) {
+    if (!build_request(fields, stream->ctx.req)) {
+      return send_reset(id, H2Err::protocol_error);
+    }
+    std::lock_guard<std::mutex> lock{mutex};
+    streams.emplace(id, stream);
+  }
+
+  if (end_stream) {
+    stream->complete = true;
+    dispatch(std::move(stream));
+  }
+  return H2Result();
+}
+
+H2Result H2Session::on_settings(const H2Frame &frame) {
+  if (frame.stream) {
+    return h2_error(H2Err::protocol_error);
+  }
+  if (frame.flags & H2_ACK) {
+    return frame.length ? h2_error(H2Err::frame_size_error) : H2Result();
+  }
+
+  auto err = apply_settings(frame.payload.data(), frame.length);
+  if (err.is_err()) {
+    return err;
+  }
+  return send_frame(H2Type::settings, H2_ACK, 0, nullptr, 0);
+}
+
+H2Result H2Session::on_ping(const H2Frame &frame) {
+  if (frame.stream) {
+    return h2_error(H2Err::protocol_error);
+  }
+  if (frame.length != 8) {
+    return h2_error(H2Err::frame_size_error);
+  }
+  if (frame.flags & H2_ACK) {
+    return H2Result();
+  }
+  return send_frame(H2Type::ping, H2_ACK, 0, frame.payload.data(), 8);
+}
+
+H2Result H2Session::on_window_update(const H2Frame &frame) {
+  if (frame.length != 4) {
+    return h2_error(H2Err::frame_size_error);
+  }
+  uint32_t increment = read_u32(frame.payload.data()) & 0x7fffffff;
+
+  if (!frame.stream) {
+    if (!increment) {
+      return h2_error(H2Err::protocol_error);
+    }
+    std::lock_guard<std::mutex> lock{mutex};
+    send_window += increment;
+    if (send_window > H2_MAX_WINDOW) {
+      return h2_error(H2Err::flow_control_error);
+    }
+    cv.notify_all();
+    return H2Result();
+  }
+
+  H2Err err = H2Err::no_error;
+  {
+    std::lock_guard<std::mutex> lock{mutex};
+    auto it = streams.find(frame.stream);
+    if (it == streams.end()) {
+      // the stream may have just been closed on our side
+      return H2Result();
+    }
+
+    Stream &stream = *it->second;
+    stream.send_window += increment;
+    if (!increment) {
+      err = H2Err::protocol_error;
+    } else if (stream.send_window > H2_MAX_WINDOW) {
+      err = H2Err::flow_control_error;
+    }
+    stream.reset = err != H2Err::no_error;
+    cv.notify_all();
+  }
+
+  if (err != H2Err::no_error) {
+    return send_reset(frame.stream, err);
+  }
+  return H2Result();
+}
+
+H2Result H2Session::on_rst_stream(const H2Frame &frame) {
+  if (frame.length != 4) {
+    return h2_error(H2Err::frame_size_error);
+  }
+
+  std::lock_guard<std::mutex> lock{mutex};
+  if (!frame.stream || frame.stream > last_stream) {
+    return h2_error(H2Err::protocol_error);
+  }
+  auto it = streams.find(frame.stream);
+  if (it != streams.end()) {
+    it->second->reset = true;
+    cv.notify_all();
+  }
+  return H2Result();
+}
+
+void H2Session::dispatch(std::shared_ptr<Stream> stream) {
+  {
+    std::lock_guard<std::mutex> lock{mutex};
+    ++active;
+  }
+
+  try {
+    std::thread t{&H2Session::respond, this, stream};
+    t.detach();
+  } catch (const std::system_error &) {
+    {
+      std::lock_guard<std::mutex> lock{mutex};
+      streams.erase(stream->id);
+      --active;
+    }
+    (void)send_reset(stream->id, H2Err::refused_stream);
+  }
+}
+
+void H2Session::respond(std::shared_ptr<Stream> stream) {
+  next.next(stream->ctx);
+  // on error, the stream is already reset or the connection is gone
+  (void)send_response(*stream);
+
+  // nothing in this object may be touched once active reaches 0
+  std::lock_guard<std::mutex> lock{mutex};
+  streams.erase(stream->id);
+  --active;
+  cv.notify_all();
+}
+
+H2Result H2Session::send_response(Stream &stream) {
+  Context &c = stream.ctx;
+
+  const std::string *status;
+  const std::map<std::string, std::string> *headers;
+  const char *body;
+  size_t body_size;
+
+  if (c.prepared) {
+    status = &c.prepared->status();
+    headers = &c.prepared->headers();
+    body = c.prepared->body();
+    body_size = c.prepared->body_size();
+  } else if (!c.resp.headers.empty()) {
+    status = &c.resp.status;
+    headers = &c.resp.headers;
+    body = c.resp.content.data();
+    body_size = c.resp.content.size();
+  } else {
+    // HTTP/1 closes the connection without a response
+    return send_reset(stream.id, H2Err::internal_error);
+  }
+
+  HeaderList fields;
+  fields.emplace_back(":status", status->substr(0, status->find(' ')));
+
+  for (const auto &[key, value] : c.prefix.entries()) {
+    if (!headers->count(key)) {
+      fields.emplace_back(lowercase(key), value);
+    }
+  }
+  if (c.prefix.has_date() && !headers->count("Date")) {
+    // "Date:<value>\r\n"
+    auto line = DateCache::instance().get();
+    fields.emplace_back("date", line->substr(5, line->size() - 7));
+  }
+
+  bool has_length = false;
+  for (const auto &[key, value] : *headers) {
+    std::string name = lowercase(key);
+    if (connection_specific(name)) {
+      continue;
+    }
+    if (name == "content-length") {
+      if (body_size) {
+        continue;
+      }
+      has_length = true;
+    }
+    fields.emplace_back(std::move(name), value);
+  }
+  if (body_size && !has_length) {
+    fields.emplace_back("content-length", std::to_string(body_size));
+  }
+
+  if (c.req.method == "HEAD") {
+    body_size = 0;
+  }
+
+  {
+    std::lock_guard<std::mutex> lock{write_mutex};
+
+    // checked before encoding: an encoded block changes the HPACK table,
+    // so it must be sent
+    uint32_t frame_size;
+    {
+      std::lock_guard<std::mutex> state_lock{mutex};
+      if (stream.reset || closed) {
+        return h2_error(H2Err::cancel);
+      }
+      frame_size = max_frame_size;
+    }
+
+    std::string fragment;
+    encoder.encode(fields, fragment);
+
+    // a block larger than a frame continues in CONTINUATION frames
+    H2Type type = H2Type::headers;
+    uint8_t flags = body_size ? 0 : H2_END_STREAM;
+    size_t offset = 0;
+    csr::Result<size_t, server_error_t> write_result =
+        csr::Result<size_t, server_error_t>::Ok(0);
+    do {
+      size_t length = std::min(fragment.size() - offset, (size_t)frame_size);
+      if (offset + length == fragment.size()) {
+        flags |= H2_END_HEADERS;
+      }
+      write_result = write_frame(writer, type, flags, stream.id,
+                                 fragment.data() + offset, length);
+      type = H2Type::continuation;
+      flags = 0;
+      offset += length;
+    } while (write_result.is_ok() && offset < fragment.size());
+
+    if (write_result.is_ok()) {
+      write_result = writer.flush();
+    }
+    if (write_result.is_err()) {
+      return H2Result::Err(std::move(write_result.unwrap_err()));
+    }
+  }
+
+  return send_data(stream, body, body_size);
+}
+
+H2Result H2Session::send_data(Stream &stream, const char *data,
+                              size_t length) {
+  while (length) {
+    size_t size;
+    {
+      std::unique_lock<std::mutex> lock{mutex};
+      cv.wait(lock, [this, &stream] {
+        return closed || stream.reset ||
+               (send_window > 0 && stream.send_window > 0);
+      });
+      if (closed || stream.reset) {
+        return h2_error(H2Err::cancel);
+      }
+
+      size = std::min(length, (size_t)max_frame_size);
+      size = std::min(size, (size_t)std::min(send_window, stream.send_window));
+      send_window -= (int64_t)size;
+      stream.send_window -= (int64_t)size;
+    }
+
+    length -= size;
+    auto err = send_frame(H2Type::data, length ? 0 : H2_END_STREAM, stream.id,
+                          data, size);
+    if (err.is_err()) {
+      return err;
+    }
+    data += size;
+  }
+
+  return H2Result();
+}
+
+void H2Session::run(const char *preface) {
+  char settings[12];
+  write_u16(settings, (uint16_t)H2Setting::max_concurrent_streams);
+  write_u32(settings + 2, H2_MAX_CONCURRENT_STREAMS);
+  write_u16(settings + 6, (uint16_t)H2Setting::max_header_list_size);
+  write_u32(settings + 8, (uint32_t)HPACK_MAX_HEADER_LIST);
+
+  // the server preface is a SETTINGS frame
+  auto err = send_frame(H2Type::settings, 0, 0, settings, sizeof(settings));
+
+  if (err.is_ok()) {
+    size_t length = strlen(preface);
+    std::string received(length, 0);
+    auto read_result = ctx.reader.read_exact(received.data(), length);
+    if (read_result.is_err() || read_result.unwrap() != length ||
+        received != preface) {
+      err = h2_error(H2Err::protocol_error);
+    }
+  }
+
+  if (err.is_ok()) {
+    // the request of an upgrade
+    std::shared_ptr<Stream> stream;
+    {
+      std::lock_guard<std::mutex> lock{mutex};
+      auto it = streams.find(1);
+      if (it != streams.end()) {
+        stream = it->second;
+      }
+    }
+    if (stream) {
+      dispatch(std::move(stream));
+    }
+  }
+
+  H2Frame frame;
+  while (err.is_ok()) {
+    // after GOAWAY, the connection lasts as long as its streams: their
+    // bodies and window updates are still read
+    if (goaway) {
+      std::lock_guard<std::mutex> lock{mutex};
+      if (streams.empty()) {
+        break;
+      }
+    }
+    auto read_result = frame.read(ctx.reader, H2_DEFAULT_FRAME_SIZE);
+    if (read_result.is_err()) {
+      err = H2Result::Err(std::move(read_result.unwrap_err()));
+    } else if (!read_result.unwrap()) {
+      break;
+    } else {
+      err = handle(frame);
+    }
+  }
+
+  // connection error: tell the client before closing
+  if (err.is_err() && err.unwrap_err().category() == h2_category()) {
+    (void)send_goaway((H2Err)err.unwrap_err().value());
+  }
+
+  // wake up the handlers waiting for a window and wait for all of them
+  std::unique_lock<std::mutex> lock{mutex};
+  closed = true;
+  cv.notify_all();
+  cv.wait(lock, [this] { return !active; });
+}
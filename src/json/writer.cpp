@@ -0,0 +1,222 @@
+#include "json/writer.h"
+#include <cmath>
+#include <cstring>
+#include <system_error>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+static const char HEX[] = "0123456789abcdef";
+
+static inline bool needs_escape(unsigned char c) {
+  return c < 0x20 || c == '"' || c == '\\';
+}
+
+// length of the prefix of data that is copied as it is
+static size_t plain_prefix(const char *data, size_t size) {
+  size_t i = 0;
+
+#if defined(__SSE2__)
+  const __m128i quote = _mm_set1_epi8('"');
+  const __m128i backslash = _mm_set1_epi8('\\');
+  const __m128i control = _mm_set1_epi8(0x1f);
+  for (; i + 16 <= size; i += 16) {
+    __m128i v = _mm_loadu_si128((const __m128i *)(data + i));
+    // max(v, 0x1f) == 0x1f exactly for the bytes below 0x20
+    __m128i hit = _mm_or_si128(
+        _mm_or_si128(_mm_cmpeq_epi8(v, quote), _mm_cmpeq_epi8(v, backslash)),
+        _mm_cmpeq_epi8(_mm_max_epu8(v, control), control));
+    int mask = _mm_movemask_epi8(hit);
+    if (mask) {
+      return i + (size_t)__builtin_ctz((unsigned)mask);
+    }
+  }
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+  const uint8x16_t quote = vdupq_n_u8('"');
+  const uint8x16_t backslash = vdupq_n_u8('\\');
+  const uint8x16_t control = vdupq_n_u8(0x20);
+  for (; i + 16 <= size; i += 16) {
+    uint8x16_t v = vld1q_u8((const uint8_t *)(data + i));
+    uint8x16_t hit =
+        vorrq_u8(vorrq_u8(vceqq_u8(v, quote), vceqq_u8(v, backslash)),
+                 vcltq_u8(v, control));
+    if (vmaxvq_u8(hit)) {
+      break;
+    }
+  }
+#endif
+
+  for (; i < size; ++i) {
+    if (needs_escape((unsigned char)data[i])) {
+      break;
+    }
+  }
+  return i;
+}
+
+JsonWriter::JsonWriter(Response &resp)
+    : out(resp.content), empty(), object(), depth(0), after_key(false) {
+  out.clear();
+  resp.headers["Content-Type"] = "application/json";
+}
+
+void JsonWriter::separate() {
+  if (after_key) {
+    after_key = false;
+    return;
+  }
+  if (depth == 0) {
+    return;
+  }
+  bool &first = empty[depth - 1];
+  if (!first) {
+    out.push_back(',');
+  }
+  first = false;
+}
+
+void JsonWriter::put(const char *data, size_t size) {
+  out.insert(out.end(), data, data + size);
+}
+
+void JsonWriter::quoted(std::string_view s) {
+  out.push_back('"');
+  const char *p = s.data();
+  size_t size = s.size();
+  while (size) {
+    size_t run = plain_prefix(p, size);
+    put(p, run);
+    if (run == size) {
+      break;
+    }
+
+    unsigned char c = (unsigned char)p[run];
+    char escaped[6] = {'\\', 0, 0, 0, 0, 0};
+    size_t length = 2;
+    switch (c) {
+    case '"':
+    case '\\':
+      escaped[1] = (char)c;
+      break;
+    case '\n':
+      escaped[1] = 'n';
+      break;
+    case '\r':
+      escaped[1] = 'r';
+      break;
+    case '\t':
+      escaped[1] = 't';
+      break;
+    case '\b':
+      escaped[1] = 'b';
+      break;
+    case '\f':
+      escaped[1] = 'f';
+      break;
+    default:
+      memcpy(escaped + 1, "u00", 3);
+      escaped[4] = HEX[c >> 4];
+      escaped[5] = HEX[c & 0xf];
+      length = 6;
+    }
+    put(escaped, length);
+    p += run + 1;
+    size -= run + 1;
+  }
+  out.push_back('"');
+}
+
+void JsonWriter::open(char c) {
+  if (depth == JSON_MAX_DEPTH) {
+    throw std::system_error(std::make_error_code(std::errc::value_too_large),
+                            "JSON nested too deeply");
+  }
+  separate();
+  out.push_back(c);
+  empty[depth] = true;
+  object[depth] = c == '{';
+  ++depth;
+}
+
+void JsonWriter::close(char c) {
+  if (depth == 0 || object[depth - 1] != (c == '}') || after_key) {
+    throw std::system_error(std::make_error_code(std::errc::invalid_argument),
+                            "unbalanced JSON container");
+  }
+  out.push_back(c);
+  --depth;
+}
+
+JsonWriter &JsonWriter::begin_object() {
+  open('{');
+  return *this;
+}
+
+JsonWriter &JsonWriter::end_object() {
+  close('}');
+  return *this;
+}
+
+JsonWriter &JsonWriter::begin_array() {
+  open('[');
+  return *this;
+}
+
+JsonWriter &JsonWriter::end_array() {
+  close(']');
+  return *this;
+}
+
+JsonWriter &JsonWriter::key(std::string_view name) {
+  separate();
+  quoted(name);
+  out.push_back(':');
+  after_key = true;
+  return *this;
+}
+
+JsonWriter &JsonWriter::value(std::string_view s) {
+  separate();
+  quoted(s);
+  return *this;
+}
+
+JsonWriter &JsonWriter::value(const char *s) {
+  return value(std::string_view(s));
+}
+
+JsonWriter &JsonWriter::value(bool b) {
+  separate();
+  if (b) {
+    put("true", 4);
+  } else {
+    put("false", 5);
+  }
+  return *this;
+}
+
+JsonWriter &JsonWriter::value(double d) {
+  if (!std::isfinite(d)) {
+    return null();
+  }
+  separate();
+  char buf[32];
+  auto result = std::to_chars(buf, buf + sizeof(buf), d);
+  put(buf, (size_t)(result.ptr - buf));
+  return *this;
+}
+
+JsonWriter &JsonWriter::null() {
+  separate();
+  put("null", 4);
+  return *this;
+}
+
+JsonWriter &JsonWriter::raw(std::string_view json) {
+  separate();
+  put(json.data(), json.size());
+  return *this;
+}
@@ -0,0 +1,77 @@
+#include "middleware/accesslog/accesslog.h"
+#include "http/preparedresponse.h"
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+
+#if defined(__APPLE__) || defined(__linux__)
+#include <netinet/in.h>
+#endif
+
+static uint8_t copy_field(char *dst, size_t max, const std::string &src) {
+  size_t size = std::min(max, src.size());
+  memcpy(dst, src.data(), size);
+  return (uint8_t)size;
+}
+
+// the leading digits of a status such as "404" or "404 Not Found"
+static uint16_t status_code(const std::string &status) {
+  unsigned code = 0;
+  for (size_t i = 0; i < status.size() && i < 3; ++i) {
+    if (status[i] < '0' || status[i] > '9') {
+      break;
+    }
+    code = code * 10 + (unsigned)(status[i] - '0');
+  }
+  return (uint16_t)code;
+}
+
+AccessLog::AccessLog(const AccessLogOptions &options)
+    : logger(std::make_shared<AccessLogger>(options)) {}
+
+void AccessLog::operator()(Context &ctx, const Task &next) {
+  auto received = std::chrono::system_clock::now();
+  auto start = std::chrono::steady_clock::now();
+  next.next(ctx);
+  auto latency = std::chrono::duration_cast<std::chrono::microseconds>(
+                     std::chrono::steady_clock::now() - start)
+                     .count();
+
+  AccessEntry *entry = logger->reserve();
+  if (!entry) {
+    return;
+  }
+
+  entry->time = std::chrono::duration_cast<std::chrono::microseconds>(
+                    received.time_since_epoch())
+                    .count();
+  entry->latency = (uint32_t)std::min<int64_t>(latency, (int64_t)UINT32_MAX);
+  if (ctx.prepared) {
+    entry->status = status_code(ctx.prepared->status());
+    entry->bytes = ctx.prepared->body_size();
+  } else {
+    entry->status = status_code(ctx.resp.status);
+    entry->bytes = ctx.resp.content.size();
+  }
+
+  entry->family = 0;
+  if (ctx.peer.ss_family == AF_INET) {
+    const auto *addr = (const struct sockaddr_in *)&ctx.peer;
+    entry->family = AF_INET;
+    memcpy(entry->addr, &addr->sin_addr, sizeof(addr->sin_addr));
+  } else if (ctx.peer.ss_family == AF_INET6) {
+    const auto *addr = (const struct sockaddr_in6 *)&ctx.peer;
+    entry->family = AF_INET6;
+    memcpy(entry->addr, &addr->sin6_addr, sizeof(addr->sin6_addr));
+  }
+
+  entry->method_size =
+      copy_field(entry->method, ACCESS_METHOD_MAX, ctx.req.method);
+  entry->version_size =
+      copy_field(entry->version, ACCESS_VERSION_MAX, ctx.req.version);
+  entry->target_size =
+      copy_field(entry->target, ACCESS_TARGET_MAX, ctx.req.fullpath);
+  logger->commit();
+}
+
+uint64_t AccessLog::dropped() const { return logger->dropped(); }
@@ -0,0 +1,155 @@
+#include "middleware/cache/cache.h"
+#include "http/headers.h"
+#include <cstdlib>
+
+// statuses cacheable by default (RFC 9110 15.1)
+static const char *const CACHEABLE[] = {"200", "203", "204", "300",
+                                        "301", "404", "410"};
+
+// the value of a directive such as max-age=60 in a Cache-Control list
+static bool directive(const std::string &control, const char *name,
+                      long &value) {
+  size_t start = 0;
+  while (start < control.size()) {
+    size_t end = control.find(',', start);
+    if (end == std::string::npos) {
+      end = control.size();
+    }
+    size_t first = control.find_first_not_of(" \t", start);
+    size_t eq = control.find('=', first);
+    if (first < end && eq < end &&
+        iequals(control.substr(first, eq - first), name)) {
+      size_t digits = eq + 1 + (control[eq + 1] == '"');
+      value = strtol(control.c_str() + digits, nullptr, 10);
+      return true;
+    }
+    start = end + 1;
+  }
+  return false;
+}
+
+Cache::Cache(const CacheOptions &options)
+    : options(options), cache(std::make_shared<ResponseCache>(
+                            options.shards, options.capacity)) {}
+
+std::string Cache::key(const Request &req) const {
+  std::string key = req.method + " " + req.fullpath;
+  for (const auto &name : options.vary) {
+    const std::string *value = find_header(req.headers, name.c_str());
+    key += '\n';
+    key += name;
+    key += ':';
+    if (value) {
+      key += *value;
+    }
+  }
+  return key;
+}
+
+std::shared_ptr<const PreparedResponse>
+Cache::store(Context &ctx, std::chrono::milliseconds &ttl) const {
+  // upgraded, or written by the middleware itself
+  if (ctx.takeover || (!ctx.prepared && ctx.resp.headers.empty())) {
+    return nullptr;
+  }
+
+  const std::string &status =
+      ctx.prepared ? ctx.prepared->status() : ctx.resp.status;
+  const auto &headers =
+      ctx.prepared ? ctx.prepared->headers() : ctx.resp.headers;
+  size_t body_size =
+      ctx.prepared ? ctx.prepared->body_size() : ctx.resp.content.size();
+
+  bool cacheable = false;
+  for (const char *code : CACHEABLE) {
+    cacheable = cacheable || status.compare(0, 3, code) == 0;
+  }
+  if (!cacheable || body_size > options.max_body ||
+      find_header(headers, "Set-Cookie")) {
+    return nullptr;
+  }
+
+  ttl = std::chrono::milliseconds(options.ttl);
+  const std::string *control = find_header(headers, "Cache-Control");
+  if (control) {
+    if (has_token(*control, "no-store") || has_token(*control, "no-cache") ||
+        has_token(*control, "private")) {
+      return nullptr;
+    }
+    long seconds;
+    if (directive(*control, "s-maxage", seconds) ||
+        directive(*control, "max-age", seconds)) {
+      ttl = std::chrono::seconds(seconds);
+    }
+  }
+  if (ttl.count() <= 0) {
+    return nullptr;
+  }
+
+  // the key only tells apart the headers in options.vary
+  const std::string *vary = find_header(headers, "Vary");
+  if (vary) {
+    size_t start = 0;
+    while (start < vary->size()) {
+      size_t end = vary->find(',', start);
+      if (end == std::string::npos) {
+        end = vary->size();
+      }
+      size_t first = vary->find_first_not_of(" \t", start);
+      size_t last = vary->find_last_not_of(" \t", end - 1);
+      start = end + 1;
+      if (first >= end || last < first) {
+        continue;
+      }
+      std::string name = vary->substr(first, last - first + 1);
+      bool keyed = false;
+      for (const auto &header : options.vary) {
+        keyed = keyed || iequals(name, header.c_str());
+      }
+      if (!keyed) {
+        return nullptr;
+      }
+    }
+  }
+
+  if (ctx.prepared) {
+    return ctx.prepared;
+  }
+  return PreparedResponse::build(ctx.resp);
+}
+
+void Cache::operator()(Context &ctx, const Task &next) {
+  if (ctx.req.method != "GET" && ctx.req.method != "HEAD") {
+    next.next(ctx);
+    return;
+  }
+
+  const std::string *control = find_header(ctx.req.headers, "Cache-Control");
+  if (control && has_token(*control, "no-store")) {
+    next.next(ctx);
+    return;
+  }
+
+  std::string k = key(ctx.req);
+  bool leader = false;
+  std::shared_ptr<const PreparedResponse> response;
+  if (control && has_token(*control, "no-cache")) {
+    // skip the lookup, but store the fresh response
+    leader = true;
+  } else {
+    response = cache->acquire(k, leader,
+                              std::chrono::milliseconds(options.wait));
+  }
+  if (response) {
+    ctx.send(std::move(response));
+    return;
+  }
+
+  next.next(ctx);
+  if (leader) {
+    std::chrono::milliseconds ttl{0};
+    cache->complete(k, store(ctx, ttl), ttl);
+  }
+}
+
+CacheStats Cache::stats() const { return cache->stats(); }
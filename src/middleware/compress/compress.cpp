@@ -0,0 +1,299 @@
+#include "middleware/compress/compress.h"
+#include "http/headers.h"
+#include "http/preparedresponse.h"
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+
+// body bytes compressed at once by write_pieces
+constexpr size_t COMPRESS_PIECE = 65536;
+
+// the coding with the highest q-value in Accept-Encoding (gzip on a tie);
+// false if neither is acceptable
+static bool negotiate(const std::string &accept, Coding &coding) {
+  double gzip = -1, deflate = -1, any = -1;
+
+  size_t start = 0;
+  while (start < accept.size()) {
+    size_t end = accept.find(',', start);
+    if (end == std::string::npos) {
+      end = accept.size();
+    }
+    std::string item = accept.substr(start, end - start);
+    start = end + 1;
+
+    size_t semi = item.find(';');
+    std::string name = item.substr(0, semi);
+    size_t first = name.find_first_not_of(" \t");
+    size_t last = name.find_last_not_of(" \t");
+    if (first == std::string::npos) {
+      continue;
+    }
+    name = name.substr(first, last - first + 1);
+
+    double q = 1;
+    if (semi != std::string::npos) {
+      size_t pos = item.find("q=", semi);
+      if (pos != std::string::npos) {
+        q = strtod(item.c_str() + pos + 2, nullptr);
+      }
+    }
+
+    if (iequals(name, "gzip") || iequals(name, "x-gzip")) {
+      gzip = q;
+    } else if (iequals(name, "deflate")) {
+      deflate = q;
+    } else if (name == "*") {
+      any = q;
+    }
+  }
+
+  if (gzip < 0) {
+    gzip = any;
+  }
+  if (deflate < 0) {
+    deflate = any;
+  }
+  if (gzip <= 0 && deflate <= 0) {
+    return false;
+  }
+  coding = gzip >= deflate ? Coding::gzip : Coding::deflate;
+  return true;
+}
+
+static void add_vary(std::map<std::string, std::string> &headers) {
+  std::string &vary = headers["Vary"];
+  if (vary.empty()) {
+    vary = "Accept-Encoding";
+  } else if (vary != "*" && !has_token(vary, "Accept-Encoding")) {
+    vary += ", Accept-Encoding";
+  }
+}
+
+// a strong validator no longer matches once the body is encoded
+static void weaken_etag(std::map<std::string, std::string> &headers) {
+  auto it = headers.find("ETag");
+  if (it != headers.end() && it->second.compare(0, 2, "W/")) {
+    it->second = "W/" + it->second;
+  }
+}
+
+static uint64_t fnv1a(const char *data, size_t size) {
+  uint64_t h = 14695981039346656037ULL;
+  for (size_t i = 0; i < size; ++i) {
+    h ^= (unsigned char)data[i];
+    h *= 1099511628211ULL;
+  }
+  return h;
+}
+
+Compress::Compress(const CompressOptions &options)
+    : options(options),
+      cache(std::make_shared<CompressCache>(options.cache_size)),
+      enabled(Deflater::create(Coding::gzip, options.level).is_ok()) {}
+
+// HEAD is compressed too, for its headers to be the ones of GET
+bool Compress::compressible(
+    const std::string &status,
+    const std::map<std::string, std::string> &headers) const {
+  if (status.empty() || status[0] != '2' ||
+      status.compare(0, 3, "204") == 0 || status.compare(0, 3, "206") == 0) {
+    return false;
+  }
+  if (find_header(headers, "Content-Encoding")) {
+    return false;
+  }
+  const std::string *control = find_header(headers, "Cache-Control");
+  if (control && has_token(*control, "no-transform")) {
+    return false;
+  }
+
+  const std::string *type = find_header(headers, "Content-Type");
+  if (!type) {
+    return false;
+  }
+  for (const auto &prefix : options.types) {
+    if (type->size() >= prefix.size() &&
+        iequals(type->substr(0, prefix.size()), prefix.c_str())) {
+      return true;
+    }
+  }
+  return false;
+}
+
+std::string Compress::cache_key(const Request &req, const Response &resp,
+                                Coding coding) const {
+  const auto &headers = resp.headers;
+  const std::string *etag = find_header(headers, "ETag");
+  if (etag) {
+    return std::string("e ") + coding_name(coding) + " " + req.fullpath +
+           " " + *etag;
+  }
+  const std::string *control = find_header(headers, "Cache-Control");
+  if (control && has_token(*control, "immutable")) {
+    // told apart by their hash, which costs far less than compressing
+    char hash[64];
+    snprintf(hash, sizeof(hash), " %zu %016llx", resp.content.size(),
+             (unsigned long long)fnv1a(resp.content.data(),
+                                       resp.content.size()));
+    return std::string("i ") + coding_name(coding) + " " + req.fullpath +
+           hash;
+  }
+  return std::string();
+}
+
+std::vector<char> Compress::deflate(const char *data, size_t size,
+                                    Coding coding) const {
+  std::vector<char> out;
+  auto create_ret = Deflater::create(coding, options.level);
+  if (create_ret.is_err()) {
+    return out;
+  }
+  out.reserve(size / 2);
+  if (create_ret.unwrap()->feed(data, size, true, out).is_err() ||
+      out.size() >= size) {
+    out.clear();
+    out.shrink_to_fit();
+  }
+  return out;
+}
+
+void Compress::send_prepared(Context &ctx, bool encode, Coding coding) const {
+  const PreparedResponse &source = *ctx.prepared;
+  char address[32];
+  snprintf(address, sizeof(address), "%p", (const void *)&source);
+  std::string key = std::string("p ") +
+                    (encode ? coding_name(coding) : "identity") + " " +
+                    address;
+
+  auto body = cache->get(key);
+  if (!body || body->source.lock() != ctx.prepared) {
+    auto entry = std::make_shared<CompressedBody>();
+    if (encode) {
+      entry->data = deflate(source.body(), source.body_size(), coding);
+    }
+    entry->source = ctx.prepared;
+
+    // either variant depends on Accept-Encoding
+    Response resp;
+    resp.status = source.status();
+    resp.headers = source.headers();
+    add_vary(resp.headers);
+    if (!entry->data.empty()) {
+      resp.headers["Content-Encoding"] = coding_name(coding);
+      resp.headers["Content-Length"] = std::to_string(entry->data.size());
+      weaken_etag(resp.headers);
+      resp.content = std::move(entry->data);
+    } else {
+      resp.content.assign(source.body(), source.body() + source.body_size());
+    }
+    // the bytes are in the prepared response
+    entry->prepared = PreparedResponse::build(resp);
+    entry->data.clear();
+    entry->data.shrink_to_fit();
+    body = entry;
+    cache->put(key, body);
+  }
+
+  ctx.send(body->prepared);
+}
+
+void Compress::write_pieces(Context &ctx, Coding coding) const {
+  auto create_ret = Deflater::create(coding, options.level);
+  if (create_ret.is_err()) {
+    return;
+  }
+  Deflater &deflater = *create_ret.unwrap();
+
+  // the length is not known in advance: the body ends with the connection
+  ctx.resp.headers.erase("Content-Length");
+  ctx.resp.headers["Content-Encoding"] = coding_name(coding);
+  weaken_etag(ctx.resp.headers);
+
+  Writer writer{ctx.fd, ctx.bufsize, ctx.transport};
+  auto write_ret = ctx.write_head(writer);
+  std::vector<char> out;
+  // nothing to compress for HEAD: the body is left out
+  const std::vector<char> &content = ctx.resp.content;
+  size_t size = ctx.req.method == "HEAD" ? 0 : content.size();
+  for (size_t sent = 0; write_ret.is_ok() && sent < size;) {
+    size_t piece = std::min(COMPRESS_PIECE, size - sent);
+    out.clear();
+    bool last = sent + piece == size;
+    if (deflater.feed(content.data() + sent, piece, last, out).is_err()) {
+      break;
+    }
+    write_ret = writer.write(out);
+    sent += piece;
+  }
+  if (write_ret.is_ok()) {
+    (void)writer.flush();
+  }
+
+  // the response has been written: Context::write has nothing left to do
+  ctx.resp.headers.clear();
+}
+
+void Compress::operator()(Context &ctx, const Task &next) {
+  next.next(ctx);
+  if (!enabled) {
+    return;
+  }
+
+  const std::string *accept = find_header(ctx.req.headers, "Accept-Encoding");
+  Coding coding = Coding::gzip;
+  bool acceptable = accept && negotiate(*accept, coding);
+
+  if (ctx.prepared) {
+    // shared and immutable: both variants are copies with Vary
+    if (ctx.prepared->body_size() >= options.min_size &&
+        compressible(ctx.prepared->status(), ctx.prepared->headers())) {
+      send_prepared(ctx, acceptable, coding);
+    }
+    return;
+  }
+
+  Response &resp = ctx.resp;
+  if (resp.headers.empty() || !compressible(resp.status, resp.headers)) {
+    return;
+  }
+  add_vary(resp.headers);
+  if (!acceptable || resp.content.size() < options.min_size) {
+    return;
+  }
+
+  // a body that does not change is compressed once
+  std::string key = cache_key(ctx.req, resp, coding);
+  if (!key.empty()) {
+    auto body = cache->get(key);
+    if (!body) {
+      auto entry = std::make_shared<CompressedBody>();
+      entry->data = deflate(resp.content.data(), resp.content.size(), coding);
+      body = entry;
+      cache->put(key, body);
+    }
+    if (!body->data.empty()) {
+      resp.content = body->data;
+      resp.headers["Content-Encoding"] = coding_name(coding);
+      resp.headers.erase("Content-Length");
+      weaken_etag(resp.headers);
+    }
+    return;
+  }
+
+  if (resp.content.size() >= options.stream_size &&
+      ctx.req.version != "HTTP/2.0") {
+    write_pieces(ctx, coding);
+    return;
+  }
+
+  std::vector<char> out =
+      deflate(resp.content.data(), resp.content.size(), coding);
+  if (!out.empty()) {
+    resp.content = std::move(out);
+    resp.headers["Content-Encoding"] = coding_name(coding);
+    resp.headers.erase("Content-Length");
+    weaken_etag(resp.headers);
+  }
+}
@@ -0,0 +1,86 @@
+#include "middleware/etag/etag.h"
+#include "hash/xxh64.h"
+#include "http/headers.h"
+#include "http/preparedresponse.h"
+#include <cstdio>
+
+// the opaque-tag of an entity-tag, without W/
+static std::string opaque(const std::string &tag) {
+  return tag.compare(0, 2, "W/") == 0 ? tag.substr(2) : tag;
+}
+
+// weak comparison of etag with the list of If-None-Match (RFC 9110 13.1.2)
+static bool none_match(const std::string &list, const std::string &etag) {
+  std::string wanted = opaque(etag);
+  size_t start = 0;
+  while (start < list.size()) {
+    size_t end = list.find(',', start);
+    if (end == std::string::npos) {
+      end = list.size();
+    }
+    size_t first = list.find_first_not_of(" \t", start);
+    size_t last = list.find_last_not_of(" \t", end - 1);
+    start = end + 1;
+    if (first >= end || last < first) {
+      continue;
+    }
+    std::string tag = list.substr(first, last - first + 1);
+    if (tag == "*" || opaque(tag) == wanted) {
+      return true;
+    }
+  }
+  return false;
+}
+
+void ETag::operator()(Context &ctx, const Task &next) {
+  next.next(ctx);
+
+  if (ctx.req.method != "GET" && ctx.req.method != "HEAD") {
+    return;
+  }
+  const std::string *condition = find_header(ctx.req.headers, "If-None-Match");
+
+  if (ctx.prepared) {
+    const std::string *etag = find_header(ctx.prepared->headers(), "ETag");
+    if (condition && etag && ctx.prepared->status() == "200" &&
+        none_match(*condition, *etag)) {
+      ctx.resp.clear();
+      ctx.resp.status = "304";
+      ctx.resp.headers["ETag"] = *etag;
+      for (const char *name : {"Cache-Control", "Vary", "Expires"}) {
+        const std::string *value = find_header(ctx.prepared->headers(), name);
+        if (value) {
+          ctx.resp.headers[name] = *value;
+        }
+      }
+      ctx.prepared.reset();
+    }
+    return;
+  }
+
+  Response &resp = ctx.resp;
+  if (resp.headers.empty() || resp.status != "200") {
+    return;
+  }
+  const std::string *etag = find_header(resp.headers, "ETag");
+  if (!etag) {
+    // the tag is the one of the representation: a HEAD response without
+    // it (a body left out, or only its Content-Length) gets none rather
+    // than the tag of an empty body
+    if (ctx.req.method == "HEAD" && resp.content.empty()) {
+      return;
+    }
+    char tag[48];
+    snprintf(tag, sizeof(tag), "\"%zx-%016llx\"", resp.content.size(),
+             (unsigned long long)xxh64(resp.content.data(),
+                                       resp.content.size()));
+    etag = &(resp.headers["ETag"] = tag);
+  }
+
+  if (condition && none_match(*condition, *etag)) {
+    // the headers stay: they describe the representation not sent
+    resp.status = "304";
+    resp.content.clear();
+    resp.headers.erase("Content-Length");
+  }
+}
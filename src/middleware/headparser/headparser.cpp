@@ -1,4 +1,5 @@
 #include "middleware/headparser/headparser.h"
+#include "trace/tracer.h"
 #include <sstream>
 
 const char *ws = " \t\n\r\f\v";
@@ -16,33 +17,19 @@ void HeadParser::operator()(Context &ctx, const Task &next) {
 
 csr::Result<std::monostate, server_error_t>
 HeadParser::parse(Context &ctx) const {
+  TraceScope scope(ctx.trace, SpanKind::parse);
   if (limit) {
-    LimitSizeReader reader{ctx.fd, limit};
-
-    auto err = parse_req(ctx, reader);
-    if (err.is_err()) {
-      return err;
-    }
-
-    err = parse_header(ctx, reader);
-    if (err.is_err()) {
-      return err;
-    }
-  } else {
-    Reader reader{ctx.fd};
-
-    auto err = parse_req(ctx, reader);
-    if (err.is_err()) {
-      return err;
-    }
+    ctx.reader.limit(limit);
+  }
 
-    err = parse_header(ctx, reader);
-    if (err.is_err()) {
-      return err;
-    }
+  auto err = parse_req(ctx, ctx.reader);
+  if (err.is_ok()) {
+    err = parse_header(ctx, ctx.reader);
   }
 
-  return csr::Result<std::monostate, server_error_t>();
+  // the limit only applies to the head, not to what follows it
+  ctx.reader.unlimit();
+  return err;
 }
 
 csr::Result<std::monostate, server_error_t>
@@ -51,32 +38,33 @@ HeadParser::parse_req(Context &ctx, Reader &reader) const {
   auto read_result = reader.readline(s);
 
   if (read_result.is_err()) {
-    return csr::Result<std::monostate, std::system_error>::Err(
+    return csr::Result<std::monostate, server_error_t>::Err(
         std::move(read_result.unwrap_err()));
   }
   if (read_result.unwrap() == 0) {
     return csr::Result<std::monostate, server_error_t>::Err(
-        server_error(ServerErr::connection_close_by_client, "parse_req error"));
+        server_error(ServerErr::connection_close_by_client));
   }
 
   std::istringstream is{std::move(s)};
 
   if (!std::getline(is, ctx.req.method, ' ')) {
     return csr::Result<std::monostate, server_error_t>::Err(
-        server_error(ServerErr::invalid_request, "parse_req error"));
+        server_error(ServerErr::invalid_request));
   }
 
   if (!std::getline(is, ctx.req.fullpath, ' ')) {
     return csr::Result<std::monostate, server_error_t>::Err(
-        server_error(ServerErr::invalid_request, "parse_req error"));
+        server_error(ServerErr::invalid_request));
   }
 
   if (!std::getline(is, ctx.req.version, ' ')) {
     return csr::Result<std::monostate, server_error_t>::Err(
-        server_error(ServerErr::invalid_request, "parse_req error"));
+        server_error(ServerErr::invalid_request));
   }
+  trim(ctx.req.version, ws);
 
-  return csr::Result<std::monostate, std::system_error>();
+  return csr::Result<std::monostate, server_error_t>();
 }
 
 csr::Result<std::monostate, server_error_t>
@@ -85,12 +73,12 @@ HeadParser::parse_header(Context &ctx, Reader &reader) const {
   while (true) {
     auto read_result = reader.readline(s);
     if (read_result.is_err()) {
-      return csr::Result<std::monostate, std::system_error>::Err(
+      return csr::Result<std::monostate, server_error_t>::Err(
           std::move(read_result.unwrap_err()));
     }
     if (read_result.unwrap() == 0) {
-      return csr::Result<std::monostate, server_error_t>::Err(server_error(
-          ServerErr::connection_close_by_client, "parse_req error"));
+      return csr::Result<std::monostate, server_error_t>::Err(
+          server_error(ServerErr::connection_close_by_client));
     }
 
     if (s == "\r\n") {
@@ -100,13 +88,13 @@ HeadParser::parse_header(Context &ctx, Reader &reader) const {
     std::istringstream is{std::move(s)};
     if (!std::getline(is, s, ':')) {
       return csr::Result<std::monostate, server_error_t>::Err(
-          server_error(ServerErr::invalid_header, "parse_header error"));
+          server_error(ServerErr::invalid_header));
     }
 
     std::string value;
     if (!std::getline(is, value)) {
       return csr::Result<std::monostate, server_error_t>::Err(
-          server_error(ServerErr::invalid_header, "parse_header error"));
+          server_error(ServerErr::invalid_header));
     }
 
     trim(value, ws);
@@ -116,7 +104,7 @@ HeadParser::parse_header(Context &ctx, Reader &reader) const {
     s.clear();
   }
 
-  return csr::Result<std::monostate, std::system_error>();
+  return csr::Result<std::monostate, server_error_t>();
 }
 
 // trim from end of string (right)
@@ -0,0 +1,97 @@
+#include "middleware/http2/http2.h"
+#include "http/headers.h"
+#include "http2/session.h"
+#include "watchdog/watchdog.h"
+
+static const char SWITCHING_PROTOCOLS[] =
+    "HTTP/1.1 101 Switching Protocols\r\n"
+    "Connection: Upgrade\r\n"
+    "Upgrade: h2c\r\n\r\n";
+
+// decode base64url without padding (RFC 7540 3.2.1)
+static bool decode_base64url(const std::string &in, std::string &out) {
+  uint32_t acc = 0;
+  int bits = 0;
+
+  for (char c : in) {
+    uint32_t v;
+    if (c >= 'A' && c <= 'Z') {
+      v = (uint32_t)(c - 'A');
+    } else if (c >= 'a' && c <= 'z') {
+      v = (uint32_t)(c - 'a' + 26);
+    } else if (c >= '0' && c <= '9') {
+      v = (uint32_t)(c - '0' + 52);
+    } else if (c == '-') {
+      v = 62;
+    } else if (c == '_') {
+      v = 63;
+    } else if (c == '=') {
+      break;
+    } else {
+      return false;
+    }
+
+    acc = acc << 6 | v;
+    bits += 6;
+    if (bits >= 8) {
+      bits -= 8;
+      out.push_back((char)(acc >> bits));
+    }
+  }
+  return true;
+}
+
+bool Http2::upgradable(const Context &ctx, std::string &settings) {
+  const std::string *upgrade = find_header(ctx.req.headers, "Upgrade");
+  const std::string *connection = find_header(ctx.req.headers, "Connection");
+  const std::string *encoded = find_header(ctx.req.headers, "HTTP2-Settings");
+  const std::string *length = find_header(ctx.req.headers, "Content-Length");
+
+  // a request body would have to be read as HTTP/1 first: such requests
+  // are served over HTTP/1 instead (RFC 7540 3.2)
+  if (!upgrade || !connection || !encoded || ctx.req.version != "HTTP/1.1" ||
+      (length && *length != "0") ||
+      find_header(ctx.req.headers, "Transfer-Encoding")) {
+    return false;
+  }
+
+  return has_token(*upgrade, "h2c") && has_token(*connection, "Upgrade") &&
+         has_token(*connection, "HTTP2-Settings") &&
+         decode_base64url(*encoded, settings);
+}
+
+void Http2::operator()(Context &ctx, const Task &next) {
+  // HeadParser has read "PRI * HTTP/2.0\r\n\r\n" as a request without
+  // headers: the rest of the preface follows
+  if (ctx.req.method == "PRI" && ctx.req.fullpath == "*" &&
+      ctx.req.version == "HTTP/2.0") {
+    H2Session session{ctx, next};
+    // the session lasts as long as the connection; its streams are watched
+    WatchPause pause;
+    session.run(H2_PREFACE + 18);
+    return;
+  }
+
+  std::string settings;
+  if (!upgradable(ctx, settings)) {
+    next.next(ctx);
+    return;
+  }
+
+  H2Session session{ctx, next};
+  if (session.upgrade(settings).is_err()) {
+    next.next(ctx);
+    return;
+  }
+
+  Writer writer{ctx.fd, ctx.bufsize, ctx.transport};
+  auto write_result =
+      writer.write(SWITCHING_PROTOCOLS, sizeof(SWITCHING_PROTOCOLS) - 1);
+  if (write_result.is_ok()) {
+    write_result = writer.flush();
+  }
+  if (write_result.is_ok()) {
+    WatchPause pause;
+    session.run(H2_PREFACE);
+  }
+}
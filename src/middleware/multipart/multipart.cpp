@@ -0,0 +1,407 @@
+#include "middleware/multipart/multipart.h"
+#include "http/headers.h"
+#include "multipart/parser.h"
+#include "socket/bufferpool.h"
+#include <cctype>
+#include <cerrno>
+#include <cstdlib>
+#include <vector>
+
+#if defined(__APPLE__) || defined(__linux__)
+#include <fcntl.h>
+#include <unistd.h>
+#elif defined(_WIN32)
+#include <fcntl.h>
+#include <io.h>
+#include <share.h>
+#include <sys/stat.h>
+#endif
+
+// bytes of the body read at once; reads this large bypass the buffer of the
+// connection
+constexpr size_t MULTIPART_READ = 65536;
+// longest chunk size line of a chunked body
+constexpr size_t MULTIPART_LINE_MAX = 1024;
+
+static const char CONTINUE[] = "HTTP/1.1 100 Continue\r\n\r\n";
+
+static server_error_t file_error() {
+  return std::error_code(errno, std::system_category());
+}
+
+// create a file that did not exist in dir, open for writing
+static csr::Result<int, server_error_t> create_temp(const std::string &dir,
+                                                    std::string &path) {
+  path = dir + "/upload-XXXXXX";
+#if defined(__APPLE__) || defined(__linux__)
+  int fd = mkstemp(&path[0]);
+  if (fd == -1) {
+    return csr::Result<int, server_error_t>::Err(file_error());
+  }
+  (void)fcntl(fd, F_SETFD, FD_CLOEXEC);
+#elif defined(_WIN32)
+  int fd = -1;
+  if (_mktemp_s(&path[0], path.size() + 1) ||
+      _sopen_s(&fd, path.c_str(),
+               _O_CREAT | _O_EXCL | _O_WRONLY | _O_BINARY | _O_NOINHERIT,
+               _SH_DENYNO, _S_IREAD | _S_IWRITE)) {
+    return csr::Result<int, server_error_t>::Err(file_error());
+  }
+#endif
+  return csr::Result<int, server_error_t>::Ok(std::move(fd));
+}
+
+static csr::Result<std::monostate, server_error_t>
+write_file(int fd, const char *data, size_t size) {
+  while (size) {
+#if defined(__APPLE__) || defined(__linux__)
+    ssize_t rc = ::write(fd, data, size);
+    if (rc == -1 && errno == EINTR) {
+      continue;
+    }
+#elif defined(_WIN32)
+    int rc = _write(fd, data, size > 1 << 30 ? 1 << 30 : (unsigned)size);
+#endif
+    if (rc <= 0) {
+      return csr::Result<std::monostate, server_error_t>::Err(file_error());
+    }
+    data += rc;
+    size -= (size_t)rc;
+  }
+  return csr::Result<std::monostate, server_error_t>();
+}
+
+static void close_file(int fd) {
+#if defined(__APPLE__) || defined(__linux__)
+  (void)::close(fd);
+#elif defined(_WIN32)
+  (void)_close(fd);
+#endif
+}
+
+static void remove_file(const std::string &path) {
+#if defined(__APPLE__) || defined(__linux__)
+  (void)unlink(path.c_str());
+#elif defined(_WIN32)
+  (void)_unlink(path.c_str());
+#endif
+}
+
+static std::string trim(const std::string &s) {
+  size_t first = s.find_first_not_of(" \t");
+  if (first == std::string::npos) {
+    return std::string();
+  }
+  return s.substr(first, s.find_last_not_of(" \t") - first + 1);
+}
+
+/*
+ * Look up a parameter of a header value such as
+ * 'form-data; name="field"; filename="a.txt"'. Quoted values are unquoted.
+ */
+static bool header_param(const std::string &value, const char *name,
+                         std::string &out) {
+  size_t pos = value.find(';');
+  while (pos != std::string::npos) {
+    size_t eq = value.find('=', pos + 1);
+    if (eq == std::string::npos) {
+      return false;
+    }
+    std::string key = trim(value.substr(pos + 1, eq - pos - 1));
+
+    out.clear();
+    size_t i = eq + 1;
+    while (i < value.size() && (value[i] == ' ' || value[i] == '\t')) {
+      ++i;
+    }
+    if (i < value.size() && value[i] == '"') {
+      for (++i; i < value.size() && value[i] != '"'; ++i) {
+        if (value[i] == '\\' && i + 1 < value.size()) {
+          ++i;
+        }
+        out.push_back(value[i]);
+      }
+      pos = value.find(';', i);
+    } else {
+      pos = value.find(';', i);
+      out = trim(value.substr(i, pos == std::string::npos ? pos : pos - i));
+    }
+
+    if (iequals(key, name)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+static bool form_data(const std::string &type) {
+  static const char FORM_DATA[] = "multipart/form-data";
+  size_t n = sizeof(FORM_DATA) - 1;
+  if (type.size() < n ||
+      (type.size() > n && type[n] != ';' && type[n] != ' ')) {
+    return false;
+  }
+  for (size_t i = 0; i < n; ++i) {
+    if (std::tolower((unsigned char)type[i]) != FORM_DATA[i]) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// The parts of the body of one request, and their temporary files, which
+// are removed with it.
+class Upload {
+private:
+  Context &ctx;
+  const MultipartHandler &handler;
+  const MultipartOptions &options;
+
+  MultipartPart part;
+  int fd;
+  size_t parts;
+  std::vector<std::string> files;
+
+public:
+  // set if a temporary file could not be written
+  bool file_failed;
+
+public:
+  Upload(Context &ctx, const MultipartHandler &handler,
+         const MultipartOptions &options)
+      : ctx(ctx), handler(handler), options(options), part(), fd(-1),
+        parts(0), files(), file_failed(false) {}
+
+  ~Upload() {
+    if (fd != -1) {
+      close_file(fd);
+    }
+    for (const auto &path : files) {
+      remove_file(path);
+    }
+  }
+
+  NOT_COPYABLE(Upload);
+  NOT_MOVEABLE(Upload);
+
+  csr::Result<std::monostate, server_error_t>
+  begin(const std::map<std::string, std::string> &headers) {
+    if (++parts > options.max_parts) {
+      return csr::Result<std::monostate, server_error_t>::Err(
+          server_error(ServerErr::max_len_reached));
+    }
+
+    part = MultipartPart();
+    part.headers = headers;
+    part.size = 0;
+    const std::string *disposition =
+        find_header(headers, "Content-Disposition");
+    if (!disposition || !header_param(*disposition, "name", part.name)) {
+      return csr::Result<std::monostate, server_error_t>::Err(
+          server_error(ServerErr::invalid_body));
+    }
+    if (!header_param(*disposition, "filename", part.filename) ||
+        part.filename.empty()) {
+      part.filename.clear();
+      return csr::Result<std::monostate, server_error_t>();
+    }
+
+    auto create_ret = create_temp(options.temp_dir, part.path);
+    if (create_ret.is_err()) {
+      file_failed = true;
+      return csr::Result<std::monostate, server_error_t>::Err(
+          std::move(create_ret.unwrap_err()));
+    }
+    fd = create_ret.unwrap();
+    files.push_back(part.path);
+    return csr::Result<std::monostate, server_error_t>();
+  }
+
+  csr::Result<std::monostate, server_error_t> data(const char *data,
+                                                   size_t size) {
+    part.size += size;
+    if (fd == -1) {
+      if (part.size > options.max_field_size) {
+        return csr::Result<std::monostate, server_error_t>::Err(
+            server_error(ServerErr::max_len_reached));
+      }
+      part.value.append(data, size);
+      return csr::Result<std::monostate, server_error_t>();
+    }
+
+    if (part.size > options.max_file_size) {
+      return csr::Result<std::monostate, server_error_t>::Err(
+          server_error(ServerErr::max_len_reached));
+    }
+    auto write_ret = write_file(fd, data, size);
+    file_failed = write_ret.is_err();
+    return write_ret;
+  }
+
+  csr::Result<std::monostate, server_error_t> end() {
+    if (fd != -1) {
+      close_file(fd);
+      fd = -1;
+    }
+    handler(ctx, part);
+    return csr::Result<std::monostate, server_error_t>();
+  }
+};
+
+// a line of at most MULTIPART_LINE_MAX bytes, including its "\r\n"
+static csr::Result<std::monostate, server_error_t>
+read_line(Reader &reader, std::string &line) {
+  line.clear();
+  reader.limit(MULTIPART_LINE_MAX);
+  auto read_ret = reader.readline(line);
+  reader.unlimit();
+
+  if (read_ret.is_err()) {
+    return csr::Result<std::monostate, server_error_t>::Err(
+        std::move(read_ret.unwrap_err()));
+  }
+  if (line.size() < 2 || line[line.size() - 2] != '\r' || line.back() != '\n') {
+    return csr::Result<std::monostate, server_error_t>::Err(
+        server_error(ServerErr::invalid_body));
+  }
+  return csr::Result<std::monostate, server_error_t>();
+}
+
+// feed length bytes of the connection to parser
+static csr::Result<std::monostate, server_error_t>
+feed_length(Reader &reader, MultipartParser &parser, char *buf,
+            uint64_t length) {
+  while (length && !parser.done()) {
+    size_t n = length < MULTIPART_READ ? (size_t)length : MULTIPART_READ;
+    auto read_ret = reader.read(buf, n);
+    if (read_ret.is_err()) {
+      return csr::Result<std::monostate, server_error_t>::Err(
+          std::move(read_ret.unwrap_err()));
+    }
+    if (read_ret.unwrap() == 0) {
+      return csr::Result<std::monostate, server_error_t>::Err(
+          server_error(ServerErr::invalid_body));
+    }
+
+    auto feed_ret = parser.feed(buf, read_ret.unwrap());
+    if (feed_ret.is_err()) {
+      return feed_ret;
+    }
+    length -= read_ret.unwrap();
+  }
+  return csr::Result<std::monostate, server_error_t>();
+}
+
+// feed the data of a chunked body to parser, up to its last chunk
+static csr::Result<std::monostate, server_error_t>
+feed_chunked(Reader &reader, MultipartParser &parser, char *buf) {
+  std::string line;
+  while (!parser.done()) {
+    auto read_ret = read_line(reader, line);
+    if (read_ret.is_err()) {
+      return read_ret;
+    }
+
+    char *end;
+    uint64_t size = std::strtoull(line.c_str(), &end, 16);
+    if (end == line.c_str() || (*end != ';' && *end != '\r')) {
+      return csr::Result<std::monostate, server_error_t>::Err(
+          server_error(ServerErr::invalid_body));
+    }
+    if (size == 0) {
+      break;
+    }
+
+    read_ret = feed_length(reader, parser, buf, size);
+    if (read_ret.is_ok() && !parser.done()) {
+      read_ret = read_line(reader, line);
+    }
+    if (read_ret.is_err()) {
+      return read_ret;
+    }
+  }
+  return csr::Result<std::monostate, server_error_t>();
+}
+
+Multipart::Multipart(MultipartHandler &&handler,
+                     const MultipartOptions &options)
+    : handler(std::move(handler)), options(options) {}
+
+void Multipart::operator()(Context &ctx, const Task &next) {
+  const std::string *type = find_header(ctx.req.headers, "Content-Type");
+  if (!type || !form_data(*type)) {
+    next.next(ctx);
+    return;
+  }
+
+  std::string boundary;
+  if (!header_param(*type, "boundary", boundary) || boundary.empty() ||
+      boundary.size() > MULTIPART_MAX_BOUNDARY) {
+    ctx.resp.status = "400";
+    ctx.resp.headers["Content-Length"] = "0";
+    return;
+  }
+
+  Upload upload{ctx, handler, options};
+  MultipartParser parser{
+      boundary, options.max_head,
+      MultipartCallbacks{
+          [&upload](const std::map<std::string, std::string> &headers) {
+            return upload.begin(headers);
+          },
+          [&upload](const char *data, size_t size) {
+            return upload.data(data, size);
+          },
+          [&upload]() { return upload.end(); }}};
+
+  csr::Result<std::monostate, server_error_t> ret;
+  if (ctx.req.version == "HTTP/2.0") {
+    // the stream has already received the body
+    ret = parser.feed(ctx.req.content.data(), ctx.req.content.size());
+  } else {
+    const std::string *encoding =
+        find_header(ctx.req.headers, "Transfer-Encoding");
+    const std::string *length = find_header(ctx.req.headers, "Content-Length");
+    char *end = nullptr;
+    uint64_t size = length ? std::strtoull(length->c_str(), &end, 10) : 0;
+    if (!encoding && (!length || end == length->c_str() || *end)) {
+      ctx.resp.status = "411";
+      ctx.resp.headers["Content-Length"] = "0";
+      return;
+    }
+
+    const std::string *expect = find_header(ctx.req.headers, "Expect");
+    if (expect && iequals(*expect, "100-continue")) {
+      Writer writer{ctx.fd, ctx.bufsize, ctx.transport};
+      (void)writer.write_through(CONTINUE, sizeof(CONTINUE) - 1);
+    }
+
+    BufferPool &pool = BufferPool::instance();
+    char *buf = pool.acquire(MULTIPART_READ);
+    if (encoding) {
+      ret = iequals(*encoding, "chunked")
+                ? feed_chunked(ctx.reader, parser, buf)
+                : csr::Result<std::monostate, server_error_t>::Err(
+                      server_error(ServerErr::invalid_body));
+    } else {
+      ret = feed_length(ctx.reader, parser, buf, size);
+    }
+    pool.release(buf, MULTIPART_READ);
+  }
+
+  if (ret.is_ok() && !parser.done()) {
+    ret = csr::Result<std::monostate, server_error_t>::Err(
+        server_error(ServerErr::invalid_body));
+  }
+  if (ret.is_err()) {
+    ctx.resp.status =
+        upload.file_failed ? "500"
+        : ret.unwrap_err() == server_error(ServerErr::max_len_reached)
+            ? "413"
+            : "400";
+    ctx.resp.headers["Content-Length"] = "0";
+    return;
+  }
+
+  next.next(ctx);
+}
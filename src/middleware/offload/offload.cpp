@@ -0,0 +1,23 @@
+#include "middleware/offload/offload.h"
+#include <algorithm>
+
+Offload::Offload(std::shared_ptr<Executor> executor,
+                 std::vector<OffloadRoute> routes)
+    : executor(std::move(executor)), routes() {
+  std::stable_sort(routes.begin(), routes.end(),
+                   [](const OffloadRoute &a, const OffloadRoute &b) {
+                     return a.prefix.size() > b.prefix.size();
+                   });
+  this->routes =
+      std::make_shared<const std::vector<OffloadRoute>>(std::move(routes));
+}
+
+void Offload::operator()(Context &ctx, const Task &next) {
+  for (const auto &route : *routes) {
+    if (ctx.req.fullpath.compare(0, route.prefix.size(), route.prefix) == 0) {
+      executor->run(route.priority, [&ctx, &route] { route.work(ctx); });
+      break;
+    }
+  }
+  next.next(ctx);
+}
@@ -0,0 +1,537 @@
+#include "middleware/proxy/proxy.h"
+#include "http/headers.h"
+#include "socket/transport.h"
+#include <cctype>
+#include <cstdlib>
+#include <utility>
+
+// longest status, header or chunk size line taken from either side
+constexpr size_t PROXY_LINE_MAX = 8192;
+// largest response head taken from an upstream
+constexpr size_t PROXY_HEAD_MAX = 65536;
+
+static const char CONTINUE[] = "HTTP/1.1 100 Continue\r\n\r\n";
+
+// how the end of a message body is found
+enum class Framing { none, length, chunked, close };
+
+struct Body {
+  Framing framing;
+  uint64_t length;
+};
+
+struct UpstreamResponse {
+  std::string status;
+  std::string reason;
+  std::vector<std::pair<std::string, std::string>> headers;
+  Body body;
+  bool keep_alive;
+};
+
+// headers that only apply to one connection (RFC 7230 6.1); Transfer-Encoding
+// is handled by the callers
+static bool hop_by_hop(const std::string &name,
+                       const std::string *connection) {
+  static const char *const NAMES[] = {
+      "Connection",          "Keep-Alive", "Proxy-Connection",
+      "Proxy-Authenticate",  "TE",         "Trailer",
+      "Proxy-Authorization", "Upgrade"};
+  for (const char *hop : NAMES) {
+    if (iequals(name, hop)) {
+      return true;
+    }
+  }
+  return connection && has_token(*connection, name.c_str());
+}
+
+static bool parse_length(const std::string &s, uint64_t &length) {
+  if (s.empty() || s.size() > 19) {
+    return false;
+  }
+  length = 0;
+  for (char c : s) {
+    if (c < '0' || c > '9') {
+      return false;
+    }
+    length = length * 10 + (uint64_t)(c - '0');
+  }
+  return true;
+}
+
+static std::string trim(const std::string &s) {
+  size_t first = s.find_first_not_of(" \t\r\n");
+  if (first == std::string::npos) {
+    return std::string();
+  }
+  return s.substr(first, s.find_last_not_of(" \t\r\n") - first + 1);
+}
+
+// a line including its "\r\n", of at most PROXY_LINE_MAX bytes
+static csr::Result<std::monostate, server_error_t>
+read_line(Reader &from, std::string &line) {
+  line.clear();
+  from.limit(PROXY_LINE_MAX);
+  auto read_ret = from.readline(line);
+  from.unlimit();
+
+  if (read_ret.is_err()) {
+    return csr::Result<std::monostate, server_error_t>::Err(
+        std::move(read_ret.unwrap_err()));
+  }
+  if (line.empty()) {
+    return csr::Result<std::monostate, server_error_t>::Err(
+        server_error(ServerErr::connection_closed));
+  }
+  if (line.back() != '\n') {
+    return csr::Result<std::monostate, server_error_t>::Err(
+        server_error(ServerErr::invalid_body));
+  }
+  return csr::Result<std::monostate, server_error_t>();
+}
+
+static csr::Result<std::monostate, server_error_t>
+copy_length(Reader &from, Writer &to, uint64_t length) {
+  char buf[BUFSIZE];
+  while (length) {
+    size_t n = length < sizeof(buf) ? (size_t)length : sizeof(buf);
+    auto read_ret = from.read(buf, n);
+    if (read_ret.is_err()) {
+      return csr::Result<std::monostate, server_error_t>::Err(
+          std::move(read_ret.unwrap_err()));
+    }
+    if (read_ret.unwrap() == 0) {
+      return csr::Result<std::monostate, server_error_t>::Err(
+          server_error(ServerErr::invalid_body));
+    }
+
+    auto write_ret = to.write_through(buf, read_ret.unwrap());
+    if (write_ret.is_err()) {
+      return csr::Result<std::monostate, server_error_t>::Err(
+          std::move(write_ret.unwrap_err()));
+    }
+    length -= read_ret.unwrap();
+  }
+  return csr::Result<std::monostate, server_error_t>();
+}
+
+static csr::Result<std::monostate, server_error_t>
+copy_until_close(Reader &from, Writer &to) {
+  char buf[BUFSIZE];
+  while (true) {
+    auto read_ret = from.read(buf, sizeof(buf));
+    if (read_ret.is_err()) {
+      return csr::Result<std::monostate, server_error_t>::Err(
+          std::move(read_ret.unwrap_err()));
+    }
+    if (read_ret.unwrap() == 0) {
+      return csr::Result<std::monostate, server_error_t>();
+    }
+
+    auto write_ret = to.write_through(buf, read_ret.unwrap());
+    if (write_ret.is_err()) {
+      return csr::Result<std::monostate, server_error_t>::Err(
+          std::move(write_ret.unwrap_err()));
+    }
+  }
+}
+
+/*
+ * Copy a chunked body. Chunk sizes, extensions and trailers are copied as
+ * they are if raw is set; otherwise only the data is, e.g. for HTTP/1.0
+ * clients, which the end of the connection tells where the body ends.
+ */
+static csr::Result<std::monostate, server_error_t>
+copy_chunked(Reader &from, Writer &to, bool raw) {
+  std::string line;
+  csr::Result<size_t, server_error_t> write_ret;
+
+  while (true) {
+    auto read_ret = read_line(from, line);
+    if (read_ret.is_err()) {
+      return read_ret;
+    }
+    if (raw && (write_ret = to.write(line)).is_err()) {
+      return csr::Result<std::monostate, server_error_t>::Err(
+          std::move(write_ret.unwrap_err()));
+    }
+
+    char *end;
+    uint64_t size = std::strtoull(line.c_str(), &end, 16);
+    if (end == line.c_str() || (*end != ';' && *end != '\r')) {
+      return csr::Result<std::monostate, server_error_t>::Err(
+          server_error(ServerErr::invalid_body));
+    }
+
+    if (size == 0) {
+      // trailer fields up to the empty line
+      do {
+        read_ret = read_line(from, line);
+        if (read_ret.is_err()) {
+          return read_ret;
+        }
+        if (raw && (write_ret = to.write(line)).is_err()) {
+          return csr::Result<std::monostate, server_error_t>::Err(
+              std::move(write_ret.unwrap_err()));
+        }
+      } while (line != "\r\n");
+      return csr::Result<std::monostate, server_error_t>();
+    }
+
+    read_ret = copy_length(from, to, size);
+    if (read_ret.is_ok()) {
+      read_ret = read_line(from, line);
+    }
+    if (read_ret.is_ok() && line != "\r\n") {
+      read_ret = csr::Result<std::monostate, server_error_t>::Err(
+          server_error(ServerErr::invalid_body));
+    }
+    if (read_ret.is_err()) {
+      return read_ret;
+    }
+    if (raw && (write_ret = to.write(line)).is_err()) {
+      return csr::Result<std::monostate, server_error_t>::Err(
+          std::move(write_ret.unwrap_err()));
+    }
+  }
+}
+
+static csr::Result<std::monostate, server_error_t>
+copy_body(Reader &from, Writer &to, const Body &body, bool raw) {
+  switch (body.framing) {
+  case Framing::length:
+    return copy_length(from, to, body.length);
+  case Framing::chunked:
+    return copy_chunked(from, to, raw);
+  case Framing::close:
+    return copy_until_close(from, to);
+  default:
+    return csr::Result<std::monostate, server_error_t>();
+  }
+}
+
+static bool request_body(const std::map<std::string, std::string> &headers,
+                         Body &body) {
+  const std::string *encoding = find_header(headers, "Transfer-Encoding");
+  const std::string *length = find_header(headers, "Content-Length");
+
+  body = Body{Framing::none, 0};
+  // both would let an upstream that trusts Content-Length see another
+  // request in the body (RFC 7230 3.3.3): rejected
+  if (encoding && length) {
+    return false;
+  }
+  if (encoding) {
+    // only chunked can tell where a request body ends
+    body.framing = Framing::chunked;
+    return iequals(*encoding, "chunked");
+  }
+  if (length) {
+    body.framing = Framing::length;
+    return parse_length(*length, body.length);
+  }
+  return true;
+}
+
+// the framing headers of an HTTP/2 request are replaced by a Content-Length
+// of its body, which the stream has already received
+static std::string request_head(const Request &req,
+                                const std::string &authority, bool h2) {
+  const std::string *connection = find_header(req.headers, "Connection");
+
+  std::string head = req.method + " " + req.fullpath + " HTTP/1.1\r\n";
+  bool host = false;
+  for (const auto &[name, value] : req.headers) {
+    if (hop_by_hop(name, connection) || iequals(name, "Expect") ||
+        (h2 && (iequals(name, "Content-Length") ||
+                iequals(name, "Transfer-Encoding")))) {
+      continue;
+    }
+    host = host || iequals(name, "Host");
+    head += name + ": " + value + "\r\n";
+  }
+  if (!host) {
+    head += "Host: " + authority + "\r\n";
+  }
+  if (h2 && !req.content.empty()) {
+    head += "Content-Length: " + std::to_string(req.content.size()) + "\r\n";
+  }
+  head += "Connection: keep-alive\r\n\r\n";
+  return head;
+}
+
+static csr::Result<std::monostate, server_error_t>
+read_response(Reader &from, bool head_request, UpstreamResponse &resp) {
+  std::string line;
+  csr::Result<std::monostate, server_error_t> ret;
+
+  // interim 1xx responses are skipped
+  do {
+    // "HTTP/1.1 200 OK\r\n"
+    if ((ret = read_line(from, line)).is_err()) {
+      return ret;
+    }
+    if (line.size() < 14 || line.compare(0, 7, "HTTP/1.") || line[8] != ' ' ||
+        !isdigit((unsigned char)line[9]) ||
+        !isdigit((unsigned char)line[10]) ||
+        !isdigit((unsigned char)line[11])) {
+      return csr::Result<std::monostate, server_error_t>::Err(
+          server_error(ServerErr::invalid_response));
+    }
+    resp.status = line.substr(9, 3);
+    resp.reason = trim(line.substr(12));
+    resp.keep_alive = line[7] == '1';
+    resp.headers.clear();
+
+    size_t head_size = line.size();
+    while (true) {
+      if ((ret = read_line(from, line)).is_err()) {
+        return ret;
+      }
+      if (line == "\r\n") {
+        break;
+      }
+      head_size += line.size();
+      size_t colon = line.find(':');
+      if (colon == std::string::npos || colon == 0 ||
+          head_size > PROXY_HEAD_MAX) {
+        return csr::Result<std::monostate, server_error_t>::Err(
+            server_error(ServerErr::invalid_response));
+      }
+      resp.headers.emplace_back(line.substr(0, colon),
+                                trim(line.substr(colon + 1)));
+    }
+  } while (resp.status[0] == '1');
+
+  resp.body = Body{Framing::close, 0};
+  bool chunked = false;
+  for (const auto &[name, value] : resp.headers) {
+    if (iequals(name, "Connection")) {
+      if (has_token(value, "close")) {
+        resp.keep_alive = false;
+      } else if (has_token(value, "keep-alive")) {
+        resp.keep_alive = true;
+      }
+    } else if (iequals(name, "Transfer-Encoding")) {
+      chunked = has_token(value, "chunked");
+    } else if (iequals(name, "Content-Length")) {
+      if (!parse_length(value, resp.body.length)) {
+        return csr::Result<std::monostate, server_error_t>::Err(
+            server_error(ServerErr::invalid_response));
+      }
+      resp.body.framing = Framing::length;
+    }
+  }
+
+  if (head_request || resp.status == "204" || resp.status == "304") {
+    resp.body.framing = Framing::none;
+  } else if (chunked) {
+    resp.body.framing = Framing::chunked;
+  }
+  if (resp.body.framing == Framing::close) {
+    resp.keep_alive = false;
+  }
+  return csr::Result<std::monostate, server_error_t>();
+}
+
+// the client gets HTTP/1.0 like every other response of the server, so a
+// chunked body is passed on decoded
+static csr::Result<std::monostate, server_error_t>
+write_response_head(Writer &to, const UpstreamResponse &resp) {
+  const std::string *connection = nullptr;
+  for (const auto &[name, value] : resp.headers) {
+    if (iequals(name, "Connection")) {
+      connection = &value;
+    }
+  }
+
+  std::string head = "HTTP/1.0 " + resp.status + " " + resp.reason + "\r\n";
+  for (const auto &[name, value] : resp.headers) {
+    if (hop_by_hop(name, connection) || iequals(name, "Transfer-Encoding") ||
+        (resp.body.framing == Framing::chunked &&
+         iequals(name, "Content-Length"))) {
+      continue;
+    }
+    head += name + ": " + value + "\r\n";
+  }
+  head += "\r\n";
+
+  auto write_ret = to.write(head);
+  if (write_ret.is_err()) {
+    return csr::Result<std::monostate, server_error_t>::Err(
+        std::move(write_ret.unwrap_err()));
+  }
+  return csr::Result<std::monostate, server_error_t>();
+}
+
+// the response of an HTTP/2 stream, which the session frames itself
+static void set_response(Response &to, const UpstreamResponse &resp,
+                         const std::vector<char> &body) {
+  const std::string *connection = nullptr;
+  for (const auto &[name, value] : resp.headers) {
+    if (iequals(name, "Connection")) {
+      connection = &value;
+    }
+  }
+
+  to.status = resp.status;
+  to.headers.clear();
+  for (const auto &[name, value] : resp.headers) {
+    if (hop_by_hop(name, connection) || iequals(name, "Transfer-Encoding") ||
+        iequals(name, "Content-Length")) {
+      continue;
+    }
+    to.headers[name] = value;
+  }
+  to.setContent(body.data(), body.size());
+}
+
+// errors of a pooled connection the upstream closed while it was idle
+static bool stale(const server_error_t &err) {
+  return err == server_error(ServerErr::connection_closed) ||
+         err == std::errc::connection_reset || err == std::errc::broken_pipe;
+}
+
+static void respond_error(Context &ctx, const server_error_t &err) {
+  bool timeout = err == std::errc::resource_unavailable_try_again ||
+                 err == std::errc::operation_would_block ||
+                 err == std::errc::timed_out;
+  ctx.resp.status = timeout ? "504" : "502";
+  ctx.resp.headers["Content-Length"] = "0";
+}
+
+Proxy::Proxy(const std::vector<UpstreamAddress> &upstreams,
+             const ProxyOptions &options)
+    : group(std::make_shared<UpstreamGroup>(upstreams, options)) {}
+
+void Proxy::operator()(Context &ctx, const Task &next) {
+  const std::string &prefix = group->config().prefix;
+  if (ctx.req.fullpath.compare(0, prefix.size(), prefix)) {
+    next.next(ctx);
+    return;
+  }
+
+  // an upstream that cannot be connected to is marked unhealthy, so the
+  // next pick is another one
+  while (Upstream *upstream = group->pick()) {
+    upstream->outstanding.fetch_add(1);
+    bool done = forward(ctx, *upstream);
+    upstream->outstanding.fetch_sub(1);
+    if (done) {
+      return;
+    }
+  }
+
+  ctx.resp.status = "503";
+  ctx.resp.headers["Content-Length"] = "0";
+}
+
+bool Proxy::forward(Context &ctx, Upstream &upstream) const {
+  const ProxyOptions &options = group->config();
+
+  // ctx.fd and ctx.reader of an HTTP/2 stream are its whole connection:
+  // the body comes from ctx.req and the response goes to ctx.resp
+  bool h2 = ctx.req.version == "HTTP/2.0";
+
+  Body body;
+  if (h2) {
+    body = Body{Framing::none, 0};
+  } else if (!request_body(ctx.req.headers, body)) {
+    ctx.resp.status = "400";
+    ctx.resp.headers["Content-Length"] = "0";
+    return true;
+  }
+  std::string head = request_head(ctx.req, upstream.host(), h2);
+  const std::string *expect = find_header(ctx.req.headers, "Expect");
+  bool expect_continue = body.framing != Framing::none && expect &&
+                         iequals(*expect, "100-continue");
+
+  Writer client{ctx.fd, ctx.bufsize, ctx.transport};
+  UpstreamResponse resp;
+
+  while (true) {
+    bool reused;
+    auto acquire_ret = upstream.acquire(options, reused);
+    if (acquire_ret.is_err()) {
+      return false;
+    }
+    SocketClient conn = std::move(acquire_ret.unwrap());
+    Writer to{conn.connfd.unwrap()};
+    Reader from{conn.connfd.unwrap()};
+
+    // the body is sent as it arrives, after the head
+    auto ret = csr::Result<std::monostate, server_error_t>();
+    auto write_ret = to.write(head);
+    if (write_ret.is_ok() && h2) {
+      write_ret = to.write(ctx.req.content.data(), ctx.req.content.size());
+    }
+    if (write_ret.is_ok()) {
+      write_ret = to.flush();
+    }
+    if (write_ret.is_err()) {
+      ret = csr::Result<std::monostate, server_error_t>::Err(
+          std::move(write_ret.unwrap_err()));
+    }
+    if (ret.is_ok() && expect_continue) {
+      // the upstream is not asked for it: the client is answered at once
+      expect_continue = false;
+      write_ret = client.write_through(CONTINUE, sizeof(CONTINUE) - 1);
+      if (write_ret.is_err()) {
+        return true;
+      }
+    }
+    if (ret.is_ok()) {
+      ret = copy_body(ctx.reader, to, body, true);
+    }
+    if (ret.is_ok() && (write_ret = to.flush()).is_err()) {
+      ret = csr::Result<std::monostate, server_error_t>::Err(
+          std::move(write_ret.unwrap_err()));
+    }
+    if (ret.is_ok()) {
+      ret = read_response(from, ctx.req.method == "HEAD", resp);
+    }
+
+    if (ret.is_err()) {
+      // a pooled connection may have been closed by the upstream in the
+      // meantime: the request is sent again if none of it was consumed
+      if (reused && body.framing == Framing::none && stale(ret.unwrap_err())) {
+        continue;
+      }
+      respond_error(ctx, ret.unwrap_err());
+      return true;
+    }
+
+    if (h2) {
+      MemoryTransport sink;
+      Writer out{INVALID_SOCKET, ctx.bufsize, &sink};
+      ret = copy_body(from, out, resp.body, false);
+      if (ret.is_ok() && (write_ret = out.flush()).is_err()) {
+        ret = csr::Result<std::monostate, server_error_t>::Err(
+            std::move(write_ret.unwrap_err()));
+      }
+      if (ret.is_err()) {
+        respond_error(ctx, ret.unwrap_err());
+        return true;
+      }
+      set_response(ctx.resp, resp, sink.sent());
+    } else {
+      // from here on, an error can only cut the response short
+      ret = write_response_head(client, resp);
+      if (ret.is_ok()) {
+        ret = copy_body(from, client, resp.body, false);
+      }
+      if (ret.is_ok() && (write_ret = client.flush()).is_err()) {
+        ret = csr::Result<std::monostate, server_error_t>::Err(
+            std::move(write_ret.unwrap_err()));
+      }
+    }
+    if (ret.is_ok() && resp.keep_alive) {
+      // a response must not be followed by anything before a request
+      std::vector<char> rest;
+      from.take(rest);
+      if (rest.empty()) {
+        upstream.release(std::move(conn), options);
+      }
+    }
+    return true;
+  }
+}
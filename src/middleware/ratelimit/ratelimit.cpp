@@ -0,0 +1,39 @@
+#include "middleware/ratelimit/ratelimit.h"
+#include "http/headers.h"
+
+#if defined(__APPLE__) || defined(__linux__)
+#include <netinet/in.h>
+#endif
+
+RateLimit::RateLimit(const RateLimitOptions &options)
+    : header(options.header),
+      buckets(std::make_shared<TokenBuckets>(options.rate, options.burst,
+                                             options.capacity)),
+      rejected() {
+  Response resp;
+  resp.status = "429";
+  resp.headers["Retry-After"] = std::to_string(buckets->retry_after());
+  resp.headers["Content-Length"] = "0";
+  rejected = PreparedResponse::build(resp);
+}
+
+void RateLimit::operator()(Context &ctx, const Task &next) {
+  uint64_t key = 0;
+  const std::string *value =
+      header.empty() ? nullptr : find_header(ctx.req.headers, header.c_str());
+  if (value) {
+    key = bucket_key(value->data(), value->size());
+  } else if (ctx.peer.ss_family == AF_INET) {
+    const auto *addr = (const struct sockaddr_in *)&ctx.peer;
+    key = bucket_key(&addr->sin_addr, sizeof(addr->sin_addr));
+  } else if (ctx.peer.ss_family == AF_INET6) {
+    const auto *addr = (const struct sockaddr_in6 *)&ctx.peer;
+    key = bucket_key(&addr->sin6_addr, sizeof(addr->sin6_addr));
+  }
+
+  if (key && !buckets->take(key)) {
+    ctx.send(rejected);
+    return;
+  }
+  next.next(ctx);
+}
@@ -0,0 +1,56 @@
+#include "middleware/websocket/websocket.h"
+#include "http/headers.h"
+#include "websocket/frame.h"
+
+WebSocket::WebSocket(WsHandlers &&handlers, size_t max_message)
+    : loop(std::make_shared<WsLoop>(std::move(handlers), max_message)) {}
+
+void WebSocket::operator()(Context &ctx, const Task &next) {
+  const std::string *upgrade = find_header(ctx.req.headers, "Upgrade");
+  if (!upgrade || !has_token(*upgrade, "websocket")) {
+    next.next(ctx);
+    return;
+  }
+
+  const std::string *connection = find_header(ctx.req.headers, "Connection");
+  const std::string *key = find_header(ctx.req.headers, "Sec-WebSocket-Key");
+  const std::string *version =
+      find_header(ctx.req.headers, "Sec-WebSocket-Version");
+
+  // a base64-encoded 16-byte nonce is 24 characters long
+  if (ctx.req.method != "GET" || !connection ||
+      !has_token(*connection, "Upgrade") || !key || key->size() != 24) {
+    ctx.resp.status = "400";
+    ctx.resp.headers["Content-Length"] = "0";
+    return;
+  }
+  if (!version || *version != "13") {
+    ctx.resp.status = "426";
+    ctx.resp.headers["Sec-WebSocket-Version"] = "13";
+    ctx.resp.headers["Content-Length"] = "0";
+    return;
+  }
+
+  std::string response = "HTTP/1.1 101 Switching Protocols\r\n"
+                         "Upgrade: websocket\r\n"
+                         "Connection: Upgrade\r\n"
+                         "Sec-WebSocket-Accept: " +
+                         ws_accept_key(*key) + "\r\n\r\n";
+
+  Writer writer{ctx.fd, ctx.bufsize, ctx.transport};
+  auto write_result = writer.write(response);
+  if (write_result.is_ok()) {
+    write_result = writer.flush();
+  }
+  if (write_result.is_err()) {
+    return;
+  }
+
+  // the loop outlives this request (and may outlive this copy)
+  std::shared_ptr<WsLoop> target = loop;
+  Request req = std::move(ctx.req);
+  ctx.take_over([target, req = std::move(req)](
+                    SocketClient &&sc, std::vector<char> &&input) mutable {
+    target->add(std::move(sc), std::move(req), std::move(input));
+  });
+}
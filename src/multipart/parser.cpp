@@ -0,0 +1,169 @@
+#include "multipart/parser.h"
+#include <cstring>
+
+// whitespace allowed between a boundary and the end of its line
+constexpr size_t MULTIPART_MAX_PADDING = 256;
+
+MultipartParser::MultipartParser(const std::string &boundary,
+                                 size_t max_head,
+                                 MultipartCallbacks &&callbacks)
+    : state(State::preamble), delim("\r\n--" + boundary), max_head(max_head),
+      callbacks(std::move(callbacks)), window() {
+  size_t m = delim.size();
+  for (size_t &s : skip) {
+    s = m;
+  }
+  for (size_t i = 0; i + 1 < m; ++i) {
+    skip[(unsigned char)delim[i]] = m - 1 - i;
+  }
+
+  // the first delimiter may start the body, without the CRLF before it
+  window.push_back('\r');
+  window.push_back('\n');
+}
+
+bool MultipartParser::done() const { return state == State::epilogue; }
+
+size_t MultipartParser::search(const char *data, size_t size) const {
+  size_t m = delim.size();
+  const char *d = delim.data();
+  for (size_t i = 0; i + m <= size;) {
+    unsigned char last = (unsigned char)data[i + m - 1];
+    if (last == (unsigned char)d[m - 1] && !memcmp(data + i, d, m - 1)) {
+      return i;
+    }
+    i += skip[last];
+  }
+  return size;
+}
+
+// "Name: value" lines, each ending with CRLF
+csr::Result<std::monostate, server_error_t>
+MultipartParser::parse_head(const char *data, size_t size) const {
+  std::map<std::string, std::string> headers;
+  const char *end = data + size;
+  while (data < end) {
+    const char *eol = data;
+    while (eol + 1 < end && !(eol[0] == '\r' && eol[1] == '\n')) {
+      ++eol;
+    }
+    const char *colon = (const char *)memchr(data, ':', (size_t)(eol - data));
+    if (!colon || colon == data) {
+      return csr::Result<std::monostate, server_error_t>::Err(
+          server_error(ServerErr::invalid_body));
+    }
+
+    const char *value = colon + 1;
+    while (value < eol && (*value == ' ' || *value == '\t')) {
+      ++value;
+    }
+    const char *value_end = eol;
+    while (value_end > value &&
+           (value_end[-1] == ' ' || value_end[-1] == '\t')) {
+      --value_end;
+    }
+    headers[std::string(data, colon)] = std::string(value, value_end);
+    data = eol + 2;
+  }
+  return callbacks.begin(headers);
+}
+
+csr::Result<std::monostate, server_error_t>
+MultipartParser::feed(const char *data, size_t size) {
+  window.insert(window.end(), data, data + size);
+
+  csr::Result<std::monostate, server_error_t> ret;
+  size_t pos = 0;
+  bool more = true;
+  while (more && ret.is_ok()) {
+    const char *p = window.data() + pos;
+    size_t left = window.size() - pos;
+
+    switch (state) {
+    case State::preamble:
+    case State::content: {
+      size_t found = search(p, left);
+      // without a delimiter, only its possible start has to be kept
+      size_t safe = found < left           ? found
+                    : left >= delim.size() ? left - delim.size() + 1
+                                           : 0;
+      if (state == State::content && safe) {
+        ret = callbacks.data(p, safe);
+      }
+      pos += safe;
+      if (found == left) {
+        more = false;
+        break;
+      }
+      if (ret.is_ok() && state == State::content) {
+        ret = callbacks.end();
+      }
+      pos += delim.size();
+      state = State::delimiter;
+      break;
+    }
+
+    case State::delimiter: {
+      if (left >= 2 && p[0] == '-' && p[1] == '-') {
+        state = State::epilogue;
+        break;
+      }
+      // transport padding, then CRLF
+      size_t i = 0;
+      while (i < left && (p[i] == ' ' || p[i] == '\t')) {
+        ++i;
+      }
+      if (i + 2 <= left) {
+        if (p[i] != '\r' || p[i + 1] != '\n') {
+          ret = csr::Result<std::monostate, server_error_t>::Err(
+              server_error(ServerErr::invalid_body));
+          break;
+        }
+        pos += i + 2;
+        state = State::head;
+      } else if (left > MULTIPART_MAX_PADDING) {
+        ret = csr::Result<std::monostate, server_error_t>::Err(
+            server_error(ServerErr::invalid_body));
+      } else {
+        more = false;
+      }
+      break;
+    }
+
+    case State::head: {
+      // the head ends with an empty line; it may have no field at all
+      size_t end = 0;
+      if (left >= 2 && p[0] == '\r' && p[1] == '\n') {
+        end = 2;
+      } else {
+        for (size_t i = 0; i + 4 <= left; ++i) {
+          if (!memcmp(p + i, "\r\n\r\n", 4)) {
+            end = i + 4;
+            break;
+          }
+        }
+      }
+
+      if (end) {
+        ret = parse_head(p, end - 2);
+        pos += end;
+        state = State::content;
+      } else if (left > max_head) {
+        ret = csr::Result<std::monostate, server_error_t>::Err(
+            server_error(ServerErr::max_len_reached));
+      } else {
+        more = false;
+      }
+      break;
+    }
+
+    case State::epilogue:
+      pos = window.size();
+      more = false;
+      break;
+    }
+  }
+
+  window.erase(window.begin(), window.begin() + (std::ptrdiff_t)pos);
+  return ret;
+}
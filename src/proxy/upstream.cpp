@@ -0,0 +1,176 @@
+#include "proxy/upstream.h"
+#include "socket/io.h"
+#include <system_error>
+
+#if defined(__APPLE__) || defined(__linux__)
+#include <poll.h>
+#endif
+
+// longest status line read by a health check
+constexpr size_t HEALTH_LINE_MAX = 1024;
+
+// an idle keep-alive connection is readable only if the upstream closed it
+// (or sent something unsolicited): either way it cannot be reused
+static bool still_open(const SocketClient &sc) {
+#if defined(__APPLE__) || defined(__linux__)
+  struct pollfd pfd = {sc.connfd.unwrap(), POLLIN, 0};
+  return poll(&pfd, 1, 0) == 0;
+#elif defined(_WIN32)
+  WSAPOLLFD pfd = {sc.connfd.unwrap(), POLLRDNORM, 0};
+  return WSAPoll(&pfd, 1, 0) == 0;
+#endif
+}
+
+Upstream::Upstream(const UpstreamAddress &address,
+                   const struct sockaddr_storage &addr, socklen_t addrlen)
+    : authority(address.host + ":" + std::to_string(address.port)),
+      addr(addr), addrlen(addrlen), outstanding(0), healthy(true) {}
+
+const std::string &Upstream::host() const { return authority; }
+
+csr::Result<SocketClient, server_error_t>
+Upstream::acquire(const ProxyOptions &options, bool &reused) {
+  auto now = std::chrono::steady_clock::now();
+  auto max_age = std::chrono::milliseconds(options.idle_timeout);
+
+  {
+    std::lock_guard<std::mutex> lock{mutex};
+    // the oldest connections are at the front
+    while (!idle.empty() && now - idle.front().since > max_age) {
+      idle.pop_front();
+    }
+    while (!idle.empty()) {
+      SocketClient sc = std::move(idle.back().sc);
+      idle.pop_back();
+      if (still_open(sc)) {
+        reused = true;
+        return csr::Result<SocketClient, server_error_t>::Ok(std::move(sc));
+      }
+    }
+  }
+
+  reused = false;
+  auto connect_ret =
+      SocketGenerator::connect(addr, addrlen, options.connect_timeout);
+  server_error_t err;
+  if (connect_ret.is_err()) {
+    err = connect_ret.unwrap_err();
+  } else {
+    auto timeout_ret = connect_ret.unwrap().set_timeout(options.timeout);
+    if (timeout_ret.is_ok()) {
+      return connect_ret;
+    }
+    err = timeout_ret.unwrap_err();
+  }
+
+  // the health checks tell when it is back
+  healthy.store(false);
+  return csr::Result<SocketClient, server_error_t>::Err(std::move(err));
+}
+
+void Upstream::release(SocketClient &&sc, const ProxyOptions &options) {
+  if (!options.max_idle) {
+    (void)sc.close();
+    return;
+  }
+
+  std::lock_guard<std::mutex> lock{mutex};
+  if (!idle.empty() && idle.size() >= options.max_idle) {
+    idle.pop_front();
+  }
+  idle.push_back(Idle{std::move(sc), std::chrono::steady_clock::now()});
+}
+
+bool Upstream::check(const ProxyOptions &options) {
+  auto connect_ret =
+      SocketGenerator::connect(addr, addrlen, options.connect_timeout);
+  if (connect_ret.is_err()) {
+    return false;
+  }
+  SocketClient &sc = connect_ret.unwrap();
+  if (sc.set_timeout(options.connect_timeout).is_err()) {
+    return false;
+  }
+
+  std::string request = "GET " + options.health_path +
+                        " HTTP/1.1\r\n"
+                        "Host: " +
+                        authority + "\r\nConnection: close\r\n\r\n";
+  Writer writer{sc.connfd.unwrap()};
+  if (writer.write_through(request.data(), request.size()).is_err()) {
+    return false;
+  }
+
+  // "HTTP/1.1 200 OK\r\n"
+  Reader reader{sc.connfd.unwrap()};
+  reader.limit(HEALTH_LINE_MAX);
+  std::string line;
+  auto read_ret = reader.readline(line);
+  if (read_ret.is_err() || line.size() < 13 ||
+      line.compare(0, 7, "HTTP/1.")) {
+    return false;
+  }
+  return line[9] == '2' || line[9] == '3';
+}
+
+UpstreamGroup::UpstreamGroup(const std::vector<UpstreamAddress> &addresses,
+                             const ProxyOptions &options)
+    : options(options), upstreams(), next(0), stopping(false) {
+  for (const auto &address : addresses) {
+    struct sockaddr_storage addr;
+    socklen_t addrlen;
+    auto resolve_ret =
+        SocketGenerator::resolve(address.host, address.port, addr, addrlen);
+    if (resolve_ret.is_err()) {
+      throw std::system_error(resolve_ret.unwrap_err(),
+                              "upstream " + address.host);
+    }
+    upstreams.push_back(std::make_unique<Upstream>(address, addr, addrlen));
+  }
+
+  thread = std::thread{&UpstreamGroup::run, this};
+}
+
+UpstreamGroup::~UpstreamGroup() {
+  {
+    std::lock_guard<std::mutex> lock{mutex};
+    stopping = true;
+  }
+  cv.notify_all();
+  thread.join();
+}
+
+void UpstreamGroup::run() {
+  auto interval = std::chrono::milliseconds(options.health_interval);
+
+  std::unique_lock<std::mutex> lock{mutex};
+  while (!cv.wait_for(lock, interval, [this] { return stopping; })) {
+    lock.unlock();
+    for (auto &upstream : upstreams) {
+      upstream->healthy.store(upstream->check(options));
+    }
+    lock.lock();
+  }
+}
+
+const ProxyOptions &UpstreamGroup::config() const { return options; }
+
+Upstream *UpstreamGroup::pick() {
+  size_t n = upstreams.size();
+  size_t start = next.fetch_add(1, std::memory_order_relaxed);
+
+  Upstream *best = nullptr;
+  size_t best_load = 0;
+  for (size_t i = 0; i < n; ++i) {
+    Upstream *upstream = upstreams[(start + i) % n].get();
+    if (!upstream->healthy.load()) {
+      continue;
+    }
+    size_t load = upstream->outstanding.load(std::memory_order_relaxed);
+    if (!best || load < best_load) {
+      best = upstream;
+      best_load = load;
+    }
+  }
+  return best;
+}
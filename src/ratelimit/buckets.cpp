@@ -0,0 +1,100 @@
+#include "ratelimit/buckets.h"
+#include <chrono>
+
+// slots looked at for a key: two cache lines
+constexpr size_t BUCKET_PROBE = 2 * (64 / (2 * sizeof(uint64_t)));
+
+static int64_t now_ns() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+TokenBuckets::TokenBuckets(double rate, size_t burst, size_t capacity)
+    : lines(), mask(0), interval(0), tolerance(0) {
+  constexpr size_t per_line = sizeof(Line) / sizeof(Slot);
+  size_t count = 1;
+  while (count * per_line < capacity) {
+    count <<= 1;
+  }
+  lines.reset(new Line[count]);
+  for (size_t i = 0; i < count; ++i) {
+    for (auto &slot : lines[i].slots) {
+      slot.key.store(0, std::memory_order_relaxed);
+      slot.tat.store(0, std::memory_order_relaxed);
+    }
+  }
+  mask = count * per_line - 1;
+
+  // at least one request per hour, at most one per ns
+  double ns = 1e9 / (rate > 1.0 / 3600 ? rate : 1.0 / 3600);
+  interval = ns > 1 ? (int64_t)ns : 1;
+  tolerance = interval * (int64_t)(burst > 1 ? burst - 1 : 0);
+}
+
+bool TokenBuckets::take(uint64_t key) {
+  constexpr size_t per_line = sizeof(Line) / sizeof(Slot);
+  int64_t now = now_ns();
+
+  // start at a line boundary so that the probe touches two lines only
+  size_t base = key & mask & ~(per_line - 1);
+  Slot *found = nullptr;
+  Slot *reclaim = nullptr;
+  for (size_t i = 0; i < BUCKET_PROBE; ++i) {
+    size_t index = (base + i) & mask;
+    Slot &slot = lines[index / per_line].slots[index % per_line];
+    uint64_t k = slot.key.load(std::memory_order_acquire);
+    if (k == key) {
+      found = &slot;
+      break;
+    }
+    if (!reclaim && slot.tat.load(std::memory_order_relaxed) <= now) {
+      reclaim = &slot;
+    }
+  }
+
+  if (!found) {
+    // all the slots are held by clients with tokens in use
+    if (!reclaim) {
+      return true;
+    }
+    // the bucket of an expired slot is full whatever key held it, so the
+    // slot is taken over as it is; if another thread got it first, it is
+    // only usable if that thread claimed it for the same key
+    uint64_t old = reclaim->key.load(std::memory_order_relaxed);
+    if (old != key &&
+        !reclaim->key.compare_exchange_strong(old, key,
+                                              std::memory_order_acq_rel) &&
+        old != key) {
+      return true;
+    }
+    found = reclaim;
+  }
+
+  int64_t tat = found->tat.load(std::memory_order_relaxed);
+  for (;;) {
+    int64_t start = tat > now ? tat : now;
+    if (start - now > tolerance) {
+      return false;
+    }
+    if (found->tat.compare_exchange_weak(tat, start + interval,
+                                         std::memory_order_relaxed)) {
+      return true;
+    }
+  }
+}
+
+int64_t TokenBuckets::retry_after() const {
+  int64_t seconds = (interval + 999999999) / 1000000000;
+  return seconds ? seconds : 1;
+}
+
+uint64_t bucket_key(const void *data, size_t size) {
+  const unsigned char *p = (const unsigned char *)data;
+  uint64_t h = 14695981039346656037ULL;
+  for (size_t i = 0; i < size; ++i) {
+    h ^= p[i];
+    h *= 1099511628211ULL;
+  }
+  return h ? h : 1;
+}
@@ -19,6 +19,27 @@ std::string ServerCategory::message(int ev) const {
     return "invalid header fields";
   case ServerErr::numeric_limit_reached:
     return "numeric limit reached";
+  case ServerErr::unsupported_option:
+    return "socket option not supported on this platform";
+  case ServerErr::connection_closed:
+    return "connection already closed";
+  case ServerErr::tls_error:
+    return "TLS setup or handshake failed";
+  case ServerErr::invalid_body:
+    return "invalid or truncated message body";
+  case ServerErr::invalid_response:
+    return "invalid upstream response";
+  case ServerErr::compression_error:
+    return "compression failed";
   }
   return "unknown error";
+}
+
+const std::error_category &server_category() noexcept {
+  static ServerCategory category;
+  return category;
+}
+
+std::error_code make_error_code(ServerErr err) noexcept {
+  return std::error_code(err, server_category());
 }
\ No newline at end of file
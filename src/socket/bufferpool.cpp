@@ -0,0 +1,56 @@
+#include "socket/bufferpool.h"
+
+static size_t class_of(size_t size) {
+  size_t index = 0;
+  for (size_t n = BUFFER_MIN; n < size; n <<= 1) {
+    ++index;
+  }
+  return index;
+}
+
+BufferPool &BufferPool::instance() {
+  // never destroyed (see lifetime.h)
+  static BufferPool *pool = new BufferPool();
+  return *pool;
+}
+
+size_t BufferPool::round(size_t size) {
+  size_t index = class_of(size);
+  return index < BUFFER_CLASSES ? BUFFER_MIN << index : size;
+}
+
+char *BufferPool::acquire(size_t size) {
+  size_t index = class_of(size);
+  if (index >= BUFFER_CLASSES) {
+    return new char[size];
+  }
+
+  SizeClass &sc = classes[index];
+  std::lock_guard<std::mutex> lock{sc.mutex};
+  if (sc.free.empty()) {
+    // carve a new slab into buffers
+    size_t bufsize = BUFFER_MIN << index;
+    size_t count = bufsize < SLAB_SIZE ? SLAB_SIZE / bufsize : 1;
+    sc.slabs.emplace_back(new char[bufsize * count]);
+    sc.free.reserve(sc.free.size() + count);
+    for (size_t i = 0; i < count; ++i) {
+      sc.free.push_back(sc.slabs.back().get() + i * bufsize);
+    }
+  }
+
+  char *buffer = sc.free.back();
+  sc.free.pop_back();
+  return buffer;
+}
+
+void BufferPool::release(char *buffer, size_t size) {
+  size_t index = class_of(size);
+  if (index >= BUFFER_CLASSES) {
+    delete[] buffer;
+    return;
+  }
+
+  SizeClass &sc = classes[index];
+  std::lock_guard<std::mutex> lock{sc.mutex};
+  sc.free.push_back(buffer);
+}
@@ -1,45 +1,151 @@
 #include "socket/io.h"
+#include "socket/bufferpool.h"
 #include <cstring>
 
 #ifdef _WIN32
 #include <limits>
 #endif
 
-Reader::Reader(m_sock_t connfd)
-    : buffer(), usable_buf(buffer), fd(connfd), cnt(0) {}
+Reader::Reader(m_sock_t connfd, size_t bufsize, Transport *transport)
+    : buffer(nullptr), bufsize(bufsize), usable_buf(nullptr), fd(connfd),
+      transport(transport), maxlen(0), limited(false), cnt(0) {}
 
-/*
- *    This is a wrapper for the read()/send() function that
- *    transfers min(n, rio_cnt) bytes from an internal buffer to a user
- *    buffer, where n is the number of bytes requested by the user and
- *    rio_cnt is the number of unread bytes in the internal buffer. On
- *    entry, rio_read() refills the internal buffer via a call to
- *    read() if the internal buffer is empty.
- */
-csr::Result<size_t, std::system_error> Reader::read(char *usrbuf, size_t len) {
+Reader::~Reader() { release(); }
+
+void Reader::limit(size_t maxlen) {
+  this->maxlen = maxlen;
+  limited = true;
+}
 
-  while (!cnt) {
+void Reader::unlimit() { limited = false; }
+
+void Reader::reset(m_sock_t connfd, size_t bufsize, Transport *transport) {
+  release();
+  this->bufsize = bufsize;
+  fd = connfd;
+  this->transport = transport;
+  limited = false;
+  cnt = 0;
+}
+
+void Reader::release() {
+  if (buffer) {
+    BufferPool::instance().release(buffer, bufsize);
+    buffer = usable_buf = nullptr;
+  }
+}
+
+// blocking read of at most n bytes
+csr::Result<size_t, server_error_t> Reader::receive(char *usrbuf, size_t n) {
+  if (transport) {
+    return transport->recv(usrbuf, n);
+  }
+  while (true) {
 #if defined(__APPLE__) || defined(__linux__)
     ssize_t rc;
-    if (ISSOCKETERROR((rc = ::read(fd, buffer, sizeof(buffer))))) {
+    if (ISSOCKETERROR((rc = ::read(fd, usrbuf, n)))) {
       if (GETSOCKETERRNO() != EINTR) {
-        return csr::Result<size_t, std::system_error>::Err(
-            sys_socket_error("read error"));
+        return csr::Result<size_t, server_error_t>::Err(sys_socket_error());
       }
     }
 #elif defined(_WIN32)
     int rc;
-    if (ISSOCKETERROR((rc = ::recv(fd, buffer, (int)sizeof(buffer), 0)))) {
+    int len = n > (size_t)std::numeric_limits<int>::max()
+                  ? std::numeric_limits<int>::max()
+                  : (int)n;
+    if (ISSOCKETERROR((rc = ::recv(fd, usrbuf, len, 0)))) {
       if (GETSOCKETERRNO() != WSAEINTR) {
-        return csr::Result<size_t, std::system_error>::Err(
-            sys_socket_error("read error"));
+        return csr::Result<size_t, server_error_t>::Err(sys_socket_error());
       }
     }
 #endif
-    else if (rc == 0) {
-      return csr::Result<size_t, std::system_error>::Ok(0);
-    } else {
-      cnt = (size_t)rc;
+    else {
+      return csr::Result<size_t, server_error_t>::Ok((size_t)rc);
+    }
+  }
+}
+
+/*
+ * Refill the empty buffer. Input already available is read into the buffer
+ * held; otherwise the buffer goes back to the pool while the connection
+ * waits for input (with a MSG_PEEK of one byte), and is taken again once
+ * there is some. Returns 0 on EOF.
+ */
+csr::Result<size_t, server_error_t> Reader::fill() {
+#if defined(__APPLE__) || defined(__linux__)
+  // a Transport never blocks: the buffer is simply kept
+  if (!transport) {
+    ssize_t rc;
+    if (buffer) {
+      while (
+          ISSOCKETERROR((rc = ::recv(fd, buffer, bufsize, MSG_DONTWAIT))) &&
+          GETSOCKETERRNO() == EINTR) {
+      }
+      if (!ISSOCKETERROR(rc)) {
+        usable_buf = buffer;
+        cnt = (size_t)rc;
+        return csr::Result<size_t, server_error_t>::Ok(std::move(cnt));
+      }
+      if (!ISWOULDBLOCK(GETSOCKETERRNO())) {
+        return csr::Result<size_t, server_error_t>::Err(sys_socket_error());
+      }
+      release();
+    }
+
+    char c;
+    while (ISSOCKETERROR((rc = ::recv(fd, &c, 1, MSG_PEEK)))) {
+      if (GETSOCKETERRNO() != EINTR) {
+        return csr::Result<size_t, server_error_t>::Err(sys_socket_error());
+      }
+    }
+    if (rc == 0) {
+      return csr::Result<size_t, server_error_t>::Ok(0);
+    }
+  }
+#endif
+
+  // Windows has no MSG_DONTWAIT: the buffer is kept while waiting there
+  if (!buffer) {
+    buffer = BufferPool::instance().acquire(bufsize);
+  }
+  auto receive_result = receive(buffer, bufsize);
+  if (receive_result.is_ok()) {
+    usable_buf = buffer;
+    cnt = receive_result.unwrap();
+  }
+  return receive_result;
+}
+
+/*
+ *    This is a wrapper for the read()/send() function that
+ *    transfers min(n, rio_cnt) bytes from an internal buffer to a user
+ *    buffer, where n is the number of bytes requested by the user and
+ *    rio_cnt is the number of unread bytes in the internal buffer. On
+ *    entry, rio_read() refills the internal buffer via a call to
+ *    read() if the internal buffer is empty.
+ */
+csr::Result<size_t, server_error_t> Reader::read(char *usrbuf, size_t len) {
+  if (limited) {
+    if (maxlen == 0) {
+      return csr::Result<size_t, server_error_t>::Err(
+          server_error(ServerErr::max_len_reached));
+    }
+    len = maxlen < len ? maxlen : len;
+  }
+
+  if (!cnt) {
+    // a read as large as the buffer bypasses it
+    if (len >= bufsize) {
+      auto receive_result = receive(usrbuf, len);
+      if (receive_result.is_ok() && limited) {
+        maxlen -= receive_result.unwrap();
+      }
+      return receive_result;
+    }
+
+    auto fill_result = fill();
+    if (fill_result.is_err() || fill_result.unwrap() == 0) {
+      return fill_result;
     }
   }
 
@@ -48,18 +154,18 @@ csr::Result<size_t, std::system_error> Reader::read(char *usrbuf, size_t len) {
 
   usable_buf += bytes_to_copy;
   cnt -= bytes_to_copy;
-  if (cnt == 0) {
-    usable_buf = buffer;
+  if (limited) {
+    maxlen -= bytes_to_copy;
   }
 
-  return csr::Result<size_t, std::system_error>::Ok(std::move(bytes_to_copy));
+  return csr::Result<size_t, server_error_t>::Ok(std::move(bytes_to_copy));
 }
 
 /*
  *    Read n-1 characters via Unix syscall read().
  *    The null terminator is appended at the end.
  */
-csr::Result<size_t, std::system_error> Reader::readn(char *usrbuf, size_t n) {
+csr::Result<size_t, server_error_t> Reader::readn(char *usrbuf, size_t n) {
   size_t left = n - 1;
   while (left) {
     auto read_result = read(usrbuf, left);
@@ -77,10 +183,31 @@ csr::Result<size_t, std::system_error> Reader::readn(char *usrbuf, size_t n) {
   }
   *usrbuf = 0;
 
-  return csr::Result<size_t, std::system_error>::Ok(n - left);
+  return csr::Result<size_t, server_error_t>::Ok(n - left);
 }
 
-csr::Result<size_t, std::system_error> Reader::read_char(char *c) {
+csr::Result<size_t, server_error_t> Reader::read_exact(char *usrbuf,
+                                                       size_t n) {
+  size_t left = n;
+  while (left) {
+    auto read_result = read(usrbuf, left);
+    if (read_result.is_err()) {
+      return read_result;
+    }
+
+    size_t rc = read_result.unwrap();
+    if (rc == 0) {
+      break;
+    }
+
+    left -= rc;
+    usrbuf += rc;
+  }
+
+  return csr::Result<size_t, server_error_t>::Ok(n - left);
+}
+
+csr::Result<size_t, server_error_t> Reader::read_char(char *c) {
   return read(c, 1);
 }
 
@@ -88,7 +215,7 @@ csr::Result<size_t, std::system_error> Reader::read_char(char *c) {
  * Read a line into vector<char> usrbuf.
  * The newline character \n is included.
  */
-csr::Result<size_t, std::system_error>
+csr::Result<size_t, server_error_t>
 Reader::readline(std::vector<char> &usrbuf) {
   char c = 0;
 
@@ -105,10 +232,10 @@ Reader::readline(std::vector<char> &usrbuf) {
     usrbuf.push_back(std::move(c));
   }
 
-  return csr::Result<size_t, std::system_error>::Ok(usrbuf.size());
+  return csr::Result<size_t, server_error_t>::Ok(usrbuf.size());
 }
 
-csr::Result<size_t, std::system_error> Reader::readline(std::string &usrbuf) {
+csr::Result<size_t, server_error_t> Reader::readline(std::string &usrbuf) {
   char c = 0;
 
   while (c != '\n') {
@@ -124,39 +251,45 @@ csr::Result<size_t, std::system_error> Reader::readline(std::string &usrbuf) {
     usrbuf.push_back(std::move(c));
   }
 
-  return csr::Result<size_t, std::system_error>::Ok(usrbuf.size());
+  return csr::Result<size_t, server_error_t>::Ok(usrbuf.size());
+}
+
+void Reader::take(std::vector<char> &usrbuf) {
+  if (cnt) {
+    usrbuf.insert(usrbuf.end(), usable_buf, usable_buf + cnt);
+  }
+  cnt = 0;
+  release();
 }
 
 LimitSizeReader::LimitSizeReader(m_sock_t connfd, size_t maxlen)
-    : Reader(connfd), maxlen(maxlen) {}
+    : Reader(connfd) {
+  limit(maxlen);
+}
 
-csr::Result<size_t, server_error_t> LimitSizeReader::read(char *usrbuf,
-                                                          size_t n) {
-  if (maxlen == 0) {
-    return csr::Result<size_t, server_error_t>::Err(
-        server_error(ServerErr::max_len_reached, "read error"));
-  }
+Writer::Writer(m_sock_t connfd, size_t bufsize, Transport *transport)
+    : buffer(nullptr), bufsize(bufsize), cnt(0), fd(connfd),
+      transport(transport) {}
 
-  auto read_result = Reader::read(usrbuf, maxlen < n ? maxlen : n);
-  if (read_result.is_ok()) {
-    maxlen -= read_result.unwrap();
+Writer::~Writer() {
+  if (buffer) {
+    BufferPool::instance().release(buffer, bufsize);
   }
-  return read_result;
 }
 
-Writer::Writer(m_sock_t connfd) : buffer(), cnt(0), fd(connfd) {}
-
-csr::Result<size_t, std::system_error> Writer::write_ub(const char *usrbuf,
-                                                        size_t size) const {
+csr::Result<size_t, server_error_t> Writer::write_ub(const char *usrbuf,
+                                                     size_t size) const {
+  if (transport) {
+    return transport->send(usrbuf, size);
+  }
   size_t nleft = size;
 
   while (nleft) {
 #if defined(__APPLE__) || defined(__linux__)
     ssize_t rc;
-    if (ISSOCKETERROR((rc = ::write(fd, usrbuf, nleft)))) {
+    if (ISSOCKETERROR((rc = ::send(fd, usrbuf, nleft, SEND_FLAGS)))) {
       if (GETSOCKETERRNO() != EINTR) {
-        return csr::Result<size_t, std::system_error>::Err(
-            sys_socket_error("write error"));
+        return csr::Result<size_t, server_error_t>::Err(sys_socket_error());
       }
       rc = 0;
     }
@@ -164,13 +297,12 @@ csr::Result<size_t, std::system_error> Writer::write_ub(const char *usrbuf,
     int rc;
     // windows send function requires nleft to be int
     if (nleft > (size_t)std::numeric_limits<int>::max()) {
-      return csr::Result<size_t, std::system_error>::Err(
-          server_error(ServerErr::numeric_limit_reached, "write_ub error"));
+      return csr::Result<size_t, server_error_t>::Err(
+          server_error(ServerErr::numeric_limit_reached));
     }
     if (ISSOCKETERROR((rc = ::send(fd, usrbuf, (int)nleft, 0)))) {
       if (GETSOCKETERRNO() != WSAEINTR) {
-        return csr::Result<size_t, std::system_error>::Err(
-            sys_socket_error("write error"));
+        return csr::Result<size_t, server_error_t>::Err(sys_socket_error());
       }
       rc = 0;
     }
@@ -180,56 +312,83 @@ csr::Result<size_t, std::system_error> Writer::write_ub(const char *usrbuf,
     usrbuf += rc;
   }
 
-  return csr::Result<size_t, std::system_error>::Ok(std::move(size));
+  return csr::Result<size_t, server_error_t>::Ok(std::move(size));
 }
 
-csr::Result<size_t, std::system_error> Writer::flush() {
-  auto write_result = write_ub(buffer, cnt);
-  if (write_result.is_err()) {
-    return write_result;
+// the buffer is given back once written
+csr::Result<size_t, server_error_t> Writer::flush() {
+  if (cnt) {
+    auto write_result = write_ub(buffer, cnt);
+    if (write_result.is_err()) {
+      return write_result;
+    }
+    cnt = 0;
   }
 
-  cnt = 0;
-  return csr::Result<size_t, std::system_error>::Ok(sizeof(buffer));
+  if (buffer) {
+    BufferPool::instance().release(buffer, bufsize);
+    buffer = nullptr;
+  }
+  return csr::Result<size_t, server_error_t>::Ok(std::move(bufsize));
 }
 
-csr::Result<size_t, std::system_error> Writer::write(const char *usrbuf,
-                                                     size_t size) {
-  size_t avail = (sizeof(buffer) - cnt), nleft = size;
-  size_t bytes_to_write_to_buffer = nleft < avail ? nleft : avail;
+csr::Result<size_t, server_error_t> Writer::write(const char *usrbuf,
+                                                  size_t size) {
+  size_t nleft = size;
+
+  // complete the buffered data first, so the bytes stay in order
+  if (cnt) {
+    size_t avail = bufsize - cnt;
+    size_t bytes_to_write_to_buffer = nleft < avail ? nleft : avail;
 
-  memcpy(buffer + cnt, usrbuf, bytes_to_write_to_buffer);
-  nleft -= bytes_to_write_to_buffer;
-  usrbuf += bytes_to_write_to_buffer;
-  cnt += bytes_to_write_to_buffer;
+    memcpy(buffer + cnt, usrbuf, bytes_to_write_to_buffer);
+    nleft -= bytes_to_write_to_buffer;
+    usrbuf += bytes_to_write_to_buffer;
+    cnt += bytes_to_write_to_buffer;
 
-  if (cnt == sizeof(buffer)) {
+    if (cnt < bufsize) {
+      return csr::Result<size_t, server_error_t>::Ok(std::move(size));
+    }
     auto flush_result = flush();
     if (flush_result.is_err()) {
       return flush_result;
     }
   }
 
-  if (nleft) {
-    if (nleft >= sizeof(buffer)) {
-      auto write_result = write_ub(usrbuf, nleft);
-      if (write_result.is_err()) {
-        return write_result;
-      }
-    } else {
-      memcpy(buffer, usrbuf, nleft);
+  if (nleft >= bufsize) {
+    // too large to be buffered: written from usrbuf directly
+    auto write_result = write_ub(usrbuf, nleft);
+    if (write_result.is_err()) {
+      return write_result;
+    }
+  } else if (nleft) {
+    if (!buffer) {
+      buffer = BufferPool::instance().acquire(bufsize);
     }
+    memcpy(buffer, usrbuf, nleft);
+    cnt = nleft;
   }
 
-  return csr::Result<size_t, std::system_error>::Ok(std::move(size));
+  return csr::Result<size_t, server_error_t>::Ok(std::move(size));
 }
 
-csr::Result<size_t, std::system_error>
+csr::Result<size_t, server_error_t>
 Writer::write(const std::vector<char> &usrbuf) {
   return write(usrbuf.data(), usrbuf.size());
 }
 
-csr::Result<size_t, std::system_error>
+csr::Result<size_t, server_error_t>
 Writer::write(const std::string &usrbuf) {
   return write(usrbuf.c_str(), usrbuf.size());
+}
+
+csr::Result<size_t, server_error_t>
+Writer::write_through(const char *usrbuf, size_t size) {
+  if (cnt) {
+    auto flush_result = flush();
+    if (flush_result.is_err()) {
+      return flush_result;
+    }
+  }
+  return write_ub(usrbuf, size);
 }
\ No newline at end of file
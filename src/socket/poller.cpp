@@ -0,0 +1,219 @@
+#include "socket/poller.h"
+#include <cerrno>
+
+#if defined(__APPLE__) || defined(__linux__)
+#include <fcntl.h>
+#endif
+
+#if defined(__linux__)
+#include <sys/epoll.h>
+#endif
+
+#if defined(__linux__)
+constexpr int MAX_EVENTS = 256;
+#elif defined(_WIN32)
+// WSAPoll cannot watch a pipe: wait() returns at least this often (ms) so
+// the caller notices what wake() was meant to signal
+constexpr int WAKE_INTERVAL = 50;
+#endif
+
+Poller::Poller()
+#if defined(__linux__)
+    : epfd(-1), wake_pipe{-1, -1}
+#elif defined(__APPLE__)
+    : fds(), index(), wake_pipe{-1, -1}
+#else
+    : fds(), index()
+#endif
+{
+}
+
+Poller::~Poller() {
+#if defined(__linux__)
+  if (epfd != -1) {
+    close(epfd);
+  }
+#endif
+#if defined(__APPLE__) || defined(__linux__)
+  for (int fd : wake_pipe) {
+    if (fd != -1) {
+      close(fd);
+    }
+  }
+#endif
+}
+
+csr::Result<std::unique_ptr<Poller>, server_error_t> Poller::create() {
+  // constructor is private, so std::make_unique cannot be used
+  std::unique_ptr<Poller> poller{new Poller()};
+
+#if defined(__APPLE__) || defined(__linux__)
+  if (pipe(poller->wake_pipe) == -1) {
+    return csr::Result<std::unique_ptr<Poller>, server_error_t>::Err(
+        sys_socket_error());
+  }
+  for (int fd : poller->wake_pipe) {
+    if (fcntl(fd, F_SETFL, O_NONBLOCK) == -1 ||
+        fcntl(fd, F_SETFD, FD_CLOEXEC) == -1) {
+      return csr::Result<std::unique_ptr<Poller>, server_error_t>::Err(
+          sys_socket_error());
+    }
+  }
+#endif
+
+#if defined(__linux__)
+  if ((poller->epfd = epoll_create1(EPOLL_CLOEXEC)) == -1) {
+    return csr::Result<std::unique_ptr<Poller>, server_error_t>::Err(
+        sys_socket_error());
+  }
+  struct epoll_event ev = {};
+  ev.events = EPOLLIN;
+  ev.data.fd = poller->wake_pipe[0];
+  if (epoll_ctl(poller->epfd, EPOLL_CTL_ADD, poller->wake_pipe[0], &ev) ==
+      -1) {
+    return csr::Result<std::unique_ptr<Poller>, server_error_t>::Err(
+        sys_socket_error());
+  }
+#elif defined(__APPLE__)
+  poller->fds.push_back({poller->wake_pipe[0], POLLIN, 0});
+#endif
+
+  return csr::Result<std::unique_ptr<Poller>, server_error_t>::Ok(
+      std::move(poller));
+}
+
+#if defined(__linux__)
+static csr::Result<std::monostate, server_error_t> Epoll_ctl(int epfd, int op,
+                                                             int fd,
+                                                             bool write) {
+  struct epoll_event ev = {};
+  ev.events = EPOLLIN | EPOLLRDHUP | (write ? (uint32_t)EPOLLOUT : 0u);
+  ev.data.fd = fd;
+  if (epoll_ctl(epfd, op, fd, &ev) == -1) {
+    return csr::Result<std::monostate, server_error_t>::Err(
+        sys_socket_error());
+  }
+  return csr::Result<std::monostate, server_error_t>();
+}
+#endif
+
+csr::Result<std::monostate, server_error_t> Poller::add(m_sock_t fd,
+                                                        bool write) {
+#if defined(__linux__)
+  return Epoll_ctl(epfd, EPOLL_CTL_ADD, fd, write);
+#else
+  index[fd] = fds.size();
+  fds.push_back({fd, (short)(POLLIN | (write ? POLLOUT : 0)), 0});
+  return csr::Result<std::monostate, server_error_t>();
+#endif
+}
+
+csr::Result<std::monostate, server_error_t> Poller::modify(m_sock_t fd,
+                                                           bool write) {
+#if defined(__linux__)
+  return Epoll_ctl(epfd, EPOLL_CTL_MOD, fd, write);
+#else
+  auto it = index.find(fd);
+  if (it != index.end()) {
+    fds[it->second].events = (short)(POLLIN | (write ? POLLOUT : 0));
+  }
+  return csr::Result<std::monostate, server_error_t>();
+#endif
+}
+
+csr::Result<std::monostate, server_error_t> Poller::remove(m_sock_t fd) {
+#if defined(__linux__)
+  if (epoll_ctl(epfd, EPOLL_CTL_DEL, fd, nullptr) == -1) {
+    return csr::Result<std::monostate, server_error_t>::Err(
+        sys_socket_error());
+  }
+#else
+  auto it = index.find(fd);
+  if (it != index.end()) {
+    // move the last socket into the hole
+    fds[it->second] = fds.back();
+    index[fds.back().fd] = it->second;
+    fds.pop_back();
+    index.erase(fd);
+  }
+#endif
+  return csr::Result<std::monostate, server_error_t>();
+}
+
+csr::Result<std::monostate, server_error_t>
+Poller::wait(int timeout, std::vector<PollEvent> &events) {
+  events.clear();
+
+#if defined(__linux__)
+  struct epoll_event evs[MAX_EVENTS];
+  int n = epoll_wait(epfd, evs, MAX_EVENTS, timeout);
+  if (n == -1) {
+    if (errno == EINTR) {
+      return csr::Result<std::monostate, server_error_t>();
+    }
+    return csr::Result<std::monostate, server_error_t>::Err(
+        sys_socket_error());
+  }
+
+  for (int i = 0; i < n; ++i) {
+    if (evs[i].data.fd == wake_pipe[0]) {
+      char buf[64];
+      while (read(wake_pipe[0], buf, sizeof(buf)) > 0) {
+      }
+      continue;
+    }
+    events.push_back({evs[i].data.fd, (evs[i].events & EPOLLIN) != 0,
+                      (evs[i].events & EPOLLOUT) != 0,
+                      (evs[i].events & (EPOLLERR | EPOLLHUP)) != 0});
+  }
+#else
+#if defined(_WIN32)
+  if (timeout < 0 || timeout > WAKE_INTERVAL) {
+    timeout = WAKE_INTERVAL;
+  }
+  if (fds.empty()) {
+    Sleep((DWORD)timeout);
+    return csr::Result<std::monostate, server_error_t>();
+  }
+  int n = WSAPoll(fds.data(), (ULONG)fds.size(), timeout);
+#else
+  int n = poll(fds.data(), (nfds_t)fds.size(), timeout);
+#endif
+  if (ISSOCKETERROR(n)) {
+#if defined(__APPLE__)
+    if (errno == EINTR) {
+      return csr::Result<std::monostate, server_error_t>();
+    }
+#endif
+    return csr::Result<std::monostate, server_error_t>::Err(
+        sys_socket_error());
+  }
+
+  for (auto &pfd : fds) {
+    if (!pfd.revents) {
+      continue;
+    }
+#if defined(__APPLE__)
+    if (pfd.fd == wake_pipe[0]) {
+      char buf[64];
+      while (read(wake_pipe[0], buf, sizeof(buf)) > 0) {
+      }
+      continue;
+    }
+#endif
+    events.push_back({pfd.fd, (pfd.revents & POLLIN) != 0,
+                      (pfd.revents & POLLOUT) != 0,
+                      (pfd.revents & (POLLERR | POLLHUP | POLLNVAL)) != 0});
+  }
+#endif
+
+  return csr::Result<std::monostate, server_error_t>();
+}
+
+void Poller::wake() {
+#if defined(__APPLE__) || defined(__linux__)
+  // a full pipe already has a wake-up pending
+  char c = 0;
+  (void)!write(wake_pipe[1], &c, 1);
+#endif
+}
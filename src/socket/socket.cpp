@@ -1,18 +1,35 @@
 #include "socket/socket.h"
 #include <cerrno>
+#include <cstddef>
 #include <cstring>
 
+#if defined(__APPLE__) || defined(__linux__)
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#endif
+
 #ifdef _WIN32
 #include <limits>
 #endif
 
-constexpr size_t LISTENQ = 1024;
-
-static csr::Result<std::monostate, std::system_error> Close(m_sock_t fd);
+static csr::Result<std::monostate, server_error_t> Close(m_sock_t fd);
+static csr::Result<std::monostate, server_error_t>
+Setsockopt(m_sock_t fd, int level, int optname, int value);
+static csr::Result<std::monostate, server_error_t>
+Setnonblock(m_sock_t fd, bool nonblock);
+#if defined(__APPLE__) || defined(__linux__)
+static csr::Result<socklen_t, server_error_t>
+Unixaddr(const std::string &path, struct sockaddr_un &addr);
+#endif
 
 #ifdef _WIN32
-static csr::Result<std::monostate, std::system_error> init_WSA();
-static csr::Result<std::monostate, std::system_error> cleanup_WSA();
+static csr::Result<std::monostate, server_error_t> init_WSA();
+static csr::Result<std::monostate, server_error_t> cleanup_WSA();
 #endif
 
 SocketClient::SocketClient(m_sock_t connfd, socklen_t clientlen,
@@ -20,9 +37,10 @@ SocketClient::SocketClient(m_sock_t connfd, socklen_t clientlen,
     : connfd(csr::Option<m_sock_t>::Some(std::move(connfd))),
       clientlen(clientlen), clientaddr(clientaddr) {}
 
+// errors of close() leave nothing to recover, so they are ignored here
 SocketClient::~SocketClient() {
   if (connfd.is_some()) {
-    Close(connfd.unwrap()).unwrap();
+    (void)Close(connfd.unwrap());
   }
 }
 
@@ -32,51 +50,292 @@ SocketClient::SocketClient(SocketClient &&other)
   other.connfd = csr::Option<int>::None();
 }
 
-Socket::Socket(m_sock_t sockfd)
-    : sockfd(csr::Option<m_sock_t>::Some(std::move(sockfd))) {}
+csr::Result<std::monostate, server_error_t> SocketClient::shutdown() const {
+  // the connection may have been closed or handed over already
+  if (connfd.is_none()) {
+    return csr::Result<std::monostate, server_error_t>();
+  }
+
+#if defined(__APPLE__) || defined(__linux__)
+  if (ISSOCKETERROR(::shutdown(connfd.unwrap(), SHUT_RDWR)) &&
+      GETSOCKETERRNO() != ENOTCONN) {
+#elif defined(_WIN32)
+  if (ISSOCKETERROR(::shutdown(connfd.unwrap(), SD_BOTH)) &&
+      GETSOCKETERRNO() != WSAENOTCONN) {
+#endif
+    return csr::Result<std::monostate, server_error_t>::Err(sys_socket_error());
+  }
+  return csr::Result<std::monostate, server_error_t>();
+}
+
+csr::Result<std::monostate, server_error_t>
+SocketClient::set_nonblock(bool nonblock) const {
+  return Setnonblock(connfd.unwrap(), nonblock);
+}
+
+csr::Result<std::monostate, server_error_t> SocketClient::close() {
+  if (connfd.is_none()) {
+    return csr::Result<std::monostate, server_error_t>();
+  }
+  m_sock_t fd = connfd.unwrap();
+  connfd = csr::Option<m_sock_t>::None();
+  return Close(fd);
+}
+
+csr::Result<std::monostate, server_error_t>
+SocketClient::set_timeout(int timeout) const {
+#if defined(__APPLE__) || defined(__linux__)
+  struct timeval tv = {timeout / 1000, (timeout % 1000) * 1000};
+  const char *value = (const char *)&tv;
+  socklen_t len = sizeof(tv);
+#elif defined(_WIN32)
+  DWORD ms = (DWORD)timeout;
+  const char *value = (const char *)&ms;
+  int len = (int)sizeof(ms);
+#endif
+  m_sock_t fd = connfd.unwrap();
+  if (ISSOCKETERROR(setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, value, len)) ||
+      ISSOCKETERROR(setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, value, len))) {
+    return csr::Result<std::monostate, server_error_t>::Err(sys_socket_error());
+  }
+  return csr::Result<std::monostate, server_error_t>();
+}
+
+Socket::Socket(m_sock_t sockfd, const ServerOptions &options)
+    : sockfd(csr::Option<m_sock_t>::Some(std::move(sockfd))), owner(true),
+      path(), path_dev(0), path_ino(0), nodelay(options.tcp_nodelay),
+      cloexec(options.accept_cloexec), bufsize(options.buffer_size), tls() {}
 
-// * This destructor may throw exception
 Socket::~Socket() {
-  if (sockfd.is_some()) {
-    Close(sockfd.unwrap()).unwrap();
+  (void)close();
 
 #ifdef _WIN32
-    cleanup_WSA().unwrap();
-#endif
+  if (owner) {
+    (void)cleanup_WSA();
   }
+#endif
 }
 
-Socket::Socket(Socket &&other) : sockfd(std::move(other.sockfd)) {
+Socket::Socket(Socket &&other)
+    : sockfd(std::move(other.sockfd)), owner(other.owner),
+      path(std::move(other.path)), path_dev(other.path_dev),
+      path_ino(other.path_ino), nodelay(other.nodelay),
+      cloexec(other.cloexec), bufsize(other.bufsize),
+      tls(std::move(other.tls)) {
   other.sockfd = csr::Option<int>::None();
+  other.owner = false;
+  other.path.clear();
 }
 
-csr::Result<m_sock_t, std::system_error>
-Socket::_Accept(m_sock_t listenfd, struct sockaddr *addr, socklen_t *addrlen) {
+csr::Result<csr::Option<m_sock_t>, server_error_t>
+Socket::_Accept(m_sock_t listenfd, struct sockaddr *addr,
+                socklen_t *addrlen) const {
   m_sock_t fd;
-  if (ISINVALIDSOCKET((fd = ::accept(listenfd, addr, addrlen)))) {
-    return csr::Result<int, std::system_error>::Err(
-        sys_socket_error("accept error"));
+
+#if defined(__linux__)
+  // set the descriptor flags atomically with the accept
+  fd = ::accept4(listenfd, addr, addrlen, cloexec ? SOCK_CLOEXEC : 0);
+#else
+  fd = ::accept(listenfd, addr, addrlen);
+#endif
+
+  if (ISINVALIDSOCKET(fd)) {
+    int err = GETSOCKETERRNO();
+    // the listening socket is nonblocking, and the pending connection may
+    // have been taken by another process or reset before being accepted
+#if defined(__APPLE__) || defined(__linux__)
+    if (ISWOULDBLOCK(err) || err == ECONNABORTED || err == EINTR) {
+#elif defined(_WIN32)
+    if (ISWOULDBLOCK(err) || err == WSAECONNRESET || err == WSAEINTR) {
+#endif
+      return csr::Result<csr::Option<m_sock_t>, server_error_t>::Ok(
+          csr::Option<m_sock_t>::None());
+    }
+    return csr::Result<csr::Option<m_sock_t>, server_error_t>::Err(
+        sys_socket_error());
+  }
+
+#if defined(__APPLE__)
+  if (cloexec && fcntl(fd, F_SETFD, FD_CLOEXEC) == -1) {
+    auto err = sys_socket_error();
+    (void)Close(fd);
+    return csr::Result<csr::Option<m_sock_t>, server_error_t>::Err(
+        std::move(err));
+  }
+#endif
+
+#if defined(__APPLE__) || defined(_WIN32)
+  // accepted sockets inherit the nonblocking mode of the listening socket
+  auto setnonblock_ret = Setnonblock(fd, false);
+  if (setnonblock_ret.is_err()) {
+    (void)Close(fd);
+    return csr::Result<csr::Option<m_sock_t>, server_error_t>::Err(
+        std::move(setnonblock_ret.unwrap_err()));
+  }
+#endif
+
+#if defined(__APPLE__)
+  // report EPIPE instead of raising SIGPIPE (see MSG_NOSIGNAL in Writer)
+  auto nosigpipe_ret = Setsockopt(fd, SOL_SOCKET, SO_NOSIGPIPE, 1);
+  if (nosigpipe_ret.is_err()) {
+    (void)Close(fd);
+    return csr::Result<csr::Option<m_sock_t>, server_error_t>::Err(
+        std::move(nosigpipe_ret.unwrap_err()));
   }
-  return csr::Result<m_sock_t, std::system_error>::Ok(std::move(fd));
-  ;
+#endif
+
+  if (nodelay) {
+    auto setsockopt_ret = Setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, 1);
+    if (setsockopt_ret.is_err()) {
+      (void)Close(fd);
+      return csr::Result<csr::Option<m_sock_t>, server_error_t>::Err(
+          std::move(setsockopt_ret.unwrap_err()));
+    }
+  }
+
+  return csr::Result<csr::Option<m_sock_t>, server_error_t>::Ok(
+      csr::Option<m_sock_t>::Some(std::move(fd)));
 }
 
-csr::Result<SocketClient, std::system_error> Socket::accept() const {
+csr::Result<SocketClient, server_error_t> Socket::accept() const {
+  while (true) {
+    auto accept_ret = accept_for(-1);
+    if (accept_ret.is_err()) {
+      return csr::Result<SocketClient, server_error_t>::Err(
+          std::move(accept_ret.unwrap_err()));
+    }
+
+    if (accept_ret.unwrap().is_some()) {
+      return csr::Result<SocketClient, server_error_t>::Ok(
+          std::move(accept_ret.unwrap().unwrap()));
+    }
+  }
+}
+
+csr::Result<csr::Option<SocketClient>, server_error_t>
+Socket::accept_for(int timeout) const {
   struct sockaddr_storage clientaddr;
   socklen_t clientlen = sizeof(struct sockaddr_storage);
 
+#if defined(__APPLE__) || defined(__linux__)
+  struct pollfd pfd = {sockfd.unwrap(), POLLIN, 0};
+  int rc = poll(&pfd, 1, timeout);
+#elif defined(_WIN32)
+  WSAPOLLFD pfd = {sockfd.unwrap(), POLLRDNORM, 0};
+  int rc = WSAPoll(&pfd, 1, timeout);
+#endif
+
+  if (ISSOCKETERROR(rc)) {
+#if defined(__APPLE__) || defined(__linux__)
+    if (GETSOCKETERRNO() != EINTR) {
+#elif defined(_WIN32)
+    if (GETSOCKETERRNO() != WSAEINTR) {
+#endif
+      return csr::Result<csr::Option<SocketClient>, server_error_t>::Err(
+          sys_socket_error());
+    }
+    rc = 0;
+  }
+  if (rc == 0) {
+    return csr::Result<csr::Option<SocketClient>, server_error_t>::Ok(
+        csr::Option<SocketClient>::None());
+  }
+
   auto accept_ret =
       _Accept(sockfd.unwrap(), (struct sockaddr *)&clientaddr, &clientlen);
   if (accept_ret.is_err()) {
-    return csr::Result<SocketClient, std::system_error>::Err(
+    return csr::Result<csr::Option<SocketClient>, server_error_t>::Err(
         std::move(accept_ret.unwrap_err()));
   }
+  if (accept_ret.unwrap().is_none()) {
+    return csr::Result<csr::Option<SocketClient>, server_error_t>::Ok(
+        csr::Option<SocketClient>::None());
+  }
+
+  return csr::Result<csr::Option<SocketClient>, server_error_t>::Ok(
+      csr::Option<SocketClient>::Some(
+          SocketClient{accept_ret.unwrap().unwrap(), clientlen, clientaddr}));
+}
+
+csr::Result<std::monostate, server_error_t>
+Socket::secure(SocketClient &sc) const {
+  if (!tls) {
+    return csr::Result<std::monostate, server_error_t>();
+  }
+  return tls->accept(sc);
+}
+
+csr::Result<std::monostate, server_error_t> Socket::close() {
+  if (sockfd.is_none()) {
+    return csr::Result<std::monostate, server_error_t>();
+  }
+
+  auto close_ret = Close(sockfd.unwrap());
+  sockfd = csr::Option<m_sock_t>::None();
+
+#if defined(__APPLE__) || defined(__linux__)
+  // another process may have bound the path since (e.g. after a restart)
+  struct stat st;
+  if (!path.empty() && stat(path.c_str(), &st) == 0 &&
+      (uint64_t)st.st_dev == path_dev && (uint64_t)st.st_ino == path_ino) {
+    unlink(path.c_str());
+  }
+  path.clear();
+#endif
+
+  return close_ret;
+}
+
+m_sock_t Socket::fd() const { return sockfd.unwrap(); }
+
+size_t Socket::buffer_size() const { return bufsize; }
+
+csr::Result<std::monostate, server_error_t>
+Socket::send_to(const SocketClient &peer) {
+#if defined(__APPLE__) || defined(__linux__)
+  m_sock_t fd = sockfd.unwrap();
+  char data = 0;
+  struct iovec iov = {&data, 1};
+
+  alignas(struct cmsghdr) char control[CMSG_SPACE(sizeof(fd))];
+  memset(control, 0, sizeof(control));
+
+  struct msghdr msg;
+  memset(&msg, 0, sizeof(msg));
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  msg.msg_control = control;
+  msg.msg_controllen = sizeof(control);
+
+  struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+  cmsg->cmsg_level = SOL_SOCKET;
+  cmsg->cmsg_type = SCM_RIGHTS;
+  cmsg->cmsg_len = CMSG_LEN(sizeof(fd));
+  memcpy(CMSG_DATA(cmsg), &fd, sizeof(fd));
+
+#if defined(__linux__)
+  int flags = MSG_NOSIGNAL;
+#else
+  int flags = 0;
+#endif
 
-  return csr::Result<SocketClient, std::system_error>::Ok(
-      SocketClient{accept_ret.unwrap(), clientlen, clientaddr});
+  ssize_t rc;
+  while (ISSOCKETERROR((rc = sendmsg(peer.connfd.unwrap(), &msg, flags)))) {
+    if (GETSOCKETERRNO() != EINTR) {
+      return csr::Result<std::monostate, server_error_t>::Err(
+          sys_socket_error());
+    }
+  }
+  path.clear();
+  return csr::Result<std::monostate, server_error_t>();
+#elif defined(_WIN32)
+  (void)peer;
+  return csr::Result<std::monostate, server_error_t>::Err(
+      server_error(ServerErr::unsupported_option));
+#endif
 }
 
-csr::Result<std::monostate, std::system_error>
+csr::Result<std::monostate, server_error_t>
 SocketGenerator::_Getaddrinfo(const char *node, const char *service,
                               const struct addrinfo *hints,
                               struct addrinfo **res) {
@@ -84,47 +343,125 @@ SocketGenerator::_Getaddrinfo(const char *node, const char *service,
   if ((rc = getaddrinfo(node, service, hints, res)) != 0) {
     // use server_error to encapsulate the getaddrinfo error
     // as this error is not supported by standard Unix errno
-    return csr::Result<std::monostate, std::system_error>::Err(
-        server_error(ServerErr::getaddrinfo_fail,
-                     "getaddrinfo error(" + std::to_string(rc) + ")"));
+    return csr::Result<std::monostate, server_error_t>::Err(
+        server_error(ServerErr::getaddrinfo_fail));
   }
-  return csr::Result<std::monostate, std::system_error>();
+  return csr::Result<std::monostate, server_error_t>();
 }
 
-csr::Result<m_sock_t, std::system_error>
+csr::Result<m_sock_t, server_error_t>
 SocketGenerator::_Socket(int domain, int type, int protocol) {
   m_sock_t fd;
   if (ISINVALIDSOCKET((fd = socket(domain, type, protocol)))) {
-    return csr::Result<int, std::system_error>::Err(
-        sys_socket_error("close error"));
+    return csr::Result<int, server_error_t>::Err(sys_socket_error());
   }
-  return csr::Result<m_sock_t, std::system_error>::Ok(std::move(fd));
+  return csr::Result<m_sock_t, server_error_t>::Ok(std::move(fd));
 }
 
-csr::Result<std::monostate, std::system_error>
+csr::Result<std::monostate, server_error_t>
 SocketGenerator::_Bind(m_sock_t sockfd, const struct sockaddr *addr,
                        socklen_t addrlen) {
   if (ISSOCKETERROR((bind(sockfd, addr, addrlen)))) {
-    return csr::Result<std::monostate, std::system_error>::Err(
-        sys_socket_error("bind error"));
+    return csr::Result<std::monostate, server_error_t>::Err(sys_socket_error());
   }
-  return csr::Result<std::monostate, std::system_error>();
+  return csr::Result<std::monostate, server_error_t>();
 }
 
-csr::Result<std::monostate, std::system_error>
+csr::Result<std::monostate, server_error_t>
 SocketGenerator::_Listen(m_sock_t sockfd, int backlog) {
   if (ISSOCKETERROR((::listen(sockfd, backlog)))) {
-    return csr::Result<std::monostate, std::system_error>::Err(
-        sys_socket_error("listen error"));
+    return csr::Result<std::monostate, server_error_t>::Err(sys_socket_error());
+  }
+  return csr::Result<std::monostate, server_error_t>();
+}
+
+/*
+ * Apply the listening socket options. They are set before bind() so
+ * SO_REUSEADDR/SO_REUSEPORT take effect for the bind itself.
+ */
+csr::Result<std::monostate, server_error_t>
+SocketGenerator::_Setsockopts(m_sock_t sockfd, const ServerOptions &options) {
+  csr::Result<std::monostate, server_error_t> ret;
+
+  if (options.reuse_addr &&
+      (ret = Setsockopt(sockfd, SOL_SOCKET, SO_REUSEADDR, 1)).is_err()) {
+    return ret;
+  }
+
+  if (options.reuse_port) {
+#ifdef SO_REUSEPORT
+    if ((ret = Setsockopt(sockfd, SOL_SOCKET, SO_REUSEPORT, 1)).is_err()) {
+      return ret;
+    }
+#else
+    return csr::Result<std::monostate, server_error_t>::Err(
+        server_error(ServerErr::unsupported_option));
+#endif
+  }
+
+  if (options.send_buffer &&
+      (ret = Setsockopt(sockfd, SOL_SOCKET, SO_SNDBUF, options.send_buffer))
+          .is_err()) {
+    return ret;
+  }
+
+  if (options.recv_buffer &&
+      (ret = Setsockopt(sockfd, SOL_SOCKET, SO_RCVBUF, options.recv_buffer))
+          .is_err()) {
+    return ret;
+  }
+
+  if (options.defer_accept) {
+#ifdef TCP_DEFER_ACCEPT
+    if ((ret = Setsockopt(sockfd, IPPROTO_TCP, TCP_DEFER_ACCEPT,
+                          options.defer_accept))
+            .is_err()) {
+      return ret;
+    }
+#else
+    return csr::Result<std::monostate, server_error_t>::Err(
+        server_error(ServerErr::unsupported_option));
+#endif
+  }
+
+  if (options.fastopen) {
+#ifdef TCP_FASTOPEN
+    if ((ret = Setsockopt(sockfd, IPPROTO_TCP, TCP_FASTOPEN,
+                          options.fastopen))
+            .is_err()) {
+      return ret;
+    }
+#else
+    return csr::Result<std::monostate, server_error_t>::Err(
+        server_error(ServerErr::unsupported_option));
+#endif
+  }
+
+  return ret;
+}
+
+// load the TLS certificate of the options, if any
+csr::Result<std::monostate, server_error_t>
+SocketGenerator::_Secure(Socket &s, const ServerOptions &options) {
+  if (options.tls_cert.empty() && options.tls_key.empty()) {
+    return csr::Result<std::monostate, server_error_t>();
+  }
+
+  auto create_ret = TlsContext::create(options.tls_cert, options.tls_key);
+  if (create_ret.is_err()) {
+    return csr::Result<std::monostate, server_error_t>::Err(
+        std::move(create_ret.unwrap_err()));
   }
-  return csr::Result<std::monostate, std::system_error>();
+  s.tls = std::move(create_ret.unwrap());
+  return csr::Result<std::monostate, server_error_t>();
 }
 
-csr::Result<Socket, server_error_t> SocketGenerator::listen(int port) {
+csr::Result<Socket, server_error_t>
+SocketGenerator::listen(int port, const ServerOptions &options) {
 #ifdef _WIN32
   auto startup_result = init_WSA();
   if (startup_result.is_err()) {
-    return csr::Result<Socket, std::system_error>::Err(
+    return csr::Result<Socket, server_error_t>::Err(
         std::move(startup_result.unwrap_err()));
   }
 #endif
@@ -138,16 +475,17 @@ csr::Result<Socket, server_error_t> SocketGenerator::listen(int port) {
   hints.ai_flags |= AI_NUMERICSERV; /* ... using port number */
 
   auto getaddrinfo_result =
-      _Getaddrinfo(NULL, std::to_string(port).c_str(), &hints, &res);
+      _Getaddrinfo(options.address.empty() ? NULL : options.address.c_str(),
+                   std::to_string(port).c_str(), &hints, &res);
   if (getaddrinfo_result.is_err()) {
 #ifdef _WIN32
-    cleanup_WSA().unwrap();
+    (void)cleanup_WSA();
 #endif
-    return csr::Result<Socket, std::system_error>::Err(
+    return csr::Result<Socket, server_error_t>::Err(
         std::move(getaddrinfo_result.unwrap_err()));
   }
 
-  m_sock_t listenfd;
+  m_sock_t listenfd{};
 
   for (p = res; p; p = p->ai_next) {
     auto socket_ret = _Socket(p->ai_family, p->ai_socktype, p->ai_protocol);
@@ -157,12 +495,23 @@ csr::Result<Socket, server_error_t> SocketGenerator::listen(int port) {
 
     listenfd = socket_ret.unwrap();
 
+    auto setsockopts_ret = _Setsockopts(listenfd, options);
+    if (setsockopts_ret.is_err()) {
+      (void)Close(listenfd);
+      freeaddrinfo(res);
+#ifdef _WIN32
+      (void)cleanup_WSA();
+#endif
+      return csr::Result<Socket, server_error_t>::Err(
+          std::move(setsockopts_ret.unwrap_err()));
+    }
+
 #if defined(_WIN32)
     // it's reasonable to assume that ai_addrlen is smaller than int max
     // however, it's better to add a test to ensure this never happen
     if (p->ai_addrlen > (size_t)std::numeric_limits<int>::max()) {
-      return csr::Result<Socket, std::system_error>::Err(
-          server_error(ServerErr::numeric_limit_reached, "listen error"));
+      return csr::Result<Socket, server_error_t>::Err(
+          server_error(ServerErr::numeric_limit_reached));
     }
 #endif
 
@@ -170,52 +519,383 @@ csr::Result<Socket, server_error_t> SocketGenerator::listen(int port) {
     if (_Bind(listenfd, p->ai_addr, (socklen_t)p->ai_addrlen).is_ok())
       break;
 
-    Close(listenfd).unwrap();
+    (void)Close(listenfd);
   }
 
   freeaddrinfo(res);
 
   if (!p) {
 #ifdef _WIN32
-    cleanup_WSA().unwrap();
+    (void)cleanup_WSA();
 #endif
-    return csr::Result<Socket, std::system_error>::Err(
-        server_error(ServerErr::no_available_address, "listen error"));
+    return csr::Result<Socket, server_error_t>::Err(
+        server_error(ServerErr::no_available_address));
   }
 
   /* Make it a listening socket ready to accept connection requests */
-  auto listen_ret = _Listen(listenfd, LISTENQ);
+  auto listen_ret = _Listen(listenfd, options.backlog);
+  if (listen_ret.is_ok()) {
+    /* accept() must not block if another process takes the connection */
+    listen_ret = Setnonblock(listenfd, true);
+  }
   if (listen_ret.is_err()) {
+    (void)Close(listenfd);
 #ifdef _WIN32
-    cleanup_WSA().unwrap();
+    (void)cleanup_WSA();
 #endif
-    return csr::Result<Socket, std::system_error>::Err(
+    return csr::Result<Socket, server_error_t>::Err(
         std::move(listen_ret.unwrap_err()));
   }
 
-  return csr::Result<Socket, std::system_error>::Ok(Socket{listenfd});
+  Socket s{listenfd, options};
+  auto secure_ret = _Secure(s, options);
+  if (secure_ret.is_err()) {
+    return csr::Result<Socket, server_error_t>::Err(
+        std::move(secure_ret.unwrap_err()));
+  }
+  return csr::Result<Socket, server_error_t>::Ok(std::move(s));
 }
 
-static csr::Result<std::monostate, std::system_error> Close(m_sock_t fd) {
+csr::Result<Socket, server_error_t>
+SocketGenerator::listen_unix(const std::string &path,
+                             const ServerOptions &options) {
+#if defined(__APPLE__) || defined(__linux__)
+  struct sockaddr_un addr;
+  auto addr_ret = Unixaddr(path, addr);
+  if (addr_ret.is_err()) {
+    return csr::Result<Socket, server_error_t>::Err(
+        std::move(addr_ret.unwrap_err()));
+  }
+  bool abstract = path[0] == '@';
+
+  auto socket_ret = _Socket(AF_UNIX, SOCK_STREAM, 0);
+  if (socket_ret.is_err()) {
+    return csr::Result<Socket, server_error_t>::Err(
+        std::move(socket_ret.unwrap_err()));
+  }
+  m_sock_t listenfd = socket_ret.unwrap();
+
+  // remove the file left by a previous process
+  if (!abstract) {
+    unlink(path.c_str());
+  }
+
+  auto ret = _Bind(listenfd, (struct sockaddr *)&addr, addr_ret.unwrap());
+  if (ret.is_ok()) {
+    ret = _Listen(listenfd, options.backlog);
+  }
+  if (ret.is_ok()) {
+    ret = Setnonblock(listenfd, true);
+  }
+  if (ret.is_err()) {
+    (void)Close(listenfd);
+    return csr::Result<Socket, server_error_t>::Err(
+        std::move(ret.unwrap_err()));
+  }
+
+  ServerOptions unix_options = options;
+  unix_options.tcp_nodelay = false;
+  Socket s{listenfd, unix_options};
+
+  struct stat st;
+  if (!abstract && stat(path.c_str(), &st) == 0) {
+    s.path = path;
+    s.path_dev = (uint64_t)st.st_dev;
+    s.path_ino = (uint64_t)st.st_ino;
+  }
+
+  auto secure_ret = _Secure(s, options);
+  if (secure_ret.is_err()) {
+    return csr::Result<Socket, server_error_t>::Err(
+        std::move(secure_ret.unwrap_err()));
+  }
+  return csr::Result<Socket, server_error_t>::Ok(std::move(s));
+#elif defined(_WIN32)
+  (void)path;
+  (void)options;
+  return csr::Result<Socket, server_error_t>::Err(
+      server_error(ServerErr::unsupported_option));
+#endif
+}
+
+csr::Result<Socket, server_error_t>
+SocketGenerator::inherit(const std::string &path,
+                         const ServerOptions &options) {
+#if defined(__APPLE__) || defined(__linux__)
+  struct sockaddr_un addr;
+  auto addr_ret = Unixaddr(path, addr);
+  if (addr_ret.is_err()) {
+    return csr::Result<Socket, server_error_t>::Err(
+        std::move(addr_ret.unwrap_err()));
+  }
+
+  auto socket_ret = _Socket(AF_UNIX, SOCK_STREAM, 0);
+  if (socket_ret.is_err()) {
+    return csr::Result<Socket, server_error_t>::Err(
+        std::move(socket_ret.unwrap_err()));
+  }
+  m_sock_t connfd = socket_ret.unwrap();
+
+  if (ISSOCKETERROR(
+          ::connect(connfd, (struct sockaddr *)&addr, addr_ret.unwrap()))) {
+    auto err = sys_socket_error();
+    (void)Close(connfd);
+    return csr::Result<Socket, server_error_t>::Err(std::move(err));
+  }
+
+  m_sock_t fd;
+  char data;
+  struct iovec iov = {&data, 1};
+
+  alignas(struct cmsghdr) char control[CMSG_SPACE(sizeof(fd))];
+  struct msghdr msg;
+  memset(&msg, 0, sizeof(msg));
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  msg.msg_control = control;
+  msg.msg_controllen = sizeof(control);
+
+#if defined(__linux__)
+  int flags = MSG_CMSG_CLOEXEC;
+#else
+  int flags = 0;
+#endif
+
+  ssize_t rc;
+  while (ISSOCKETERROR((rc = recvmsg(connfd, &msg, flags))) &&
+         GETSOCKETERRNO() == EINTR) {
+  }
+  if (ISSOCKETERROR(rc)) {
+    auto err = sys_socket_error();
+    (void)Close(connfd);
+    return csr::Result<Socket, server_error_t>::Err(std::move(err));
+  }
+  (void)Close(connfd);
+
+  struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+  if (rc == 0 || !cmsg || cmsg->cmsg_level != SOL_SOCKET ||
+      cmsg->cmsg_type != SCM_RIGHTS) {
+    return csr::Result<Socket, server_error_t>::Err(
+        server_error(ServerErr::connection_close_by_client));
+  }
+  memcpy(&fd, CMSG_DATA(cmsg), sizeof(fd));
+
+  // the handed over listener may be a Unix socket
+  ServerOptions inherited_options = options;
+  struct sockaddr_un local;
+  socklen_t locallen = sizeof(local);
+  bool unix_socket =
+      !ISSOCKETERROR(getsockname(fd, (struct sockaddr *)&local, &locallen)) &&
+      local.sun_family == AF_UNIX;
+  if (unix_socket) {
+    inherited_options.tcp_nodelay = false;
+  }
+
+  Socket s{fd, inherited_options};
+
+  // the path to remove on close() is handed over with the socket
+  struct stat st;
+  if (unix_socket && locallen > offsetof(struct sockaddr_un, sun_path) &&
+      local.sun_path[0] != '\0') {
+    std::string local_path{local.sun_path,
+                           strnlen(local.sun_path, sizeof(local.sun_path))};
+    if (stat(local_path.c_str(), &st) == 0) {
+      s.path = std::move(local_path);
+      s.path_dev = (uint64_t)st.st_dev;
+      s.path_ino = (uint64_t)st.st_ino;
+    }
+  }
+  auto secure_ret = _Secure(s, options);
+  if (secure_ret.is_err()) {
+    return csr::Result<Socket, server_error_t>::Err(
+        std::move(secure_ret.unwrap_err()));
+  }
+  return csr::Result<Socket, server_error_t>::Ok(std::move(s));
+#elif defined(_WIN32)
+  (void)path;
+  (void)options;
+  return csr::Result<Socket, server_error_t>::Err(
+      server_error(ServerErr::unsupported_option));
+#endif
+}
+
+csr::Result<std::monostate, server_error_t>
+SocketGenerator::resolve(const std::string &host, int port,
+                         struct sockaddr_storage &addr, socklen_t &addrlen) {
+  struct addrinfo hints;
+  struct addrinfo *res;
+
+  memset(&hints, 0, sizeof(struct addrinfo));
+  hints.ai_socktype = SOCK_STREAM;
+  hints.ai_flags = AI_ADDRCONFIG | AI_NUMERICSERV;
+
+  auto getaddrinfo_result =
+      _Getaddrinfo(host.c_str(), std::to_string(port).c_str(), &hints, &res);
+  if (getaddrinfo_result.is_err()) {
+    return getaddrinfo_result;
+  }
+
+  memset(&addr, 0, sizeof(addr));
+  memcpy(&addr, res->ai_addr, res->ai_addrlen);
+  addrlen = (socklen_t)res->ai_addrlen;
+  freeaddrinfo(res);
+  return csr::Result<std::monostate, server_error_t>();
+}
+
+csr::Result<SocketClient, server_error_t>
+SocketGenerator::connect(const struct sockaddr_storage &addr,
+                         socklen_t addrlen, int timeout) {
+  auto socket_ret = _Socket(addr.ss_family, SOCK_STREAM, 0);
+  if (socket_ret.is_err()) {
+    return csr::Result<SocketClient, server_error_t>::Err(
+        std::move(socket_ret.unwrap_err()));
+  }
+  // closes the descriptor on the error paths
+  SocketClient sc{socket_ret.unwrap(), addrlen, addr};
+  m_sock_t fd = sc.connfd.unwrap();
+
+  // connect without blocking, so the wait can be bounded
+  auto ret = Setnonblock(fd, true);
+  if (ret.is_ok() &&
+      ISSOCKETERROR(::connect(fd, (const struct sockaddr *)&addr, addrlen))) {
+    int err = GETSOCKETERRNO();
+#if defined(__APPLE__) || defined(__linux__)
+    if (err != EINPROGRESS) {
+#elif defined(_WIN32)
+    if (err != WSAEWOULDBLOCK) {
+#endif
+      return csr::Result<SocketClient, server_error_t>::Err(sys_socket_error());
+    }
+
+#if defined(__APPLE__) || defined(__linux__)
+    struct pollfd pfd = {fd, POLLOUT, 0};
+    int rc;
+    while (ISSOCKETERROR((rc = poll(&pfd, 1, timeout))) &&
+           GETSOCKETERRNO() == EINTR) {
+    }
+#elif defined(_WIN32)
+    WSAPOLLFD pfd = {fd, POLLWRNORM, 0};
+    int rc = WSAPoll(&pfd, 1, timeout);
+#endif
+    if (ISSOCKETERROR(rc)) {
+      return csr::Result<SocketClient, server_error_t>::Err(sys_socket_error());
+    }
+    if (rc == 0) {
+      return csr::Result<SocketClient, server_error_t>::Err(
+          std::make_error_code(std::errc::timed_out));
+    }
+
+    int error = 0;
+    socklen_t len = sizeof(error);
+    if (ISSOCKETERROR(
+            getsockopt(fd, SOL_SOCKET, SO_ERROR, (char *)&error, &len))) {
+      return csr::Result<SocketClient, server_error_t>::Err(sys_socket_error());
+    }
+    if (error) {
+      return csr::Result<SocketClient, server_error_t>::Err(
+          std::error_code(error, std::system_category()));
+    }
+  }
+
+  if (ret.is_ok()) {
+    ret = Setnonblock(fd, false);
+  }
+#if defined(__APPLE__)
+  if (ret.is_ok()) {
+    ret = Setsockopt(fd, SOL_SOCKET, SO_NOSIGPIPE, 1);
+  }
+#endif
+  if (ret.is_ok()) {
+    ret = Setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, 1);
+  }
+  if (ret.is_err()) {
+    return csr::Result<SocketClient, server_error_t>::Err(
+        std::move(ret.unwrap_err()));
+  }
+  return csr::Result<SocketClient, server_error_t>::Ok(std::move(sc));
+}
+
+static csr::Result<std::monostate, server_error_t> Close(m_sock_t fd) {
   int rc;
 
 #if defined(__APPLE__) || defined(__linux__)
   if (ISSOCKETERROR((rc = close(fd)))) {
-    return csr::Result<std::monostate, std::system_error>::Err(
-        sys_socket_error("close error"));
+    return csr::Result<std::monostate, server_error_t>::Err(sys_socket_error());
   }
 #elif defined(_WIN32)
   if (ISSOCKETERROR((rc = closesocket(fd)))) {
-    return csr::Result<std::monostate, std::system_error>::Err(
-        sys_socket_error("close error"));
+    return csr::Result<std::monostate, server_error_t>::Err(sys_socket_error());
   }
 #endif
 
-  return csr::Result<std::monostate, std::system_error>();
+  return csr::Result<std::monostate, server_error_t>();
+}
+
+static csr::Result<std::monostate, server_error_t>
+Setsockopt(m_sock_t fd, int level, int optname, int value) {
+#if defined(__APPLE__) || defined(__linux__)
+  if (ISSOCKETERROR(
+          setsockopt(fd, level, optname, &value, sizeof(value)))) {
+#elif defined(_WIN32)
+  if (ISSOCKETERROR(setsockopt(fd, level, optname, (const char *)&value,
+                               (int)sizeof(value)))) {
+#endif
+    return csr::Result<std::monostate, server_error_t>::Err(sys_socket_error());
+  }
+  return csr::Result<std::monostate, server_error_t>();
 }
 
+static csr::Result<std::monostate, server_error_t>
+Setnonblock(m_sock_t fd, bool nonblock) {
+#if defined(__APPLE__) || defined(__linux__)
+  int flags = fcntl(fd, F_GETFL);
+  if (flags == -1 ||
+      fcntl(fd, F_SETFL, nonblock ? flags | O_NONBLOCK : flags & ~O_NONBLOCK) ==
+          -1) {
+    return csr::Result<std::monostate, server_error_t>::Err(sys_socket_error());
+  }
+#elif defined(_WIN32)
+  u_long mode = nonblock ? 1 : 0;
+  if (ISSOCKETERROR(ioctlsocket(fd, FIONBIO, &mode))) {
+    return csr::Result<std::monostate, server_error_t>::Err(sys_socket_error());
+  }
+#endif
+  return csr::Result<std::monostate, server_error_t>();
+}
+
+#if defined(__APPLE__) || defined(__linux__)
+static csr::Result<socklen_t, server_error_t>
+Unixaddr(const std::string &path, struct sockaddr_un &addr) {
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  if (path.empty()) {
+    return csr::Result<socklen_t, server_error_t>::Err(
+        server_error(ServerErr::no_available_address));
+  }
+  if (path.size() >= sizeof(addr.sun_path)) {
+    return csr::Result<socklen_t, server_error_t>::Err(
+        server_error(ServerErr::max_len_reached));
+  }
+  memcpy(addr.sun_path, path.c_str(), path.size());
+
+  if (path[0] != '@') {
+    return csr::Result<socklen_t, server_error_t>::Ok(
+        (socklen_t)sizeof(addr));
+  }
+#if defined(__linux__)
+  // the abstract name is the bytes after a leading NUL, without terminator
+  addr.sun_path[0] = '\0';
+  return csr::Result<socklen_t, server_error_t>::Ok(
+      (socklen_t)(offsetof(struct sockaddr_un, sun_path) + path.size()));
+#else
+  return csr::Result<socklen_t, server_error_t>::Err(
+      server_error(ServerErr::unsupported_option));
+#endif
+}
+#endif
+
 #ifdef _WIN32
-static csr::Result<std::monostate, std::system_error> init_WSA() {
+static csr::Result<std::monostate, server_error_t> init_WSA() {
   WSADATA wsaData;
   int ec_startup;
 
@@ -223,21 +903,20 @@ static csr::Result<std::monostate, std::system_error> init_WSA() {
   ec_startup = WSAStartup(MAKEWORD(2, 2), &wsaData);
   if (ec_startup != 0) {
     // error is directly returned, so avoid using macro
-    return csr::Result<std::monostate, std::system_error>::Err(
-        std::system_error(ec_startup, std::system_category(),
-                          "WSAStartup error"));
+    return csr::Result<std::monostate, server_error_t>::Err(
+        server_error_t(ec_startup, std::system_category(),
+                       "WSAStartup error"));
   }
 
-  return csr::Result<std::monostate, std::system_error>();
+  return csr::Result<std::monostate, server_error_t>();
 }
 
-static csr::Result<std::monostate, std::system_error> cleanup_WSA() {
+static csr::Result<std::monostate, server_error_t> cleanup_WSA() {
   int ec_cleanup;
   ec_cleanup = WSACleanup();
   if (ec_cleanup != 0) {
-    return csr::Result<std::monostate, std::system_error>::Err(
-        sys_socket_error("WSACleanup error"));
+    return csr::Result<std::monostate, server_error_t>::Err(sys_socket_error());
   }
-  return csr::Result<std::monostate, std::system_error>();
+  return csr::Result<std::monostate, server_error_t>();
 }
 #endif
\ No newline at end of file
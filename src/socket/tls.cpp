@@ -0,0 +1,220 @@
+#include "socket/tls.h"
+#include "socket/socket.h"
+
+#if defined(USE_TLS) && (defined(__APPLE__) || defined(__linux__))
+#include <cerrno>
+#include <csignal>
+#include <openssl/err.h>
+#include <openssl/ssl.h>
+#include <poll.h>
+#include <system_error>
+#include <thread>
+
+// plaintext bytes moved per read by the relay (one TLS record)
+constexpr int TLS_RELAY_SIZE = 16384;
+
+/*
+ * Move the plaintext between the TLS connection (net) and the end of the
+ * socket pair the server reads and writes (app) until the server closes its
+ * end. The input of the client is written without blocking, so a server
+ * sending its response before reading the request cannot deadlock the
+ * relay. An end of input from the client is passed on as a half close.
+ */
+static void relay(SSL *ssl, int net, int app) {
+#if defined(__linux__)
+  // SSL_write uses write(): a reset peer must not raise SIGPIPE
+  sigset_t set;
+  sigemptyset(&set);
+  sigaddset(&set, SIGPIPE);
+  pthread_sigmask(SIG_BLOCK, &set, nullptr);
+#endif
+
+  // input of the client not taken by the server yet
+  char in[TLS_RELAY_SIZE];
+  size_t in_pos = 0, in_len = 0;
+  char out[TLS_RELAY_SIZE];
+  struct pollfd fds[2] = {{net, POLLIN, 0}, {app, POLLIN, 0}};
+  bool net_open = true;
+
+  while (true) {
+    bool read_net = net_open && in_pos == in_len;
+    // decrypted bytes may be left over from the last record
+    bool pending = read_net && SSL_pending(ssl) > 0;
+    if (pending) {
+      fds[0].revents = fds[1].revents = 0;
+    } else {
+      fds[0].fd = read_net ? net : -1;
+      fds[1].events = (short)(POLLIN | (in_pos < in_len ? POLLOUT : 0));
+      if (ISSOCKETERROR(poll(fds, 2, -1))) {
+        if (GETSOCKETERRNO() == EINTR) {
+          continue;
+        }
+        break;
+      }
+    }
+
+    if (read_net && (pending || fds[0].revents)) {
+      int rc = SSL_read(ssl, in, sizeof(in));
+      if (rc > 0) {
+        in_pos = 0;
+        in_len = (size_t)rc;
+      } else if (SSL_get_error(ssl, rc) == SSL_ERROR_ZERO_RETURN) {
+        net_open = false;
+        (void)::shutdown(app, SHUT_WR);
+      } else {
+        break;
+      }
+    }
+
+    if (in_pos < in_len) {
+      ssize_t rc = ::send(app, in + in_pos, in_len - in_pos,
+                          SEND_FLAGS | MSG_DONTWAIT);
+      if (!ISSOCKETERROR(rc)) {
+        in_pos += (size_t)rc;
+      } else if (!ISWOULDBLOCK(GETSOCKETERRNO()) &&
+                 GETSOCKETERRNO() != EINTR) {
+        // the server stopped reading: the rest of the input is dropped
+        in_pos = in_len;
+        net_open = false;
+      }
+    }
+
+    if (fds[1].revents & (POLLIN | POLLHUP | POLLERR)) {
+      ssize_t rc = ::read(app, out, sizeof(out));
+      if (ISSOCKETERROR(rc) && GETSOCKETERRNO() == EINTR) {
+        continue;
+      }
+      if (rc <= 0) {
+        // the server is done with the connection
+        (void)SSL_shutdown(ssl);
+        break;
+      }
+      if (SSL_write(ssl, out, (int)rc) <= 0) {
+        break;
+      }
+    }
+  }
+
+  SSL_free(ssl);
+  (void)::close(net);
+  (void)::close(app);
+}
+
+TlsContext::TlsContext(struct ssl_ctx_st *ctx) : ctx(ctx) {}
+
+TlsContext::~TlsContext() { SSL_CTX_free(ctx); }
+
+csr::Result<std::shared_ptr<TlsContext>, server_error_t>
+TlsContext::create(const std::string &cert, const std::string &key) {
+  SSL_CTX *ctx = SSL_CTX_new(TLS_server_method());
+  if (!ctx) {
+    return csr::Result<std::shared_ptr<TlsContext>, server_error_t>::Err(
+        server_error(ServerErr::tls_error));
+  }
+
+  (void)SSL_CTX_set_min_proto_version(ctx, TLS1_2_VERSION);
+#ifdef SSL_OP_ENABLE_KTLS
+  // OpenSSL installs the keys in the kernel once the handshake is done
+  SSL_CTX_set_options(ctx, SSL_OP_ENABLE_KTLS);
+#endif
+
+  if (SSL_CTX_use_certificate_chain_file(ctx, cert.c_str()) != 1 ||
+      SSL_CTX_use_PrivateKey_file(ctx, key.c_str(), SSL_FILETYPE_PEM) != 1 ||
+      SSL_CTX_check_private_key(ctx) != 1) {
+    ERR_clear_error();
+    SSL_CTX_free(ctx);
+    return csr::Result<std::shared_ptr<TlsContext>, server_error_t>::Err(
+        server_error(ServerErr::tls_error));
+  }
+
+  return csr::Result<std::shared_ptr<TlsContext>, server_error_t>::Ok(
+      std::shared_ptr<TlsContext>(new TlsContext(ctx)));
+}
+
+csr::Result<std::monostate, server_error_t>
+TlsContext::accept(SocketClient &sc) const {
+  int fd = sc.connfd.unwrap();
+
+  // a client stalling the handshake must not hold its thread forever
+  auto timeout_ret = sc.set_timeout(TLS_HANDSHAKE_TIMEOUT * 1000);
+  if (timeout_ret.is_err()) {
+    return timeout_ret;
+  }
+
+  SSL *ssl = SSL_new(ctx);
+  if (!ssl || SSL_set_fd(ssl, fd) != 1 || SSL_accept(ssl) != 1) {
+    ERR_clear_error();
+    SSL_free(ssl);
+    return csr::Result<std::monostate, server_error_t>::Err(
+        server_error(ServerErr::tls_error));
+  }
+
+  timeout_ret = sc.set_timeout(0);
+  if (timeout_ret.is_err()) {
+    SSL_free(ssl);
+    return timeout_ret;
+  }
+
+#ifndef OPENSSL_NO_KTLS
+  if (BIO_get_ktls_send(SSL_get_wbio(ssl)) &&
+      BIO_get_ktls_recv(SSL_get_rbio(ssl))) {
+    // the kernel encrypts and decrypts: the descriptor is plaintext now
+    SSL_free(ssl);
+    return csr::Result<std::monostate, server_error_t>();
+  }
+#endif
+
+  int pair[2];
+#if defined(__linux__)
+  int rc = socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, pair);
+#else
+  int rc = socketpair(AF_UNIX, SOCK_STREAM, 0, pair);
+#endif
+  if (ISSOCKETERROR(rc)) {
+    auto err = sys_socket_error();
+    SSL_free(ssl);
+    return csr::Result<std::monostate, server_error_t>::Err(std::move(err));
+  }
+#if defined(__APPLE__)
+  int on = 1;
+  (void)setsockopt(pair[0], SOL_SOCKET, SO_NOSIGPIPE, &on, sizeof(on));
+  (void)setsockopt(pair[1], SOL_SOCKET, SO_NOSIGPIPE, &on, sizeof(on));
+#endif
+
+  try {
+    std::thread{relay, ssl, fd, pair[1]}.detach();
+  } catch (const std::system_error &e) {
+    SSL_free(ssl);
+    (void)::close(pair[0]);
+    (void)::close(pair[1]);
+    return csr::Result<std::monostate, server_error_t>::Err(
+        server_error_t(e.code()));
+  }
+
+  // the relay owns the TCP descriptor from now on
+  sc.connfd = csr::Option<m_sock_t>::Some(std::move(pair[0]));
+  return csr::Result<std::monostate, server_error_t>();
+}
+
+#else
+
+TlsContext::TlsContext(struct ssl_ctx_st *ctx) : ctx(ctx) {}
+
+TlsContext::~TlsContext() {}
+
+csr::Result<std::shared_ptr<TlsContext>, server_error_t>
+TlsContext::create(const std::string &cert, const std::string &key) {
+  (void)cert;
+  (void)key;
+  return csr::Result<std::shared_ptr<TlsContext>, server_error_t>::Err(
+      server_error(ServerErr::unsupported_option));
+}
+
+csr::Result<std::monostate, server_error_t>
+TlsContext::accept(SocketClient &sc) const {
+  (void)sc;
+  return csr::Result<std::monostate, server_error_t>::Err(
+      server_error(ServerErr::unsupported_option));
+}
+
+#endif
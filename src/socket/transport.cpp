@@ -0,0 +1,32 @@
+#include "socket/transport.h"
+#include <cstring>
+
+MemoryTransport::MemoryTransport() : input(), consumed(0), output() {}
+
+MemoryTransport::MemoryTransport(std::string_view input)
+    : input(input.begin(), input.end()), consumed(0), output() {}
+
+void MemoryTransport::reset(std::string_view input) {
+  this->input.assign(input.begin(), input.end());
+  consumed = 0;
+  output.clear();
+}
+
+const std::vector<char> &MemoryTransport::sent() const { return output; }
+
+csr::Result<size_t, server_error_t> MemoryTransport::recv(char *usrbuf,
+                                                          size_t n) {
+  size_t avail = input.size() - consumed;
+  size_t len = n < avail ? n : avail;
+  if (len) {
+    memcpy(usrbuf, input.data() + consumed, len);
+    consumed += len;
+  }
+  return csr::Result<size_t, server_error_t>::Ok(std::move(len));
+}
+
+csr::Result<size_t, server_error_t> MemoryTransport::send(const char *usrbuf,
+                                                          size_t n) {
+  output.insert(output.end(), usrbuf, usrbuf + n);
+  return csr::Result<size_t, server_error_t>::Ok(std::move(n));
+}
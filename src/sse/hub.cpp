@@ -0,0 +1,417 @@
+#include "sse/hub.h"
+#include <algorithm>
+#include <chrono>
+#include <system_error>
+
+#ifdef _WIN32
+#include <limits>
+#endif
+
+#if defined(__APPLE__) || defined(__linux__)
+#include <sys/uio.h>
+#endif
+
+// bytes read and discarded per readiness event: clients send nothing
+constexpr size_t SSE_READ_SIZE = 512;
+
+static std::unique_ptr<Poller> create_poller() {
+  auto create_ret = Poller::create();
+  if (create_ret.is_err()) {
+    throw std::system_error(create_ret.unwrap_err(), "poller error");
+  }
+  return std::move(create_ret.unwrap());
+}
+
+// "field: value\n" for each line of value (text/event-stream)
+static void append_field(std::string &out, std::string_view field,
+                         std::string_view value) {
+  size_t start = 0;
+  while (true) {
+    size_t end = value.find('\n', start);
+    std::string_view line = value.substr(
+        start, end == std::string_view::npos ? end : end - start);
+    if (!line.empty() && line.back() == '\r') {
+      line.remove_suffix(1);
+    }
+    out.append(field).append(": ").append(line).append("\n");
+    if (end == std::string_view::npos) {
+      return;
+    }
+    start = end + 1;
+  }
+}
+
+SseHub::Subscriber::Subscriber(SocketClient &&sc, const std::string &channel)
+    : sc(std::move(sc)), channel(channel) {}
+
+SseHub::SseHub(const SseOptions &options)
+    : options(options), poller(create_poller()), stopping(false),
+      heartbeat(std::make_shared<const std::string>(":\n\n")), count(0),
+      published(0), delivered(0), dropped(0) {
+  thread = std::thread{&SseHub::run, this};
+}
+
+SseHub::~SseHub() {
+  stopping.store(true);
+  poller->wake();
+  thread.join();
+
+  for (auto &[_, subscriber] : subscribers) {
+    (void)subscriber->sc.close();
+  }
+  for (auto &subscriber : added) {
+    (void)subscriber->sc.close();
+  }
+}
+
+csr::Result<std::monostate, server_error_t>
+SseHub::subscribe(Context &ctx, const std::string &channel) {
+  if (ctx.transport || ctx.req.version == "HTTP/2.0") {
+    return csr::Result<std::monostate, server_error_t>::Err(
+        server_error(ServerErr::unsupported_option));
+  }
+
+  // no Content-Length: the stream lasts as long as the connection
+  ctx.resp.status = "200";
+  ctx.resp.headers["Content-Type"] = "text/event-stream";
+  ctx.resp.headers["Cache-Control"] = "no-cache";
+
+  Writer writer{ctx.fd, ctx.bufsize, ctx.transport};
+  auto write_result = ctx.write_head(writer);
+  if (write_result.is_ok()) {
+    write_result = writer.flush();
+  }
+  // written here rather than by Context::write
+  ctx.resp.headers.clear();
+  if (write_result.is_err()) {
+    return csr::Result<std::monostate, server_error_t>::Err(
+        std::move(write_result.unwrap_err()));
+  }
+
+  // the hub outlives the request (and may outlive the server)
+  std::shared_ptr<SseHub> self = shared_from_this();
+  ctx.take_over([self, channel](SocketClient &&sc, std::vector<char> &&) {
+    if (sc.set_nonblock(true).is_err()) {
+      return;
+    }
+    auto subscriber = std::make_shared<Subscriber>(std::move(sc), channel);
+    std::lock_guard<std::mutex> lock{self->pending_mutex};
+    self->added.push_back(std::move(subscriber));
+    self->poller->wake();
+  });
+  return csr::Result<std::monostate, server_error_t>();
+}
+
+size_t SseHub::queue(const std::vector<std::shared_ptr<Subscriber>> &to,
+                     const std::shared_ptr<const std::string> &event,
+                     std::vector<std::shared_ptr<Subscriber>> &ready) {
+  size_t n = 0;
+  for (const auto &subscriber : to) {
+    std::lock_guard<std::mutex> lock{subscriber->mutex};
+    if (subscriber->dropped) {
+      continue;
+    }
+    if (subscriber->queued + event->size() > options.max_queue) {
+      // too slow: the loop closes it
+      subscriber->dropped = true;
+      dropped.fetch_add(1, std::memory_order_relaxed);
+      ready.push_back(subscriber);
+      continue;
+    }
+
+    // only the first event makes it ready, the loop writes the others
+    // along with it
+    if (subscriber->queue.empty()) {
+      ready.push_back(subscriber);
+    }
+    subscriber->queue.push_back(event);
+    subscriber->queued += event->size();
+    ++n;
+  }
+  return n;
+}
+
+void SseHub::beat(std::chrono::steady_clock::time_point now,
+                  std::vector<std::shared_ptr<Subscriber>> &ready) {
+  auto interval = std::chrono::milliseconds(options.heartbeat);
+  next_heartbeat = now + interval;
+  for (auto &[_, subscriber] : subscribers) {
+    std::lock_guard<std::mutex> lock{subscriber->mutex};
+    // one with output queued is not idle, and a heartbeat must not be what
+    // pushes it past max_queue
+    if (subscriber->dropped || !subscriber->queue.empty()) {
+      continue;
+    }
+    auto due = subscriber->last_write + interval;
+    if (due > now) {
+      next_heartbeat = std::min(next_heartbeat, due);
+      continue;
+    }
+    subscriber->queue.push_back(heartbeat);
+    subscriber->queued += heartbeat->size();
+    ready.push_back(subscriber);
+  }
+}
+
+size_t SseHub::publish(const std::string &channel, std::string_view data,
+                       std::string_view event, std::string_view id) {
+  std::string text;
+  text.reserve(data.size() + event.size() + id.size() + 32);
+  if (!event.empty()) {
+    append_field(text, "event", event);
+  }
+  if (!id.empty()) {
+    append_field(text, "id", id);
+  }
+  append_field(text, "data", data);
+  text.push_back('\n');
+  auto buffer = std::make_shared<const std::string>(std::move(text));
+
+  size_t n = 0;
+  std::vector<std::shared_ptr<Subscriber>> ready;
+  {
+    std::lock_guard<std::mutex> lock{mutex};
+    auto it = channels.find(channel);
+    if (it != channels.end()) {
+      n = queue(it->second, buffer, ready);
+    }
+  }
+  published.fetch_add(1, std::memory_order_relaxed);
+  delivered.fetch_add(n, std::memory_order_relaxed);
+
+  if (!ready.empty()) {
+    std::lock_guard<std::mutex> lock{pending_mutex};
+    pending.insert(pending.end(), ready.begin(), ready.end());
+    poller->wake();
+  }
+  return n;
+}
+
+void SseHub::finish(const std::shared_ptr<Subscriber> &subscriber) {
+  if (subscriber->closed) {
+    return;
+  }
+  subscriber->closed = true;
+
+  m_sock_t fd = subscriber->sc.connfd.unwrap();
+  (void)poller->remove(fd);
+  subscribers.erase(fd);
+  {
+    std::lock_guard<std::mutex> lock{mutex};
+    auto it = channels.find(subscriber->channel);
+    if (it != channels.end()) {
+      auto &list = it->second;
+      for (size_t i = 0; i < list.size(); ++i) {
+        if (list[i] == subscriber) {
+          list[i] = std::move(list.back());
+          list.pop_back();
+          break;
+        }
+      }
+      if (list.empty()) {
+        channels.erase(it);
+      }
+    }
+  }
+  count.fetch_sub(1, std::memory_order_relaxed);
+
+  {
+    // publishers see it dropped and let go of its events
+    std::lock_guard<std::mutex> lock{subscriber->mutex};
+    subscriber->dropped = true;
+    subscriber->queue.clear();
+    subscriber->queued = 0;
+  }
+  (void)subscriber->sc.close();
+}
+
+void SseHub::flush(const std::shared_ptr<Subscriber> &subscriber) {
+  if (subscriber->closed) {
+    return;
+  }
+  Subscriber &s = *subscriber;
+  m_sock_t fd = s.sc.connfd.unwrap();
+
+  bool failed = false;
+  bool empty;
+  {
+    std::lock_guard<std::mutex> lock{s.mutex};
+    while (!s.dropped && !s.queue.empty()) {
+#if defined(__APPLE__) || defined(__linux__)
+      struct iovec iov[SSE_IOV];
+      size_t n = 0;
+      for (auto it = s.queue.begin(); it != s.queue.end() && n < SSE_IOV;
+           ++it, ++n) {
+        size_t skip = n ? 0 : s.offset;
+        iov[n].iov_base = (char *)((*it)->data() + skip);
+        iov[n].iov_len = (*it)->size() - skip;
+      }
+      struct msghdr msg = {};
+      msg.msg_iov = iov;
+      msg.msg_iovlen = n;
+      ssize_t rc = ::sendmsg(fd, &msg, SEND_FLAGS);
+#elif defined(_WIN32)
+      const std::string &front = *s.queue.front();
+      size_t left = front.size() - s.offset;
+      int rc = ::send(fd, front.data() + s.offset,
+                      left > (size_t)std::numeric_limits<int>::max()
+                          ? std::numeric_limits<int>::max()
+                          : (int)left,
+                      0);
+#endif
+      if (ISSOCKETERROR(rc)) {
+        int err = GETSOCKETERRNO();
+        if (ISWOULDBLOCK(err)) {
+          break;
+        }
+#if defined(__APPLE__) || defined(__linux__)
+        if (err == EINTR) {
+          continue;
+        }
+#endif
+        failed = true;
+        break;
+      }
+
+      // drop the events written completely
+      size_t sent = (size_t)rc;
+      s.last_write = std::chrono::steady_clock::now();
+      s.queued -= sent;
+      while (sent) {
+        size_t left = s.queue.front()->size() - s.offset;
+        if (sent < left) {
+          s.offset += sent;
+          break;
+        }
+        sent -= left;
+        s.offset = 0;
+        s.queue.pop_front();
+      }
+    }
+    failed = failed || s.dropped;
+    empty = s.queue.empty();
+  }
+
+  if (failed) {
+    finish(subscriber);
+    return;
+  }
+  // wait for room in the socket buffer only while there is output left
+  if (empty == s.watching) {
+    s.watching = !empty;
+    (void)poller->modify(fd, s.watching);
+  }
+}
+
+void SseHub::on_readable(const std::shared_ptr<Subscriber> &subscriber) {
+  char buffer[SSE_READ_SIZE];
+  m_sock_t fd = subscriber->sc.connfd.unwrap();
+
+#if defined(__APPLE__) || defined(__linux__)
+  ssize_t rc = ::recv(fd, buffer, sizeof(buffer), 0);
+#elif defined(_WIN32)
+  int rc = ::recv(fd, buffer, (int)sizeof(buffer), 0);
+#endif
+  if (ISSOCKETERROR(rc)) {
+    int err = GETSOCKETERRNO();
+#if defined(__APPLE__) || defined(__linux__)
+    if (err == EINTR) {
+      return;
+    }
+#endif
+    if (!ISWOULDBLOCK(err)) {
+      finish(subscriber);
+    }
+    return;
+  }
+  if (rc == 0) {
+    finish(subscriber);
+  }
+}
+
+void SseHub::run() {
+  std::vector<PollEvent> events;
+  std::vector<std::shared_ptr<Subscriber>> new_subscribers, writable, ready;
+
+  auto interval = std::chrono::milliseconds(options.heartbeat);
+  next_heartbeat = std::chrono::steady_clock::now() + interval;
+
+  while (!stopping.load()) {
+    {
+      std::lock_guard<std::mutex> lock{pending_mutex};
+      new_subscribers.swap(added);
+      writable.swap(pending);
+    }
+
+    for (auto &subscriber : new_subscribers) {
+      m_sock_t fd = subscriber->sc.connfd.unwrap();
+      if (poller->add(fd, false).is_err()) {
+        (void)subscriber->sc.close();
+        continue;
+      }
+      subscribers.emplace(fd, subscriber);
+      count.fetch_add(1, std::memory_order_relaxed);
+      // idle from now on, until its first event
+      auto now = std::chrono::steady_clock::now();
+      {
+        std::lock_guard<std::mutex> lock{subscriber->mutex};
+        subscriber->last_write = now;
+      }
+      next_heartbeat = std::min(next_heartbeat, now + interval);
+      // receives the events published from now on
+      std::lock_guard<std::mutex> lock{mutex};
+      channels[subscriber->channel].push_back(subscriber);
+    }
+    new_subscribers.clear();
+
+    for (auto &subscriber : writable) {
+      flush(subscriber);
+    }
+    writable.clear();
+
+    int timeout = -1;
+    if (options.heartbeat > 0) {
+      auto now = std::chrono::steady_clock::now();
+      if (now >= next_heartbeat) {
+        beat(now, ready);
+        for (auto &subscriber : ready) {
+          flush(subscriber);
+        }
+        ready.clear();
+        now = std::chrono::steady_clock::now();
+      }
+      // rounded up, not to wake up just before it is due
+      timeout = next_heartbeat > now
+                    ? (int)std::chrono::ceil<std::chrono::milliseconds>(
+                          next_heartbeat - now)
+                          .count()
+                    : 0;
+    }
+
+    if (poller->wait(timeout, events).is_err()) {
+      continue;
+    }
+
+    for (auto &ev : events) {
+      auto it = subscribers.find(ev.fd);
+      if (it == subscribers.end()) {
+        continue;
+      }
+      auto subscriber = it->second;
+
+      if (ev.readable || ev.closed) {
+        on_readable(subscriber);
+      }
+      if (ev.writable) {
+        flush(subscriber);
+      }
+    }
+  }
+}
+
+SseStats SseHub::stats() const {
+  return SseStats{count.load(std::memory_order_relaxed),
+                  published.load(std::memory_order_relaxed),
+                  delivered.load(std::memory_order_relaxed),
+                  dropped.load(std::memory_order_relaxed)};
+}
@@ -0,0 +1,134 @@
+#include "trace/tracer.h"
+#include <chrono>
+#include <cstdio>
+
+static const char *const span_names[] = {"accept", "handshake", "parse",
+                                         "middleware", "write"};
+
+static std::atomic<uint32_t> next_tid{1};
+
+// the id of the current thread in the trace
+static thread_local uint32_t local_tid =
+    next_tid.fetch_add(1, std::memory_order_relaxed);
+
+thread_local ThreadSlot<std::shared_ptr<Tracer::Buffer>, Tracer::detach>
+    Tracer::local_buffer;
+
+Tracer::Tracer() : every(0), next_trace(0), mutex(), buffers() {}
+
+void Tracer::detach(std::shared_ptr<Buffer> &buffer) {
+  if (buffer) {
+    buffer->attached.store(false, std::memory_order_release);
+  }
+}
+
+Tracer &Tracer::instance() {
+  // never destroyed (see lifetime.h)
+  static Tracer *tracer = new Tracer();
+  return *tracer;
+}
+
+void Tracer::enable(size_t every) { this->every.store(every ? every : 1); }
+
+void Tracer::disable() { every.store(0); }
+
+uint64_t Tracer::sample() {
+  size_t n = every.load(std::memory_order_relaxed);
+  if (!n) {
+    return 0;
+  }
+  uint64_t id = next_trace.fetch_add(1, std::memory_order_relaxed) + 1;
+  return id % n == 0 ? id : 0;
+}
+
+uint64_t Tracer::now() {
+  return (uint64_t)(
+      std::chrono::duration_cast<std::chrono::nanoseconds>(
+          std::chrono::steady_clock::now().time_since_epoch())
+          .count());
+}
+
+Tracer::Buffer &Tracer::local() {
+  if (local_buffer.value) {
+    return *local_buffer.value;
+  }
+
+  std::lock_guard<std::mutex> lock{mutex};
+  for (auto &buffer : buffers) {
+    if (!buffer->attached.load(std::memory_order_acquire)) {
+      buffer->attached.store(true, std::memory_order_relaxed);
+      local_buffer.value = buffer;
+      return *buffer;
+    }
+  }
+  auto buffer = std::make_shared<Buffer>();
+  buffer->spans.reserve(TRACE_SPANS);
+  buffer->attached.store(true, std::memory_order_relaxed);
+  buffers.push_back(buffer);
+  local_buffer.value = buffer;
+  return *buffer;
+}
+
+void Tracer::record(uint64_t trace, SpanKind kind, uint16_t arg,
+                    uint64_t start, uint64_t end) {
+  Buffer &buffer = local();
+  Span span{start, end, trace, local_tid, arg, kind};
+
+  // only dump() and clear() contend for the lock
+  std::lock_guard<std::mutex> lock{buffer.mutex};
+  if (buffer.spans.size() < TRACE_SPANS) {
+    buffer.spans.push_back(span);
+  } else {
+    buffer.spans[buffer.next] = span;
+    buffer.next = (buffer.next + 1) % TRACE_SPANS;
+  }
+}
+
+std::string Tracer::dump() {
+  std::vector<std::shared_ptr<Buffer>> snapshot;
+  {
+    std::lock_guard<std::mutex> lock{mutex};
+    snapshot = buffers;
+  }
+
+  std::string out = "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[";
+  bool first = true;
+  char buf[256];
+  for (auto &buffer : snapshot) {
+    std::lock_guard<std::mutex> lock{buffer->mutex};
+    for (const auto &span : buffer->spans) {
+      char name[32];
+      if (span.kind == SpanKind::task) {
+        snprintf(name, sizeof(name), "%s %u",
+                 span_names[(size_t)span.kind], span.arg);
+      } else {
+        snprintf(name, sizeof(name), "%s",
+                 span_names[(size_t)span.kind]);
+      }
+      // ts and dur are in microseconds
+      uint64_t dur = span.end - span.start;
+      int n = snprintf(buf, sizeof(buf),
+                       "%s{\"name\":\"%s\",\"cat\":\"http\",\"ph\":\"X\","
+                       "\"ts\":%llu.%03u,\"dur\":%llu.%03u,\"pid\":1,"
+                       "\"tid\":%u,\"args\":{\"conn\":%llu}}",
+                       first ? "" : ",", name,
+                       (unsigned long long)(span.start / 1000),
+                       (unsigned)(span.start % 1000),
+                       (unsigned long long)(dur / 1000), (unsigned)(dur % 1000),
+                       span.tid, (unsigned long long)span.trace);
+      out.append(buf, (size_t)n);
+      first = false;
+    }
+  }
+  out += "]}\n";
+  return out;
+}
+
+void Tracer::clear() {
+  std::lock_guard<std::mutex> lock{mutex};
+  for (auto &buffer : buffers) {
+    std::lock_guard<std::mutex> buffer_lock{buffer->mutex};
+    buffer->spans.clear();
+    buffer->next = 0;
+  }
+}
@@ -0,0 +1,255 @@
+#include "watchdog/watchdog.h"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <system_error>
+
+#if defined(__APPLE__) || defined(__linux__)
+#include <cerrno>
+#include <execinfo.h>
+#endif
+
+// longest wait for a signaled thread to capture its stack, in ms
+constexpr int CAPTURE_TIMEOUT = 100;
+
+thread_local ThreadSlot<Watchdog::Slot *, Watchdog::detach>
+    Watchdog::local_slot;
+
+#if defined(__APPLE__) || defined(__linux__)
+// the slot whose thread is being signaled, read by the signal handler
+static std::atomic<void *> capturing{nullptr};
+#endif
+
+static void print_stall(const Stall &stall) {
+  fprintf(stderr, "watchdog: middleware %u stalled for %llums on \"%s\"\n",
+          (unsigned)stall.stage, (unsigned long long)stall.elapsed,
+          stall.route.c_str());
+  for (const auto &frame : stall.stack) {
+    fprintf(stderr, "    %s\n", frame.c_str());
+  }
+}
+
+static uint64_t now_ms() {
+  return (uint64_t)(
+      std::chrono::duration_cast<std::chrono::milliseconds>(
+          std::chrono::steady_clock::now().time_since_epoch())
+          .count());
+}
+
+Watchdog::Watchdog()
+    : slots(new Slot[WATCH_SLOTS]), next_slot(0), epoch(now_ms() - 1),
+      tick(1), running(false), options(), mutex(), cv(), stopping(false),
+      thread() {}
+
+Watchdog &Watchdog::instance() {
+  // never destroyed (see lifetime.h)
+  static Watchdog *watchdog = new Watchdog();
+  return *watchdog;
+}
+
+void Watchdog::detach(Slot *&slot) {
+  if (!slot) {
+    return;
+  }
+  slot->since.store(0, std::memory_order_relaxed);
+  // the thread must stay alive while the watchdog signals it
+  uint8_t busy = slot_busy;
+  while (!slot->state.compare_exchange_weak(busy, slot_free,
+                                            std::memory_order_release)) {
+    busy = slot_busy;
+    std::this_thread::yield();
+  }
+}
+
+Watchdog::Slot *Watchdog::local() {
+  if (local_slot.value) {
+    return local_slot.value;
+  }
+
+  size_t start = next_slot.fetch_add(1, std::memory_order_relaxed);
+  for (size_t i = 0; i < WATCH_SLOTS; ++i) {
+    Slot &slot = slots[(start + i) % WATCH_SLOTS];
+    uint8_t free = slot_free;
+    if (slot.state.load(std::memory_order_relaxed) == slot_free &&
+        slot.state.compare_exchange_strong(free, slot_busy,
+                                           std::memory_order_acquire)) {
+#if defined(__APPLE__) || defined(__linux__)
+      slot.thread = pthread_self();
+#endif
+      local_slot.value = &slot;
+      return &slot;
+    }
+  }
+  return nullptr;
+}
+
+void Watchdog::capture(int) {
+#if defined(__APPLE__) || defined(__linux__)
+  Slot *slot = (Slot *)capturing.load(std::memory_order_acquire);
+  if (!slot || !pthread_equal(slot->thread, pthread_self())) {
+    return;
+  }
+  int saved = errno;
+  std::atomic_signal_fence(std::memory_order_acquire);
+  slot->depth = backtrace(slot->frames, (int)WATCH_FRAMES);
+  memcpy(slot->stall_route, slot->route, slot->route_len);
+  slot->stall_route_len = slot->routed ? slot->route_len : 0;
+  slot->captured.store(true, std::memory_order_release);
+  errno = saved;
+#endif
+}
+
+void Watchdog::start(const WatchdogOptions &options) {
+  stop();
+
+  this->options = options;
+  if (!this->options.interval) {
+    this->options.interval = 1;
+  }
+  if (!this->options.report) {
+    this->options.report = print_stall;
+  }
+
+#if defined(__APPLE__) || defined(__linux__)
+  // the first call of backtrace() may allocate: not in the handler
+  void *frame;
+  (void)backtrace(&frame, 1);
+
+  struct sigaction action;
+  memset(&action, 0, sizeof(action));
+  action.sa_handler = capture;
+  // the stalled thread resumes its system calls afterwards
+  action.sa_flags = SA_RESTART;
+  sigemptyset(&action.sa_mask);
+  if (sigaction(options.signal, &action, nullptr) == -1) {
+    throw std::system_error(errno, std::generic_category(), "sigaction");
+  }
+#endif
+
+  stopping = false;
+  running.store(true);
+  thread = std::thread{&Watchdog::run, this};
+}
+
+void Watchdog::stop() {
+  if (!thread.joinable()) {
+    return;
+  }
+  {
+    std::lock_guard<std::mutex> lock{mutex};
+    stopping = true;
+  }
+  cv.notify_all();
+  thread.join();
+  running.store(false);
+}
+
+void Watchdog::run() {
+  auto interval = std::chrono::milliseconds(options.interval);
+
+  std::unique_lock<std::mutex> lock{mutex};
+  while (!cv.wait_for(lock, interval, [this] { return stopping; })) {
+    lock.unlock();
+    uint64_t now = now_ms() - epoch;
+    tick.store(now, std::memory_order_relaxed);
+    for (size_t i = 0; i < WATCH_SLOTS; ++i) {
+      check(slots[i], now);
+    }
+    lock.lock();
+  }
+}
+
+void Watchdog::check(Slot &slot, uint64_t now) {
+  uint64_t since = slot.since.load(std::memory_order_acquire);
+  if (!since || now - since < options.threshold || slot.reported == since) {
+    return;
+  }
+  slot.reported = since;
+
+  Stall stall;
+  stall.stage = slot.stage.load(std::memory_order_relaxed);
+  stall.elapsed = now - since;
+
+#if defined(__APPLE__) || defined(__linux__)
+  // keeps the thread from exiting until it is done with the signal
+  uint8_t busy = slot_busy;
+  if (slot.state.compare_exchange_strong(busy, slot_signaled,
+                                         std::memory_order_acquire)) {
+    slot.captured.store(false, std::memory_order_relaxed);
+    capturing.store(&slot, std::memory_order_release);
+
+    bool captured = false;
+    if (pthread_kill(slot.thread, options.signal) == 0) {
+      auto deadline = std::chrono::steady_clock::now() +
+                      std::chrono::milliseconds(CAPTURE_TIMEOUT);
+      while (!(captured = slot.captured.load(std::memory_order_acquire)) &&
+             std::chrono::steady_clock::now() < deadline) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+      }
+    }
+    // a handler that runs late finds nothing to do
+    capturing.store(nullptr, std::memory_order_release);
+    captured = captured || slot.captured.load(std::memory_order_acquire);
+
+    if (captured) {
+      stall.route.assign(slot.stall_route, slot.stall_route_len);
+      char **symbols = backtrace_symbols(slot.frames, slot.depth);
+      // skip the frames of the signal handler
+      for (int i = 2; symbols && i < slot.depth; ++i) {
+        stall.stack.emplace_back(symbols[i]);
+      }
+      free(symbols);
+    }
+    slot.state.store(slot_busy, std::memory_order_release);
+  }
+#endif
+
+  options.report(stall);
+}
+
+void WatchScope::enter(Watchdog &watchdog, const std::string &route,
+                       uint16_t stage) {
+  slot = watchdog.local();
+  if (!slot) {
+    return;
+  }
+  since = slot->since.load(std::memory_order_relaxed);
+  this->stage = slot->stage.load(std::memory_order_relaxed);
+
+  // the route is copied once per request, by the first middleware after
+  // HeadParser (or the first one of an HTTP/2 stream)
+  if (!since) {
+    slot->routed = false;
+  }
+  if (stage && !slot->routed) {
+    slot->route_len = route.size() < WATCH_ROUTE ? route.size() : WATCH_ROUTE;
+    memcpy(slot->route, route.data(), slot->route_len);
+    slot->routed = true;
+    // read by the signal handler, on this thread
+    std::atomic_signal_fence(std::memory_order_release);
+  }
+
+  slot->stage.store(stage, std::memory_order_relaxed);
+  slot->since.store(watchdog.tick.load(std::memory_order_relaxed),
+                    std::memory_order_release);
+}
+
+WatchPause::WatchPause() : slot(nullptr), since(0) {
+  Watchdog &watchdog = Watchdog::instance();
+  if (watchdog.running.load(std::memory_order_relaxed)) {
+    slot = watchdog.local();
+  }
+  if (slot) {
+    since = slot->since.load(std::memory_order_relaxed);
+    slot->since.store(0, std::memory_order_relaxed);
+  }
+}
+
+WatchPause::~WatchPause() {
+  // the enclosing middleware starts over
+  if (slot && since) {
+    slot->since.store(Watchdog::instance().tick.load(),
+                      std::memory_order_release);
+  }
+}
@@ -0,0 +1,108 @@
+#include "websocket/connection.h"
+#include "websocket/loop.h"
+
+#ifdef _WIN32
+#include <limits>
+#endif
+
+WsConnection::WsConnection(SocketClient &&sc, Request &&req, WsLoop *loop)
+    : sc(std::move(sc)), loop(loop), req(std::move(req)), in(), message(),
+      message_opcode(WsOpcode::continuation), done(false),
+      done_code(WsClose::normal), out(), close_sent(false), closed(false) {}
+
+const Request &WsConnection::request() const { return req; }
+
+csr::Result<std::monostate, server_error_t> WsConnection::flush() {
+  m_sock_t fd = sc.connfd.unwrap();
+  size_t sent = 0;
+
+  while (sent < out.size()) {
+#if defined(__APPLE__) || defined(__linux__)
+    ssize_t rc = ::send(fd, out.data() + sent, out.size() - sent, SEND_FLAGS);
+#elif defined(_WIN32)
+    size_t left = out.size() - sent;
+    int rc = ::send(fd, out.data() + sent,
+                    left > (size_t)std::numeric_limits<int>::max()
+                        ? std::numeric_limits<int>::max()
+                        : (int)left,
+                    0);
+#endif
+    if (ISSOCKETERROR(rc)) {
+      int err = GETSOCKETERRNO();
+      if (ISWOULDBLOCK(err)) {
+        break;
+      }
+#if defined(__APPLE__) || defined(__linux__)
+      if (err == EINTR) {
+        continue;
+      }
+#endif
+      out.erase(0, sent);
+      return csr::Result<std::monostate, server_error_t>::Err(
+          sys_socket_error());
+    }
+    sent += (size_t)rc;
+  }
+
+  out.erase(0, sent);
+  return csr::Result<std::monostate, server_error_t>();
+}
+
+csr::Result<std::monostate, server_error_t>
+WsConnection::send_frame(WsOpcode opcode, const char *payload, size_t len) {
+  std::lock_guard<std::mutex> lock{mutex};
+  if (closed || close_sent) {
+    return csr::Result<std::monostate, server_error_t>::Err(
+        server_error(ServerErr::connection_closed));
+  }
+
+  // if output is already queued, the loop is waiting to write it
+  bool idle = out.empty();
+  ws_frame_header(out, opcode, len);
+  out.append(payload, len);
+  close_sent = opcode == WsOpcode::close;
+
+  if (!idle) {
+    return csr::Result<std::monostate, server_error_t>();
+  }
+
+  auto flush_result = flush();
+  if (flush_result.is_ok() && !out.empty()) {
+    // the lock order is connection then loop
+    loop->want_write(shared_from_this());
+  }
+  return flush_result;
+}
+
+csr::Result<std::monostate, server_error_t>
+WsConnection::send(const std::string &text) {
+  return send_frame(WsOpcode::text, text.data(), text.size());
+}
+
+csr::Result<std::monostate, server_error_t>
+WsConnection::send_binary(const char *data, size_t len) {
+  return send_frame(WsOpcode::binary, data, len);
+}
+
+csr::Result<std::monostate, server_error_t>
+WsConnection::ping(const std::string &payload) {
+  if (payload.size() > WS_MAX_CONTROL) {
+    return csr::Result<std::monostate, server_error_t>::Err(
+        server_error(ServerErr::numeric_limit_reached));
+  }
+  return send_frame(WsOpcode::ping, payload.data(), payload.size());
+}
+
+csr::Result<std::monostate, server_error_t>
+WsConnection::close(WsClose code, const std::string &reason) {
+  if (reason.size() > WS_MAX_CONTROL - 2) {
+    return csr::Result<std::monostate, server_error_t>::Err(
+        server_error(ServerErr::numeric_limit_reached));
+  }
+
+  std::string payload;
+  payload.push_back((char)((uint16_t)code >> 8));
+  payload.push_back((char)code);
+  payload += reason;
+  return send_frame(WsOpcode::close, payload.data(), payload.size());
+}
@@ -0,0 +1,101 @@
+#include "websocket/frame.h"
+
+// appended to Sec-WebSocket-Key before hashing (RFC 6455 1.3)
+static const char WS_GUID[] = "258EAFA5-E914-47DA-95CA-C5AB0DC85B11";
+
+static inline uint32_t rotl(uint32_t x, int n) {
+  return x << n | x >> (32 - n);
+}
+
+// SHA-1 (RFC 3174), only used for the handshake
+static void sha1(const std::string &msg, unsigned char digest[20]) {
+  uint32_t h[5] = {0x67452301, 0xefcdab89, 0x98badcfe, 0x10325476,
+                   0xc3d2e1f0};
+
+  std::string data = msg;
+  uint64_t bits = (uint64_t)msg.size() * 8;
+  data.push_back((char)0x80);
+  while (data.size() % 64 != 56) {
+    data.push_back(0);
+  }
+  for (int shift = 56; shift >= 0; shift -= 8) {
+    data.push_back((char)(bits >> shift));
+  }
+
+  for (size_t chunk = 0; chunk < data.size(); chunk += 64) {
+    uint32_t w[80];
+    const unsigned char *p = (const unsigned char *)data.data() + chunk;
+    for (int i = 0; i < 16; ++i) {
+      w[i] = (uint32_t)p[4 * i] << 24 | (uint32_t)p[4 * i + 1] << 16 |
+             (uint32_t)p[4 * i + 2] << 8 | (uint32_t)p[4 * i + 3];
+    }
+    for (int i = 16; i < 80; ++i) {
+      w[i] = rotl(w[i - 3] ^ w[i - 8] ^ w[i - 14] ^ w[i - 16], 1);
+    }
+
+    uint32_t a = h[0], b = h[1], c = h[2], d = h[3], e = h[4];
+    for (int i = 0; i < 80; ++i) {
+      uint32_t f, k;
+      if (i < 20) {
+        f = (b & c) | (~b & d);
+        k = 0x5a827999;
+      } else if (i < 40) {
+        f = b ^ c ^ d;
+        k = 0x6ed9eba1;
+      } else if (i < 60) {
+        f = (b & c) | (b & d) | (c & d);
+        k = 0x8f1bbcdc;
+      } else {
+        f = b ^ c ^ d;
+        k = 0xca62c1d6;
+      }
+      uint32_t t = rotl(a, 5) + f + e + k + w[i];
+      e = d;
+      d = c;
+      c = rotl(b, 30);
+      b = a;
+      a = t;
+    }
+
+    h[0] += a;
+    h[1] += b;
+    h[2] += c;
+    h[3] += d;
+    h[4] += e;
+  }
+
+  for (int i = 0; i < 5; ++i) {
+    digest[4 * i] = (unsigned char)(h[i] >> 24);
+    digest[4 * i + 1] = (unsigned char)(h[i] >> 16);
+    digest[4 * i + 2] = (unsigned char)(h[i] >> 8);
+    digest[4 * i + 3] = (unsigned char)h[i];
+  }
+}
+
+static std::string base64(const unsigned char *data, size_t len) {
+  static const char table[] =
+      "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+  std::string out;
+
+  for (size_t i = 0; i < len; i += 3) {
+    uint32_t v = (uint32_t)data[i] << 16;
+    if (i + 1 < len) {
+      v |= (uint32_t)data[i + 1] << 8;
+    }
+    if (i + 2 < len) {
+      v |= data[i + 2];
+    }
+
+    out.push_back(table[v >> 18 & 0x3f]);
+    out.push_back(table[v >> 12 & 0x3f]);
+    out.push_back(i + 1 < len ? table[v >> 6 & 0x3f] : '=');
+    out.push_back(i + 2 < len ? table[v & 0x3f] : '=');
+  }
+  return out;
+}
+
+std::string ws_accept_key(const std::string &key) {
+  unsigned char digest[20];
+  sha1(key + WS_GUID, digest);
+  return base64(digest, sizeof(digest));
+}
@@ -0,0 +1,354 @@
+#include "websocket/loop.h"
+#include <system_error>
+
+// bytes read from a socket per readiness event
+constexpr size_t WS_READ_SIZE = 65536;
+
+static std::unique_ptr<Poller> create_poller() {
+  auto create_ret = Poller::create();
+  if (create_ret.is_err()) {
+    throw std::system_error(create_ret.unwrap_err(), "poller error");
+  }
+  return std::move(create_ret.unwrap());
+}
+
+// status codes a client may send in a close frame (RFC 6455 7.4)
+static bool valid_close_code(uint16_t code) {
+  return (code >= 1000 && code <= 1003) || (code >= 1007 && code <= 1011) ||
+         (code >= 3000 && code <= 4999);
+}
+
+// a connection outliving its loop must not touch it anymore
+void WsLoop::close_connection(WsConnection &conn) {
+  std::lock_guard<std::mutex> lock{conn.mutex};
+  conn.closed = true;
+  (void)conn.sc.close();
+}
+
+WsLoop::WsLoop(WsHandlers &&handlers, size_t max_message)
+    : poller(create_poller()), handlers(std::move(handlers)),
+      max_message(max_message), stopping(false), buffer(WS_READ_SIZE) {
+  thread = std::thread{&WsLoop::run, this};
+}
+
+WsLoop::~WsLoop() {
+  stopping.store(true);
+  poller->wake();
+  thread.join();
+
+  for (auto &[_, conn] : connections) {
+    close_connection(*conn);
+  }
+  for (auto &conn : added) {
+    close_connection(*conn);
+  }
+}
+
+void WsLoop::add(SocketClient &&sc, Request &&req, std::vector<char> &&input) {
+  if (sc.set_nonblock(true).is_err()) {
+    return;
+  }
+
+  auto conn = std::make_shared<WsConnection>(std::move(sc), std::move(req),
+                                             this);
+  conn->in = std::move(input);
+
+  std::lock_guard<std::mutex> lock{mutex};
+  added.push_back(std::move(conn));
+  poller->wake();
+}
+
+void WsLoop::want_write(std::shared_ptr<WsConnection> conn) {
+  std::lock_guard<std::mutex> lock{mutex};
+  pending.push_back(std::move(conn));
+  poller->wake();
+}
+
+void WsLoop::fail(const std::shared_ptr<WsConnection> &conn, WsClose code) {
+  (void)conn->close(code);
+  conn->done = true;
+  conn->done_code = code;
+}
+
+void WsLoop::finish(const std::shared_ptr<WsConnection> &conn, WsClose code) {
+  m_sock_t fd = conn->sc.connfd.unwrap();
+  (void)poller->remove(fd);
+  connections.erase(fd);
+  close_connection(*conn);
+
+  if (handlers.close) {
+    handlers.close(conn, code);
+  }
+}
+
+size_t WsLoop::process(const std::shared_ptr<WsConnection> &conn, char *data,
+                       size_t len) {
+  WsConnection &c = *conn;
+  size_t pos = 0;
+
+  while (!c.done && len - pos >= 2) {
+    const unsigned char *h = (const unsigned char *)data + pos;
+    bool fin = h[0] & WS_FIN;
+    WsOpcode opcode = (WsOpcode)(h[0] & 0x0f);
+    uint64_t payload_len = h[1] & 0x7f;
+
+    // control frames are never fragmented and fit in the 7-bit length
+    bool control = (uint8_t)opcode & 0x8;
+    if ((h[0] & WS_RSV) || !(h[1] & WS_MASKED) ||
+        (opcode > WsOpcode::binary && opcode < WsOpcode::close) ||
+        opcode > WsOpcode::pong ||
+        (control && (!fin || payload_len > WS_MAX_CONTROL))) {
+      fail(conn, WsClose::protocol_error);
+      break;
+    }
+
+    size_t header_len = 2 + (payload_len == 126   ? 2
+                             : payload_len == 127 ? 8
+                                                  : 0) +
+                        4;
+    if (len - pos < header_len) {
+      break;
+    }
+    if (payload_len == 126) {
+      payload_len = (uint64_t)h[2] << 8 | h[3];
+    } else if (payload_len == 127) {
+      payload_len = 0;
+      for (int i = 2; i < 10; ++i) {
+        payload_len = payload_len << 8 | h[i];
+      }
+    }
+
+    // checked before buffering the payload
+    if (payload_len > max_message - c.message.size()) {
+      fail(conn, WsClose::too_big);
+      break;
+    }
+    if (len - pos - header_len < payload_len) {
+      break;
+    }
+
+    char *payload = data + pos + header_len;
+    size_t size = (size_t)payload_len;
+    ws_mask(payload, size, (const char *)h + header_len - 4);
+    pos += header_len + size;
+
+    switch (opcode) {
+    case WsOpcode::text:
+    case WsOpcode::binary:
+    case WsOpcode::continuation: {
+      if ((opcode == WsOpcode::continuation) !=
+          (c.message_opcode != WsOpcode::continuation)) {
+        // a continuation without a message, or a message inside another one
+        fail(conn, WsClose::protocol_error);
+        break;
+      }
+      if (!fin) {
+        if (opcode != WsOpcode::continuation) {
+          c.message_opcode = opcode;
+        }
+        c.message.append(payload, size);
+        break;
+      }
+
+      bool binary;
+      if (opcode == WsOpcode::continuation) {
+        binary = c.message_opcode == WsOpcode::binary;
+        c.message.append(payload, size);
+        c.message_opcode = WsOpcode::continuation;
+      } else {
+        // unfragmented: the common case
+        binary = opcode == WsOpcode::binary;
+        c.message.assign(payload, size);
+      }
+
+      if (!binary && !ws_valid_utf8(c.message.data(), c.message.size())) {
+        fail(conn, WsClose::invalid_data);
+        break;
+      }
+      if (handlers.message) {
+        handlers.message(conn, c.message, binary);
+      }
+      c.message.clear();
+      break;
+    }
+    case WsOpcode::ping:
+      (void)c.send_frame(WsOpcode::pong, payload, size);
+      break;
+    case WsOpcode::close: {
+      WsClose code = WsClose::no_status;
+      if (size == 1) {
+        fail(conn, WsClose::protocol_error);
+        break;
+      }
+      if (size >= 2) {
+        code = (WsClose)((uint16_t)((unsigned char)payload[0] << 8 |
+                                    (unsigned char)payload[1]));
+        if (!valid_close_code((uint16_t)code)) {
+          fail(conn, WsClose::protocol_error);
+          break;
+        }
+        if (!ws_valid_utf8(payload + 2, size - 2)) {
+          fail(conn, WsClose::invalid_data);
+          break;
+        }
+      }
+
+      // echo the code, unless this answers our own close frame
+      (void)c.send_frame(WsOpcode::close, payload, size < 2 ? 0 : 2);
+      c.done = true;
+      c.done_code = code;
+      break;
+    }
+    default:
+      // pongs answer our pings
+      break;
+    }
+  }
+
+  // drop the capacity of large messages once delivered
+  if (c.message.empty() && c.message.capacity() > BUFSIZE) {
+    std::string().swap(c.message);
+  }
+  return pos;
+}
+
+void WsLoop::on_readable(const std::shared_ptr<WsConnection> &conn) {
+  WsConnection &c = *conn;
+  m_sock_t fd = c.sc.connfd.unwrap();
+
+#if defined(__APPLE__) || defined(__linux__)
+  ssize_t rc = ::recv(fd, buffer.data(), buffer.size(), 0);
+#elif defined(_WIN32)
+  int rc = ::recv(fd, buffer.data(), (int)buffer.size(), 0);
+#endif
+  if (ISSOCKETERROR(rc)) {
+    int err = GETSOCKETERRNO();
+#if defined(__APPLE__) || defined(__linux__)
+    if (err == EINTR) {
+      return;
+    }
+#endif
+    if (!ISWOULDBLOCK(err)) {
+      finish(conn, WsClose::abnormal);
+    }
+    return;
+  }
+  if (rc == 0) {
+    finish(conn, c.done ? c.done_code : WsClose::abnormal);
+    return;
+  }
+  if (c.done) {
+    // closing: the rest of the input is discarded
+    return;
+  }
+
+  // parse straight from the shared buffer unless a frame is incomplete
+  size_t n = (size_t)rc;
+  if (c.in.empty()) {
+    size_t used = process(conn, buffer.data(), n);
+    c.in.assign(buffer.data() + used, buffer.data() + n);
+  } else {
+    c.in.insert(c.in.end(), buffer.data(), buffer.data() + n);
+    size_t used = process(conn, c.in.data(), c.in.size());
+    c.in.erase(c.in.begin(), c.in.begin() + (std::ptrdiff_t)used);
+  }
+  if (c.in.empty() && c.in.capacity() > BUFSIZE) {
+    std::vector<char>().swap(c.in);
+  }
+}
+
+void WsLoop::on_writable(const std::shared_ptr<WsConnection> &conn) {
+  bool flushed;
+  {
+    std::lock_guard<std::mutex> lock{conn->mutex};
+    if (conn->flush().is_err()) {
+      // the peer is gone: nothing left to write
+      conn->out.clear();
+      conn->done = true;
+      conn->done_code = WsClose::abnormal;
+    }
+    flushed = conn->out.empty();
+  }
+
+  if (flushed) {
+    (void)poller->modify(conn->sc.connfd.unwrap(), false);
+  }
+}
+
+void WsLoop::settle(const std::shared_ptr<WsConnection> &conn) {
+  if (conn->closed || !conn->done) {
+    return;
+  }
+
+  bool flushed;
+  {
+    std::lock_guard<std::mutex> lock{conn->mutex};
+    flushed = conn->out.empty();
+  }
+  // the closing frame is written
+  if (flushed) {
+    finish(conn, conn->done_code);
+  }
+}
+
+void WsLoop::run() {
+  std::vector<PollEvent> events;
+  std::vector<std::shared_ptr<WsConnection>> new_conns, writable;
+
+  while (!stopping.load()) {
+    {
+      std::lock_guard<std::mutex> lock{mutex};
+      new_conns.swap(added);
+      writable.swap(pending);
+    }
+
+    for (auto &conn : new_conns) {
+      m_sock_t fd = conn->sc.connfd.unwrap();
+      if (poller->add(fd, false).is_err()) {
+        close_connection(*conn);
+        continue;
+      }
+      connections.emplace(fd, conn);
+      if (handlers.open) {
+        handlers.open(conn);
+      }
+
+      // frames sent right after the handshake
+      std::vector<char> input = std::move(conn->in);
+      if (!input.empty() && !conn->done) {
+        size_t used = process(conn, input.data(), input.size());
+        conn->in.assign(input.begin() + (std::ptrdiff_t)used, input.end());
+      }
+      settle(conn);
+    }
+    new_conns.clear();
+
+    // only the loop thread closes connections, so closed can be read here
+    for (auto &conn : writable) {
+      if (!conn->closed) {
+        (void)poller->modify(conn->sc.connfd.unwrap(), true);
+      }
+    }
+    writable.clear();
+
+    if (poller->wait(-1, events).is_err()) {
+      continue;
+    }
+
+    for (auto &ev : events) {
+      auto it = connections.find(ev.fd);
+      if (it == connections.end()) {
+        continue;
+      }
+      auto conn = it->second;
+
+      if (ev.writable) {
+        on_writable(conn);
+      }
+      if (!conn->closed && (ev.readable || ev.closed)) {
+        on_readable(conn);
+      }
+      settle(conn);
+    }
+  }
+}
@@ -0,0 +1,75 @@
+#include "websocket/frame.h"
+#include <cstring>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+void ws_mask(char *data, size_t len, const char key[4]) {
+  // the key repeated over a whole vector, so no lane needs rotating
+  char pattern[32];
+  for (size_t i = 0; i < sizeof(pattern); ++i) {
+    pattern[i] = key[i & 3];
+  }
+  size_t i = 0;
+
+#if defined(__AVX2__)
+  __m256i mask256 = _mm256_loadu_si256((const __m256i *)pattern);
+  for (; i + 32 <= len; i += 32) {
+    __m256i v = _mm256_loadu_si256((const __m256i *)(data + i));
+    _mm256_storeu_si256((__m256i *)(data + i), _mm256_xor_si256(v, mask256));
+  }
+#endif
+
+#if defined(__AVX2__) || defined(__SSE2__)
+  __m128i mask128 = _mm_loadu_si128((const __m128i *)pattern);
+  for (; i + 16 <= len; i += 16) {
+    __m128i v = _mm_loadu_si128((const __m128i *)(data + i));
+    _mm_storeu_si128((__m128i *)(data + i), _mm_xor_si128(v, mask128));
+  }
+#elif defined(__ARM_NEON)
+  uint8x16_t mask128 = vld1q_u8((const uint8_t *)pattern);
+  for (; i + 16 <= len; i += 16) {
+    uint8x16_t v = vld1q_u8((const uint8_t *)(data + i));
+    vst1q_u8((uint8_t *)(data + i), veorq_u8(v, mask128));
+  }
+#endif
+
+  // no SIMD: 8 bytes at a time
+  uint64_t mask64;
+  memcpy(&mask64, pattern, sizeof(mask64));
+  for (; i + 8 <= len; i += 8) {
+    uint64_t v;
+    memcpy(&v, data + i, sizeof(v));
+    v ^= mask64;
+    memcpy(data + i, &v, sizeof(v));
+  }
+
+  // every block above is a multiple of 4 bytes, so the key is still aligned
+  // with i here
+  for (; i < len; ++i) {
+    data[i] ^= key[i & 3];
+  }
+}
+
+void ws_frame_header(std::string &out, WsOpcode opcode, size_t len,
+                     bool fin) {
+  out.push_back((char)((fin ? WS_FIN : 0) | (uint8_t)opcode));
+
+  if (len < 126) {
+    out.push_back((char)len);
+  } else if (len <= 0xffff) {
+    out.push_back((char)126);
+    out.push_back((char)(len >> 8));
+    out.push_back((char)len);
+  } else {
+    out.push_back((char)127);
+    for (int shift = 56; shift >= 0; shift -= 8) {
+      out.push_back((char)((uint64_t)len >> shift));
+    }
+  }
+}
@@ -0,0 +1,55 @@
+#include "websocket/frame.h"
+#include <cstring>
+
+bool ws_valid_utf8(const char *data, size_t len) {
+  const unsigned char *p = (const unsigned char *)data, *end = p + len;
+
+  while (p < end) {
+    // ASCII fast path: 8 bytes at a time
+    if (end - p >= 8) {
+      uint64_t v;
+      memcpy(&v, p, sizeof(v));
+      if (!(v & 0x8080808080808080ull)) {
+        p += 8;
+        continue;
+      }
+    }
+
+    unsigned char c = *p;
+    size_t n;
+    uint32_t cp;
+    if (c < 0x80) {
+      ++p;
+      continue;
+    } else if ((c & 0xe0) == 0xc0) {
+      n = 1;
+      cp = c & 0x1f;
+    } else if ((c & 0xf0) == 0xe0) {
+      n = 2;
+      cp = c & 0x0f;
+    } else if ((c & 0xf8) == 0xf0) {
+      n = 3;
+      cp = c & 0x07;
+    } else {
+      return false;
+    }
+
+    if ((size_t)(end - p) <= n) {
+      return false;
+    }
+    for (size_t i = 1; i <= n; ++i) {
+      if ((p[i] & 0xc0) != 0x80) {
+        return false;
+      }
+      cp = cp << 6 | (p[i] & 0x3f);
+    }
+
+    // overlong encodings, surrogates and code points past U+10FFFF
+    static const uint32_t min[] = {0, 0x80, 0x800, 0x10000};
+    if (cp < min[n] || (cp >= 0xd800 && cp <= 0xdfff) || cp > 0x10ffff) {
+      return false;
+    }
+    p += n + 1;
+  }
+  return true;
+}
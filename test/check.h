@@ -0,0 +1,14 @@
+#pragma once
+
+#include <cstdio>
+
+// The failure count of a test program: every check() that does not hold is
+// reported and counted, and main() returns non-zero if any failed.
+static int failures = 0;
+
+static void check(bool ok, const char *what) {
+  if (!ok) {
+    fprintf(stderr, "FAIL: %s\n", what);
+    ++failures;
+  }
+}
@@ -0,0 +1,66 @@
+// XXH64 against the reference values of xxHash: its sanity check buffer
+// (xxhsum.c) and a few strings.
+#include "../check.h"
+#include "hash/xxh64.h"
+#include <cstdio>
+#include <cstring>
+
+constexpr uint64_t PRIME32 = 2654435761U;
+constexpr uint64_t PRIME64 = 11400714785074694797ULL;
+constexpr size_t SANITY_SIZE = 2243;
+
+// the pseudo-random bytes the xxHash sanity checks hash
+static void fill(unsigned char *buffer, size_t size) {
+  uint64_t generator = PRIME32;
+  for (size_t i = 0; i < size; ++i) {
+    buffer[i] = (unsigned char)(generator >> 56);
+    generator *= PRIME64;
+  }
+}
+
+int main() {
+  static unsigned char buffer[SANITY_SIZE];
+  fill(buffer, sizeof(buffer));
+
+  // every path: empty input, the tail alone (14 bytes: 8, 4 and 1 byte
+  // steps), and the four accumulators followed by a tail (222 bytes)
+  static const struct {
+    size_t size;
+    uint64_t seed;
+    uint64_t hash;
+  } SANITY[] = {
+      {0, 0, 0xEF46DB3751D8E999ULL},
+      {0, PRIME32, 0xAC75FDA2929B17EFULL},
+      {1, 0, 0xE934A84ADB052768ULL},
+      {1, PRIME32, 0x5014607643A9B4C3ULL},
+      {14, 0, 0x8282DCC4994E35C8ULL},
+      {14, PRIME32, 0xC3BD6BF63DEB6DF0ULL},
+      {222, 0, 0xB641AE8CB691C174ULL},
+      {222, PRIME32, 0x20CB8AB7AE10C14AULL},
+  };
+  for (const auto &example : SANITY) {
+    char what[64];
+    snprintf(what, sizeof(what), "sanity buffer, %zu bytes, seed %llx",
+             example.size, (unsigned long long)example.seed);
+    check(xxh64(buffer, example.size, example.seed) == example.hash, what);
+  }
+
+  static const struct {
+    const char *data;
+    uint64_t hash;
+  } STRINGS[] = {
+      {"a", 0xD24EC4F1A98C6E5BULL},
+      {"abc", 0x44BC2CF5AD770999ULL},
+  };
+  for (const auto &example : STRINGS) {
+    check(xxh64(example.data, strlen(example.data)) == example.hash,
+          example.data);
+  }
+
+  if (failures) {
+    fprintf(stderr, "xxh64: %d failed\n", failures);
+    return 1;
+  }
+  printf("xxh64: ok\n");
+  return 0;
+}
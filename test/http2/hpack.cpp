@@ -0,0 +1,243 @@
+// HPACK and its Huffman code against the examples of RFC 7541 Appendix C.
+#include "../check.h"
+#include "http2/frame.h"
+#include "http2/hpack.h"
+#include <cstdio>
+#include <string>
+
+// "8286 8441" -> the bytes it spells
+static std::string hex(const char *s) {
+  std::string out;
+  int high = -1;
+  for (; *s; ++s) {
+    int v;
+    if (*s >= '0' && *s <= '9') {
+      v = *s - '0';
+    } else if (*s >= 'a' && *s <= 'f') {
+      v = *s - 'a' + 10;
+    } else {
+      continue;
+    }
+    if (high < 0) {
+      high = v;
+    } else {
+      out += (char)(high << 4 | v);
+      high = -1;
+    }
+  }
+  return out;
+}
+
+static void decodes(HpackDecoder &decoder, const char *block,
+                    const HeaderList &expected, const char *what) {
+  std::string bytes = hex(block);
+  HeaderList headers;
+  auto ret = decoder.decode(bytes.data(), bytes.size(), headers);
+  check(ret.is_ok() && headers == expected, what);
+}
+
+static void encodes(HpackEncoder &encoder, const HeaderList &headers,
+                    const char *block, const char *what) {
+  std::string out;
+  encoder.encode(headers, out);
+  check(out == hex(block), what);
+}
+
+static const HeaderList REQUEST1 = {{":method", "GET"},
+                                    {":scheme", "http"},
+                                    {":path", "/"},
+                                    {":authority", "www.example.com"}};
+static const HeaderList REQUEST2 = {{":method", "GET"},
+                                    {":scheme", "http"},
+                                    {":path", "/"},
+                                    {":authority", "www.example.com"},
+                                    {"cache-control", "no-cache"}};
+static const HeaderList REQUEST3 = {{":method", "GET"},
+                                    {":scheme", "https"},
+                                    {":path", "/index.html"},
+                                    {":authority", "www.example.com"},
+                                    {"custom-key", "custom-value"}};
+
+static const HeaderList RESPONSE1 = {
+    {":status", "302"},
+    {"cache-control", "private"},
+    {"date", "Mon, 21 Oct 2013 20:13:21 GMT"},
+    {"location", "https://www.example.com"}};
+static const HeaderList RESPONSE2 = {
+    {":status", "307"},
+    {"cache-control", "private"},
+    {"date", "Mon, 21 Oct 2013 20:13:21 GMT"},
+    {"location", "https://www.example.com"}};
+static const HeaderList RESPONSE3 = {
+    {":status", "200"},
+    {"cache-control", "private"},
+    {"date", "Mon, 21 Oct 2013 20:13:22 GMT"},
+    {"location", "https://www.example.com"},
+    {"content-encoding", "gzip"},
+    {"set-cookie",
+     "foo=ASDJKHQKBZXOQWEOPIUAXQWEOIU; max-age=3600; version=1"}};
+
+// C.2: header field representations
+static void field_examples() {
+  {
+    HpackDecoder decoder;
+    decodes(decoder,
+            "400a 6375 7374 6f6d 2d6b 6579 0d63 7573 746f 6d2d 6865 6164 "
+            "6572",
+            {{"custom-key", "custom-header"}}, "C.2.1 literal, indexed");
+    // the field is now the first dynamic entry
+    decodes(decoder, "be", {{"custom-key", "custom-header"}},
+            "C.2.1 dynamic entry");
+  }
+  {
+    HpackDecoder decoder;
+    decodes(decoder, "040c 2f73 616d 706c 652f 7061 7468",
+            {{":path", "/sample/path"}}, "C.2.2 literal, not indexed");
+  }
+  {
+    HpackDecoder decoder;
+    decodes(decoder, "1008 7061 7373 776f 7264 0673 6563 7265 74",
+            {{"password", "secret"}}, "C.2.3 literal, never indexed");
+  }
+  {
+    HpackDecoder decoder;
+    decodes(decoder, "82", {{":method", "GET"}}, "C.2.4 indexed");
+  }
+}
+
+// C.3 and C.4: requests, without and with Huffman coding
+static void request_examples() {
+  HpackDecoder plain;
+  decodes(plain, "8286 8441 0f77 7777 2e65 7861 6d70 6c65 2e63 6f6d",
+          REQUEST1, "C.3.1");
+  decodes(plain, "8286 84be 5808 6e6f 2d63 6163 6865", REQUEST2, "C.3.2");
+  decodes(plain,
+          "8287 85bf 400a 6375 7374 6f6d 2d6b 6579 0c63 7573 746f 6d2d "
+          "7661 6c75 65",
+          REQUEST3, "C.3.3");
+
+  HpackDecoder huffman;
+  decodes(huffman, "8286 8441 8cf1 e3c2 e5f2 3a6b a0ab 90f4 ff", REQUEST1,
+          "C.4.1");
+  decodes(huffman, "8286 84be 5886 a8eb 1064 9cbf", REQUEST2, "C.4.2");
+  decodes(huffman,
+          "8287 85bf 4088 25a8 49e9 5ba9 7d7f 8925 a849 e95b b8e8 b4bf",
+          REQUEST3, "C.4.3");
+
+  // the encoder indexes these fields and Huffman codes every string that
+  // gets shorter, exactly as in C.4
+  HpackEncoder encoder;
+  encodes(encoder, REQUEST1, "8286 8441 8cf1 e3c2 e5f2 3a6b a0ab 90f4 ff",
+          "C.4.1 encoded");
+  encodes(encoder, REQUEST2, "8286 84be 5886 a8eb 1064 9cbf", "C.4.2 encoded");
+  encodes(encoder, REQUEST3,
+          "8287 85bf 4088 25a8 49e9 5ba9 7d7f 8925 a849 e95b b8e8 b4bf",
+          "C.4.3 encoded");
+}
+
+// C.5 and C.6: responses with a 256-byte table, so entries get evicted
+static void response_examples() {
+  HpackDecoder plain(256);
+  decodes(plain,
+          "4803 3330 3258 0770 7269 7661 7465 611d 4d6f 6e2c 2032 3120 "
+          "4f63 7420 3230 3133 2032 303a 3133 3a32 3120 474d 546e 1768 "
+          "7474 7073 3a2f 2f77 7777 2e65 7861 6d70 6c65 2e63 6f6d",
+          RESPONSE1, "C.5.1");
+  decodes(plain, "4803 3330 37c1 c0bf", RESPONSE2, "C.5.2");
+  decodes(plain,
+          "88c1 611d 4d6f 6e2c 2032 3120 4f63 7420 3230 3133 2032 303a "
+          "3133 3a32 3220 474d 54c0 5a04 677a 6970 7738 666f 6f3d 4153 "
+          "444a 4b48 514b 425a 584f 5157 454f 5049 5541 5851 5745 4f49 "
+          "553b 206d 6178 2d61 6765 3d33 3630 303b 2076 6572 7369 6f6e "
+          "3d31",
+          RESPONSE3, "C.5.3");
+
+  HpackDecoder huffman(256);
+  decodes(huffman,
+          "4882 6402 5885 aec3 771a 4b61 96d0 7abe 9410 54d4 44a8 2005 "
+          "9504 0b81 66e0 82a6 2d1b ff6e 919d 29ad 1718 63c7 8f0b 97c8 "
+          "e9ae 82ae 43d3",
+          RESPONSE1, "C.6.1");
+  decodes(huffman, "4883 640e ffc1 c0bf", RESPONSE2, "C.6.2");
+  decodes(huffman,
+          "88c1 6196 d07a be94 1054 d444 a820 0595 040b 8166 e084 a62d "
+          "1bff c05a 839b d9ab 77ad 94e7 821d d7f2 e6c7 b335 dfdf cd5b "
+          "3960 d5af 2708 7f36 72c1 ab27 0fb5 291f 9587 3160 65c0 03ed "
+          "4ee5 b106 3d50 07",
+          RESPONSE3, "C.6.3");
+}
+
+// the Huffman-coded strings of C.4 and C.6
+static void huffman_examples() {
+  static const char *const STRINGS[][2] = {
+      {"www.example.com", "f1e3 c2e5 f23a 6ba0 ab90 f4ff"},
+      {"no-cache", "a8eb 1064 9cbf"},
+      {"custom-key", "25a8 49e9 5ba9 7d7f"},
+      {"custom-value", "25a8 49e9 5bb8 e8b4 bf"},
+      {"302", "6402"},
+      {"private", "aec3 771a 4b"},
+      {"Mon, 21 Oct 2013 20:13:21 GMT",
+       "d07a be94 1054 d444 a820 0595 040b 8166 e082 a62d 1bff"},
+      {"https://www.example.com",
+       "9d29 ad17 1863 c78f 0b97 c8e9 ae82 ae43 d3"},
+      {"gzip", "9bd9 ab"},
+  };
+
+  for (const auto &example : STRINGS) {
+    std::string plain = example[0];
+    std::string coded = hex(example[1]);
+
+    std::string encoded;
+    huffman_encode(plain, encoded);
+    check(encoded == coded && huffman_length(plain) == coded.size(),
+          example[0]);
+
+    std::string decoded;
+    auto ret = huffman_decode(coded.data(), coded.size(), decoded);
+    check(ret.is_ok() && decoded == plain, example[0]);
+  }
+
+  // padding longer than 7 bits, or not made of ones, is an error (5.2)
+  std::string decoded;
+  std::string padded = hex("a8eb 1064 9cbf ff");
+  check(huffman_decode(padded.data(), padded.size(), decoded).is_err(),
+        "padding of a whole byte");
+  decoded.clear();
+  std::string zeros = hex("18");
+  check(huffman_decode(zeros.data(), zeros.size(), decoded).is_err(),
+        "padding of zeros");
+}
+
+// references to one large dynamic entry are stopped by the list limit
+static void list_limit() {
+  HpackDecoder decoder;
+  // "x: " and 4000 bytes, added to the table, then repeated by index 62
+  std::string block = hex("4001 787f a11e");
+  block.append(4000, 'v');
+  block.append(20, (char)0xbe);
+  HeaderList headers;
+  auto ret = decoder.decode(block.data(), block.size(), headers);
+  check(ret.is_err() &&
+            ret.unwrap_err() == make_error_code(H2Err::enhance_your_calm),
+        "header list over HPACK_MAX_HEADER_LIST");
+
+  HpackDecoder larger(HPACK_DEFAULT_TABLE_SIZE, 1 << 20);
+  headers.clear();
+  ret = larger.decode(block.data(), block.size(), headers);
+  check(ret.is_ok() && headers.size() == 21, "header list under the limit");
+}
+
+int main() {
+  field_examples();
+  request_examples();
+  response_examples();
+  huffman_examples();
+  list_limit();
+
+  if (failures) {
+    fprintf(stderr, "hpack: %d failed\n", failures);
+    return 1;
+  }
+  printf("hpack: ok\n");
+  return 0;
+}